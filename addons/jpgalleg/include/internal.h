@@ -116,6 +116,9 @@
 #define PASS_WRITE		0
 #define PASS_COMPUTE_HUFFMAN    1
 
+/* Number of bits looked up at once when decoding huffman codes */
+#define HUFFMAN_LOOKAHEAD	9
+
 
 /* This expression is made to return:
  *   Quality = 100 -> Factor = 10
@@ -144,6 +147,7 @@ typedef struct HUFFMAN_TABLE
 	HUFFMAN_ENTRY entry[257];
 	HUFFMAN_ENTRY *entry_of_length[16];
 	HUFFMAN_ENTRY *code[256];
+	short lookahead[1 << HUFFMAN_LOOKAHEAD];
 } HUFFMAN_TABLE;
 
 
@@ -208,6 +212,7 @@ extern HUFFMAN_TABLE _jpeg_huffman_ac_table[];
 extern HUFFMAN_TABLE _jpeg_huffman_dc_table[];
 extern IO_BUFFER _jpeg_io;
 extern const unsigned char _jpeg_zigzag_scan[];
+extern const unsigned char _jpeg_natural_order[];
 extern const char *_jpeg_component_name[];
 
 
@@ -89,6 +89,8 @@ AJPG_FUNC(BITMAP *, load_jpg, (AL_CONST char *filename, RGB *palette));
 AJPG_FUNC(BITMAP *, load_jpg_ex, (AL_CONST char *filename, RGB *palette, void (*callback)(int progress)));
 AJPG_FUNC(BITMAP *, load_memory_jpg, (void *buffer, int size, RGB *palette));
 AJPG_FUNC(BITMAP *, load_memory_jpg_ex, (void *buffer, int size, RGB *palette, void (*callback)(int progress)));
+AJPG_FUNC(BITMAP *, load_jpg_scaled, (AL_CONST char *filename, RGB *palette, int scale, void (*callback)(int progress)));
+AJPG_FUNC(BITMAP *, load_memory_jpg_scaled, (void *buffer, int size, RGB *palette, int scale, void (*callback)(int progress)));
 
 AJPG_FUNC(int, save_jpg, (AL_CONST char *filename, BITMAP *image, AL_CONST RGB *palette));
 AJPG_FUNC(int, save_jpg_ex, (AL_CONST char *filename, BITMAP *image, AL_CONST RGB *palette, int quality, int flags, void (*callback)(int progress)));
@@ -35,6 +35,20 @@ static void (*idct)(short *block, short *dequant, short *output, short *workspac
 static void (*ycbcr2rgb)(intptr_t address, int y1, int cb1, int cr1, int y2, int cb2, int cr2, int y3, int cb3, int cr3, int y4, int cb4, int cr4);
 static void (*plot)(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4, short *cb, short *cr);
 static void (*progress_cb)(int percentage);
+static int scale_shift, scaled_idct_table[4][64];
+static unsigned int bit_buffer;
+static int bit_count, padding_bits, padding_past_end;
+
+/* Without the MMX routines the C versions are called directly, so that the
+ * compiler can inline them into the decoding loops.
+ */
+#ifdef JPGALLEG_MMX
+	#define IDCT			idct
+	#define YCBCR2RGB		ycbcr2rgb
+#else
+	#define IDCT			_jpeg_c_idct
+	#define YCBCR2RGB		_jpeg_c_ycbcr2rgb
+#endif
 
 
 
@@ -116,6 +130,21 @@ _jpeg_c_idct(short *data, short *output, short *dequant, short *workspace)
 	wsptr = (int *)workspace;
 	outptr = output;
 	for (i = 8; i; i--) {
+		if ((wsptr[1] | wsptr[2] | wsptr[3] | wsptr[4] | wsptr[5] | wsptr[6] | wsptr[7]) == 0) {
+			/* Only the DC term is left in this row, so it is flat */
+			temp = (wsptr[0] >> 5) + 128;
+			outptr[0] = temp;
+			outptr[1] = temp;
+			outptr[2] = temp;
+			outptr[3] = temp;
+			outptr[4] = temp;
+			outptr[5] = temp;
+			outptr[6] = temp;
+			outptr[7] = temp;
+			wsptr += 8;
+			outptr += 8;
+			continue;
+		}
 		tmp10 = wsptr[0] + wsptr[4];
 		tmp11 = wsptr[0] - wsptr[4];
 		tmp13 = wsptr[2] + wsptr[6];
@@ -150,6 +179,79 @@ _jpeg_c_idct(short *data, short *output, short *dequant, short *workspace)
 }
 
 
+/* init_scaled_idct:
+ *  Builds the tables used by idct_scaled(), for outputs of 1, 2, 4 and 8
+ *  samples. Entry [x * size + u] of each table is the weight of frequency u
+ *  in output sample x, times 256 and divided by the AAN factor already
+ *  applied to the quantization tables.
+ */
+static void
+init_scaled_idct(void)
+{
+	int shift, size, x, u;
+	double value;
+	
+	for (shift = 0; shift < 4; shift++) {
+		size = 1 << shift;
+		for (x = 0; x < size; x++) {
+			for (u = 0; u < size; u++) {
+				value = cos((2 * x + 1) * u * M_PI / (2 * size)) / SCALE_FACTOR(u);
+				if (u == 0)
+					value /= SQRT_2;
+				scaled_idct_table[shift][(x * size) + u] = (int)floor((value * 256.0) + 0.5);
+			}
+		}
+	}
+}
+
+
+/* idct_scaled:
+ *  Reduced inverse discrete cosine transform, used when decoding at 1/2, 1/4
+ *  or 1/8 of the original size. Only the lowest width x height frequencies
+ *  are used, and the output block has the same size, stored without gaps.
+ *  Subsampled chroma blocks are asked for at twice the size of luminance
+ *  ones, so they keep their resolution relative to the luminance.
+ */
+static void
+idct_scaled(short *data, short *output, short *dequant, int width, int height)
+{
+	int *h_table, *v_table;
+	int workspace[64];
+	short idct_workspace[130];
+	int x, y, i, sum;
+	
+	if ((width == 8) && (height == 8)) {
+		IDCT(data, output, dequant, idct_workspace);
+		return;
+	}
+	if ((width == 1) && (height == 1)) {
+		/* Just the DC term: the average of the block */
+		output[0] = ((data[0] * dequant[0]) >> 5) + 128;
+		return;
+	}
+	
+	h_table = scaled_idct_table[(width >= 2) + (width >= 4) + (width >= 8)];
+	v_table = scaled_idct_table[(height >= 2) + (height >= 4) + (height >= 8)];
+	
+	for (x = 0; x < width; x++) {
+		for (y = 0; y < height; y++) {
+			sum = 0;
+			for (i = 0; i < height; i++)
+				sum += v_table[(y * height) + i] * data[(i * 8) + x] * dequant[(i * 8) + x];
+			workspace[(y * width) + x] = sum >> 8;
+		}
+	}
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x++) {
+			sum = 0;
+			for (i = 0; i < width; i++)
+				sum += h_table[(x * width) + i] * workspace[(y * width) + i];
+			*output++ = (sum >> 12) + 128;
+		}
+	}
+}
+
+
 /* zigzag_reorder:
  *  Reorders a vector of 64 coefficients by the zigzag scan.
  */
@@ -185,8 +287,8 @@ free_huffman_table(HUFFMAN_TABLE *table)
 static int
 read_dht_chunk(void)
 {
-	int i, j, table_id, num_codes[16];
-	int code, value;
+	int i, j, k, table_id, num_codes[16];
+	int code, value, shift;
 	unsigned char data;
 	HUFFMAN_TABLE *table;
 	HUFFMAN_ENTRY *entry;
@@ -211,6 +313,7 @@ read_dht_chunk(void)
 			table = &_jpeg_huffman_dc_table[table_id];
 		for (i = 0; i < 16; i++)
 			num_codes[i] = _jpeg_getc();
+		memset(table->lookahead, 0, sizeof(table->lookahead));
 		code = 0;
 		for (i = 0; i < 16; i++) {
 			if (table->entry_of_length[i])
@@ -222,11 +325,24 @@ read_dht_chunk(void)
 				return -1;
 			}
 			for (j = 0; j < num_codes[i]; j++) {
+				if (code >= (1 << (i + 1))) {
+					TRACE("Invalid huffman table");
+					jpgalleg_error = JPG_ERROR_BAD_IMAGE;
+					return -1;
+				}
 				value = _jpeg_getc();
 				entry = &table->entry_of_length[i][code];
 				entry->value = value;
 				entry->encoded_value = code;
 				entry->bits_length = i + 1;
+				if (i < HUFFMAN_LOOKAHEAD) {
+					/* Short codes are also stored in the lookahead table, once
+					 * for every combination of the bits that follow them
+					 */
+					shift = HUFFMAN_LOOKAHEAD - (i + 1);
+					for (k = 0; k < (1 << shift); k++)
+						table->lookahead[(code << shift) | k] = ((i + 1) << 8) | (value & 0xff);
+				}
 				code++;
 			}
 			code <<= 1;
@@ -445,29 +561,115 @@ read_dri_chunk(void)
 }
 
 
-/* get_bits:
- *  Reads a string of bits from the input stream.
+/* reset_bits:
+ *  Empties the bit buffer; must be called before the entropy coded data of a
+ *  scan or restart interval starts.
  */
-static int
-get_bits(int num_bits)
+static void
+reset_bits(void)
+{
+	bit_buffer = 0;
+	bit_count = 0;
+	padding_bits = 0;
+	padding_past_end = FALSE;
+}
+
+
+/* fill_bits:
+ *  Loads bytes from the input stream into the bit buffer until it holds more
+ *  than 24 bits, taking care of 0xff00 sequences. When a marker or the end of
+ *  the buffer is reached, zero bits are loaded instead.
+ */
+static void
+fill_bits(void)
 {
-	int result = 0;
-	
-	while (_jpeg_io.current_bit < num_bits) {
-		result = (result << _jpeg_io.current_bit) | (*_jpeg_io.buffer & ((1 << _jpeg_io.current_bit) - 1));
-		num_bits -= _jpeg_io.current_bit;
-		_jpeg_io.current_bit = 8;
-		if (*_jpeg_io.buffer == 0xff)
-			_jpeg_io.buffer++;
+	int data;
+	
+	while (bit_count <= 24) {
 		if (_jpeg_io.buffer >= _jpeg_io.buffer_end) {
-			TRACE("Tried to read memory past buffer size");
-			jpgalleg_error = JPG_ERROR_INPUT_BUFFER_TOO_SMALL;
-			return 0x80000000;
+			data = 0;
+			padding_bits += 8;
+			padding_past_end = TRUE;
+		}
+		else if (*_jpeg_io.buffer == 0xff) {
+			if ((_jpeg_io.buffer + 1 < _jpeg_io.buffer_end) && (_jpeg_io.buffer[1] == 0)) {
+				data = 0xff;
+				_jpeg_io.buffer += 2;
+			}
+			else {
+				data = 0;
+				padding_bits += 8;
+			}
 		}
-		_jpeg_io.buffer++;
+		else
+			data = *_jpeg_io.buffer++;
+		bit_buffer |= (unsigned int)data << (24 - bit_count);
+		bit_count += 8;
+	}
+}
+
+
+/* align_bits:
+ *  Discards the bits left in the current byte, and gives back to the input
+ *  stream the whole bytes still held by the bit buffer, so that the next
+ *  _jpeg_getc() returns the byte following the entropy coded data.
+ */
+static void
+align_bits(void)
+{
+	int bytes = (bit_count - padding_bits) >> 3;
+	
+	while (bytes-- > 0) {
+		if ((_jpeg_io.buffer[-1] == 0) && (_jpeg_io.buffer[-2] == 0xff))
+			_jpeg_io.buffer -= 2;
+		else
+			_jpeg_io.buffer--;
+	}
+	_jpeg_io.current_bit = 8;
+	reset_bits();
+}
+
+
+/* peek_bits:
+ *  Returns the next 16 bits of the input stream without consuming them.
+ */
+static INLINE int
+peek_bits(void)
+{
+	if (bit_count < 16)
+		fill_bits();
+	return bit_buffer >> 16;
+}
+
+
+/* skip_bits:
+ *  Consumes up to 16 bits previously looked at with peek_bits().
+ */
+static INLINE void
+skip_bits(int num_bits)
+{
+	bit_buffer <<= num_bits;
+	bit_count -= num_bits;
+}
+
+
+/* get_bits:
+ *  Reads a string of up to 16 bits from the input stream.
+ */
+static INLINE int
+get_bits(int num_bits)
+{
+	int result;
+	
+	if (num_bits == 0)
+		return 0;
+	result = peek_bits() >> (16 - num_bits);
+	skip_bits(num_bits);
+	if ((padding_past_end) && (bit_count < padding_bits)) {
+		TRACE("Tried to read memory past buffer size");
+		jpgalleg_error = JPG_ERROR_INPUT_BUFFER_TOO_SMALL;
+		return 0x80000000;
 	}
-	result = (result << num_bits) | ((*_jpeg_io.buffer >> (_jpeg_io.current_bit - num_bits)) & ((1 << num_bits) - 1));
-	_jpeg_io.current_bit -= num_bits;
 	
 	return result;
 }
@@ -490,35 +692,31 @@ get_value(int category)
 
 /* huffman_decode:
  *  Fetches bits from the input stream until a valid huffman code is found,
- *  then returns the value associated with that code.
+ *  then returns the value associated with that code. Codes up to
+ *  HUFFMAN_LOOKAHEAD bits long, which are by far the most common, are found
+ *  with a single table lookup; longer ones are searched length by length.
  */
 static int
 huffman_decode(HUFFMAN_TABLE *table)
 {
 	HUFFMAN_ENTRY *entry, **entry_lut;
-	int i, value;
-	unsigned char *p = _jpeg_io.buffer;
-	
-	value = (*p & ((1 << _jpeg_io.current_bit) - 1)) << (16 - _jpeg_io.current_bit);
-	if (*p++ == 0xff) p++;
-	if (p < _jpeg_io.buffer_end) {
-		value |= *p << (8 - _jpeg_io.current_bit);
-		if (*p++ == 0xff) p++;
-		if (p < _jpeg_io.buffer_end)
-			value |= *p >> _jpeg_io.current_bit;
+	int i, value, code;
+	
+	value = peek_bits();
+	
+	code = table->lookahead[value >> (16 - HUFFMAN_LOOKAHEAD)];
+	if (code) {
+		skip_bits(code >> 8);
+		return code & 0xff;
 	}
 	
-	entry_lut = table->entry_of_length;
-	for (i = 15; i >= 0; i--) {
+	entry_lut = &table->entry_of_length[HUFFMAN_LOOKAHEAD];
+	for (i = 15 - HUFFMAN_LOOKAHEAD; i >= 0; i--) {
+		if (!*entry_lut)
+			return -1;
 		entry = &((*entry_lut)[value >> i]);
 		if (entry->bits_length == 16 - i) {
-			_jpeg_io.current_bit -= 16 - i;
-			while (_jpeg_io.current_bit <= 0) {
-				_jpeg_io.current_bit += 8;
-				if (*_jpeg_io.buffer == 0xff)
-					_jpeg_io.buffer++;
-				_jpeg_io.buffer++;
-			}
+			skip_bits(16 - i);
 			return entry->value;
 		}
 		entry_lut++;
@@ -536,10 +734,9 @@ decode_baseline_block(short *block, int type, int *old_dc)
 {
 	HUFFMAN_TABLE *dc_table, *ac_table;
 	short *quant_table;
-	int data, i, index;
+	int data, index;
 	int num_zeroes, category;
 	short workspace[130];
-	short pre_idct_block[80];
 	short ordered_pre_idct_block[64];
 	
 	if (type == LUMINANCE) {
@@ -562,7 +759,13 @@ decode_baseline_block(short *block, int type, int *old_dc)
 	if ((data = get_value(data & 0xf)) == (int)0x80000000)
 		return -1;
 	*old_dc += data;
-	pre_idct_block[0] = *old_dc;
+	
+	/* Coefficients go straight to their natural order position; most of
+	 * them are zero, so clearing the block first is cheaper than storing
+	 * the zero runs one by one.
+	 */
+	memset(ordered_pre_idct_block, 0, sizeof(ordered_pre_idct_block));
+	ordered_pre_idct_block[0] = *old_dc;
 	
 	index = 1;
 	do {
@@ -577,23 +780,21 @@ decode_baseline_block(short *block, int type, int *old_dc)
 		category = data & 0xf;
 		if (category != 0) {
 			/* Normal zero run length coding */
-			for (; num_zeroes; num_zeroes--)
-				pre_idct_block[index++] = 0;
+			index += num_zeroes;
 			if ((data = get_value(category)) == (int)0x80000000)
 				return -1;
-			pre_idct_block[index++] = data;
+			if (index < 64)
+				ordered_pre_idct_block[_jpeg_natural_order[index]] = data;
+			index++;
 		}
 		else {
 			if (num_zeroes == 0) {
 				/* End of block */
-				while (index < 64)
-					pre_idct_block[index++] = 0;
 				break;
 			}
 			else if (num_zeroes == 15) {
 				/* 16 zeroes special case */
-				for (i = 16; i; i--)
-					pre_idct_block[index++] = 0;
+				index += 16;
 			}
 			else {
 				TRACE("Bad ac data");
@@ -603,9 +804,12 @@ decode_baseline_block(short *block, int type, int *old_dc)
 		}
 	} while (index < 64);
 	
-	zigzag_reorder(pre_idct_block, ordered_pre_idct_block);
-	
-	idct(ordered_pre_idct_block, block, quant_table, workspace);
+	if ((scale_shift) && (type == LUMINANCE))
+		idct_scaled(ordered_pre_idct_block, block, quant_table, 8 >> scale_shift, 8 >> scale_shift);
+	else if (scale_shift)
+		idct_scaled(ordered_pre_idct_block, block, quant_table, (8 >> scale_shift) * h_sampling, (8 >> scale_shift) * v_sampling);
+	else
+		IDCT(ordered_pre_idct_block, block, quant_table, workspace);
 	
 	return 0;
 }
@@ -650,7 +854,7 @@ decode_progressive_block(intptr_t addr, int type, int *old_dc)
 		}
 		else {
 			/* DC successive approximation */
-			if ((data = _jpeg_get_bit()) < 0) {
+			if ((data = get_bits(1)) < 0) {
 				TRACE("Failed to get bit from input stream");
 				jpgalleg_error = JPG_ERROR_BAD_IMAGE;
 				return -1;
@@ -734,7 +938,7 @@ decode_progressive_block(intptr_t addr, int type, int *old_dc)
 						}
 					}
 					else if (category == 1) {
-						if ((data = _jpeg_get_bit()) < 0) {
+						if ((data = get_bits(1)) < 0) {
 							TRACE("Failed to get bit from input stream");
 							jpgalleg_error = JPG_ERROR_BAD_IMAGE;
 							return -1;
@@ -751,7 +955,7 @@ decode_progressive_block(intptr_t addr, int type, int *old_dc)
 					}
 					do {
 						if (block[index]) {
-							if ((data = _jpeg_get_bit()) < 0) {
+							if ((data = get_bits(1)) < 0) {
 								TRACE("Failed to get bit from input stream");
 								jpgalleg_error = JPG_ERROR_BAD_IMAGE;
 								return -1;
@@ -778,7 +982,7 @@ decode_progressive_block(intptr_t addr, int type, int *old_dc)
 			if (skip_count > 0) {
 				while (index <= spectrum_end) {
 					if (block[index]) {
-						if ((data = _jpeg_get_bit()) < 0) {
+						if ((data = get_bits(1)) < 0) {
 							TRACE("Failed to get bit from input stream");
 							jpgalleg_error = JPG_ERROR_BAD_IMAGE;
 							return -1;
@@ -886,7 +1090,7 @@ plot_444(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4, s
 	else {
 		for (y = 0; y < 8; y++) {
 			for (x = 0; x < 8; x += 4) {
-				ycbcr2rgb(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 2), *(cb_ptr + 2), *(cr_ptr + 2), *(y1_ptr + 3), *(cb_ptr + 3), *(cr_ptr + 3));
+				YCBCR2RGB(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 2), *(cb_ptr + 2), *(cr_ptr + 2), *(y1_ptr + 3), *(cb_ptr + 3), *(cr_ptr + 3));
 				y1_ptr += 4;
 				cb_ptr += 4;
 				cr_ptr += 4;
@@ -912,8 +1116,8 @@ plot_422_h(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4,
 	
 	for (y = 0; y < 8; y++) {
 		for (x = 0; x < 8; x += 4) {
-			ycbcr2rgb(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *cb_ptr, *cr_ptr, *(y1_ptr + 2), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 3), *(cb_ptr + 1), *(cr_ptr + 1));
-			ycbcr2rgb(addr + 24, *y2_ptr, *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 1), *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 2), *(cb_ptr + 5), *(cr_ptr + 5), *(y2_ptr + 3), *(cb_ptr + 5), *(cr_ptr + 5));
+			YCBCR2RGB(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *cb_ptr, *cr_ptr, *(y1_ptr + 2), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 3), *(cb_ptr + 1), *(cr_ptr + 1));
+			YCBCR2RGB(addr + 24, *y2_ptr, *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 1), *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 2), *(cb_ptr + 5), *(cr_ptr + 5), *(y2_ptr + 3), *(cb_ptr + 5), *(cr_ptr + 5));
 			y1_ptr += 4;
 			y2_ptr += 4;
 			cb_ptr += 2;
@@ -941,8 +1145,8 @@ plot_422_v(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4,
 	
 	for (y = 0; y < 8; y++) {
 		for (x = 0; x < 8; x += 4) {
-			ycbcr2rgb(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 2), *(cb_ptr + 2), *(cr_ptr + 2), *(y1_ptr + 3), *(cb_ptr + 3), *(cr_ptr + 3));
-			ycbcr2rgb(addr + (pitch * 8), *y2_ptr, *(cb_ptr + 32), *(cr_ptr + 32), *(y2_ptr + 1), *(cb_ptr + 33), *(cr_ptr + 33), *(y2_ptr + 2), *(cb_ptr + 34), *(cr_ptr + 34), *(y2_ptr + 3), *(cb_ptr + 35), *(cr_ptr + 35));
+			YCBCR2RGB(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 2), *(cb_ptr + 2), *(cr_ptr + 2), *(y1_ptr + 3), *(cb_ptr + 3), *(cr_ptr + 3));
+			YCBCR2RGB(addr + (pitch * 8), *y2_ptr, *(cb_ptr + 32), *(cr_ptr + 32), *(y2_ptr + 1), *(cb_ptr + 33), *(cr_ptr + 33), *(y2_ptr + 2), *(cb_ptr + 34), *(cr_ptr + 34), *(y2_ptr + 3), *(cb_ptr + 35), *(cr_ptr + 35));
 			y1_ptr += 4;
 			y2_ptr += 4;
 			cb_ptr += 4;
@@ -968,10 +1172,10 @@ plot_411(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4, s
 	
 	for (y = 0; y < 8; y++) {
 		for (x = 0; x < 8; x += 4) {
-			ycbcr2rgb(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *cb_ptr, *cr_ptr, *(y1_ptr + 2), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 3), *(cb_ptr + 1), *(cr_ptr + 1));
-			ycbcr2rgb(addr + 24, *y2_ptr, *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 1), *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 2), *(cb_ptr + 5), *(cr_ptr + 5), *(y2_ptr + 3), *(cb_ptr + 5), *(cr_ptr + 5));
-			ycbcr2rgb(addr + (pitch * 8), *y3_ptr, *(cb_ptr + 32), *(cr_ptr + 32), *(y3_ptr + 1), *(cb_ptr + 32), *(cr_ptr + 32), *(y3_ptr + 2), *(cb_ptr + 33), *(cr_ptr + 33), *(y3_ptr + 3), *(cb_ptr + 33), *(cr_ptr + 33));
-			ycbcr2rgb(addr + (pitch * 8) + 24, *y4_ptr, *(cb_ptr + 36), *(cr_ptr + 36), *(y4_ptr + 1), *(cb_ptr + 36), *(cr_ptr + 36), *(y4_ptr + 2), *(cb_ptr + 37), *(cr_ptr + 37), *(y4_ptr + 3), *(cb_ptr + 37), *(cr_ptr + 37));
+			YCBCR2RGB(addr, *y1_ptr, *cb_ptr, *cr_ptr, *(y1_ptr + 1), *cb_ptr, *cr_ptr, *(y1_ptr + 2), *(cb_ptr + 1), *(cr_ptr + 1), *(y1_ptr + 3), *(cb_ptr + 1), *(cr_ptr + 1));
+			YCBCR2RGB(addr + 24, *y2_ptr, *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 1), *(cb_ptr + 4), *(cr_ptr + 4), *(y2_ptr + 2), *(cb_ptr + 5), *(cr_ptr + 5), *(y2_ptr + 3), *(cb_ptr + 5), *(cr_ptr + 5));
+			YCBCR2RGB(addr + (pitch * 8), *y3_ptr, *(cb_ptr + 32), *(cr_ptr + 32), *(y3_ptr + 1), *(cb_ptr + 32), *(cr_ptr + 32), *(y3_ptr + 2), *(cb_ptr + 33), *(cr_ptr + 33), *(y3_ptr + 3), *(cb_ptr + 33), *(cr_ptr + 33));
+			YCBCR2RGB(addr + (pitch * 8) + 24, *y4_ptr, *(cb_ptr + 36), *(cr_ptr + 36), *(y4_ptr + 1), *(cb_ptr + 36), *(cr_ptr + 36), *(y4_ptr + 2), *(cb_ptr + 37), *(cr_ptr + 37), *(y4_ptr + 3), *(cb_ptr + 37), *(cr_ptr + 37));
 			y1_ptr += 4;
 			y2_ptr += 4;
 			y3_ptr += 4;
@@ -988,6 +1192,58 @@ plot_411(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4, s
 }
 
 
+/* plot_scaled:
+ *  Plots an MCU decoded by idct_scaled(), for any sampling mode. Luminance
+ *  blocks are (8 >> scale_shift) pixels wide, while the chroma blocks cover
+ *  the whole MCU with one sample per pixel.
+ */
+static void
+plot_scaled(intptr_t addr, int pitch, short *y1, short *y2, short *y3, short *y4, short *cb, short *cr)
+{
+	short *luminance[4];
+	short *y_ptr;
+	int size = 8 >> scale_shift;
+	int block_x, block_y, x, y, i;
+	int r, g, b, v, cb_v, cr_v;
+	intptr_t ptr;
+	
+	luminance[0] = y1;
+	luminance[1] = y2;
+	luminance[2] = y3;
+	luminance[3] = y4;
+	
+	for (block_y = 0; block_y < v_sampling; block_y++) {
+		for (block_x = 0; block_x < h_sampling; block_x++) {
+			y_ptr = luminance[(block_y * h_sampling) + block_x];
+			for (y = 0; y < size; y++) {
+				if (jpeg_components == 1) {
+					ptr = addr + (((block_y * size) + y) * pitch) + (block_x * size);
+					for (x = 0; x < size; x++) {
+						v = *y_ptr++;
+						*(unsigned char *)ptr = MID(0, v, 255);
+						ptr++;
+					}
+				}
+				else {
+					ptr = addr + (((block_y * size) + y) * pitch) + (block_x * size * 3);
+					for (x = 0; x < size; x++) {
+						i = (((block_y * size) + y) * size * h_sampling) + (block_x * size) + x;
+						v = *y_ptr++ << 8;
+						cb_v = cb[i] - 128;
+						cr_v = cr[i] - 128;
+						r = MID(0, (v                + (359 * cr_v)) >> 8, 255);
+						g = MID(0, (v -  (88 * cb_v) - (183 * cr_v)) >> 8, 255);
+						b = MID(0, (v + (453 * cb_v)               ) >> 8, 255);
+						WRITE3BYTES(ptr, makecol24(r, g, b));
+						ptr += 3;
+					}
+				}
+			}
+		}
+	}
+}
+
+
 #ifdef DEBUG
 static void
 dump_chunk(char *msg, int length)
@@ -1008,7 +1264,7 @@ dump_chunk(char *msg, int length)
  *  Main decoding function.
  */
 static BITMAP *
-do_decode(RGB *pal, void (*callback)(int))
+do_decode(RGB *pal, int scale, void (*callback)(int))
 {
 	const int x_ofs[4] = { 0, 1, 0, 1 }, y_ofs[4] = { 0, 0, 1, 1 };
 	short coefs_buffer[384], coefs[64], *coefs_ptr, *temp_ptr;
@@ -1026,10 +1282,15 @@ do_decode(RGB *pal, void (*callback)(int))
 	BITMAP *bmp;
 	int data, flags = 0;
 	int restart_count;
-	int depth;
+	int depth, image_w, image_h;
 	
 	jpgalleg_error = JPG_ERROR_NONE;
 	
+	for (scale_shift = 0; (scale_shift < 3) && (scale > 1); scale_shift++)
+		scale >>= 1;
+	if (scale_shift)
+		init_scaled_idct();
+	
 	TRACE("############### Decode start ###############");
 	
 #ifdef JPGALLEG_MMX
@@ -1205,7 +1466,9 @@ do_decode(RGB *pal, void (*callback)(int))
 	if (restart_interval <= 0)
 		flags &= ~DRI_DEFINED;
 	
-	bmp = create_bitmap_ex((jpeg_components == 1) ? 8 : 24, (jpeg_w + 15) & ~0xf, (jpeg_h + 15) & ~0xf);
+	image_w = (jpeg_w + 15) & ~0xf;
+	image_h = (jpeg_h + 15) & ~0xf;
+	bmp = create_bitmap_ex((jpeg_components == 1) ? 8 : 24, image_w >> scale_shift, image_h >> scale_shift);
 	if (!bmp) {
 		TRACE("Out of memory");
 		return NULL;
@@ -1254,17 +1517,20 @@ do_decode(RGB *pal, void (*callback)(int))
 				cr -= 64;
 			}
 		}
+		if (scale_shift)
+			plot = plot_scaled;
 		
-		progress_total = (bmp->w / mcu_w) * (bmp->h / mcu_h);
+		progress_total = (image_w / mcu_w) * (image_h / mcu_h);
 		
 		TRACE("%dx%d %s image, %s mode", jpeg_w, jpeg_h, jpeg_components == 1 ? "greyscale" : "color", plot == plot_444 ? "444" : (((plot == plot_422_h) || (plot == plot_422_v)) ? "422" : "411"));
 		/* Start decoding! */
+		reset_bits();
 		do {
 			for (i = 0; i < blocks_in_mcu; i++) {
 				if (decode_baseline_block(block_ptr[i], (block_component[i] == 0) ? LUMINANCE : CHROMINANCE, &old_dc[block_component[i]]))
 					goto exit_error;
 			}
-			addr = (intptr_t)bmp->line[block_y] + (block_x * (jpeg_components == 1 ? 1 : 3));
+			addr = (intptr_t)bmp->line[block_y >> scale_shift] + ((block_x >> scale_shift) * (jpeg_components == 1 ? 1 : 3));
 			plot(addr, pitch, y1, y2, y3, y4, cb, cr);
 			block_x += mcu_w;
 			if (block_x >= jpeg_w) {
@@ -1273,6 +1539,7 @@ do_decode(RGB *pal, void (*callback)(int))
 			}
 			restart_count++;
 			if ((flags & DRI_DEFINED) && (restart_count >= restart_interval)) {
+				align_bits();
 				data = _jpeg_getw();
 				if (data == CHUNK_EOI)
 					break;
@@ -1292,17 +1559,17 @@ do_decode(RGB *pal, void (*callback)(int))
 	else {
 		/* Progressive decoding */
 		TRACE("Starting progressive decoding");
-		blocks_per_row[0] = bmp->w / 8;
-		data_buffer[0] = (DATA_BUFFER *)calloc(1, sizeof(DATA_BUFFER) * (bmp->w / 8) * (bmp->h / 8));
+		blocks_per_row[0] = image_w / 8;
+		data_buffer[0] = (DATA_BUFFER *)calloc(1, sizeof(DATA_BUFFER) * (image_w / 8) * (image_h / 8));
 		if (!data_buffer[0]) {
 			TRACE("Out of memory");
 			jpgalleg_error = JPG_ERROR_OUT_OF_MEMORY;
 			goto exit_error;
 		}
 		for (i = 1; i < jpeg_components; i++) {
-			blocks_per_row[i] = bmp->w / (h_sampling * 8);
+			blocks_per_row[i] = image_w / (h_sampling * 8);
 			component_w[i] = component_h[i] = 1;
-			data_buffer[i] = (DATA_BUFFER *)calloc(1, sizeof(DATA_BUFFER) * (bmp->w / 8) * (bmp->h / 8) / sampling);
+			data_buffer[i] = (DATA_BUFFER *)calloc(1, sizeof(DATA_BUFFER) * (image_w / 8) * (image_h / 8) / sampling);
 			if (!data_buffer[i]) {
 				TRACE("Out of memory");
 				jpgalleg_error = JPG_ERROR_OUT_OF_MEMORY;
@@ -1310,7 +1577,7 @@ do_decode(RGB *pal, void (*callback)(int))
 			}
 		}
 		
-		progress_total = (2 + (3 * jpeg_components)) * blocks_per_row[0] * (bmp->h / (v_sampling * 8));
+		progress_total = (2 + (3 * jpeg_components)) * blocks_per_row[0] * (image_h / (v_sampling * 8));
 		
 		TRACE("%dx%d image, %s mode", jpeg_w, jpeg_h, sampling == 1 ? "444" : (sampling == 2 ? "422" : "411"));
 		while (1) {
@@ -1369,9 +1636,11 @@ do_decode(RGB *pal, void (*callback)(int))
 				(scan_components > 1 ? _jpeg_component_name[component[1] - 1] : ""),
 				(scan_components > 2 ? _jpeg_component_name[component[2] - 1] : ""), mcu_w, mcu_h);
 			/* Start decoding! */
+			reset_bits();
 			do {
 				restart_count++;
 				if ((flags & DRI_DEFINED) && (restart_count >= restart_interval)) {
+					align_bits();
 					data = _jpeg_getw();
 					if ((data < CHUNK_RST0) || (data > CHUNK_RST7)) {
 						TRACE("Expected RSTx chunk not found, found 0x%X instead", data);
@@ -1396,8 +1665,9 @@ do_decode(RGB *pal, void (*callback)(int))
 					progress_cb((progress_counter * 100) / progress_total);
 				progress_counter++;
 				if (progress_counter > progress_total)
-					progress_total += (bmp->w / mcu_w) * (bmp->h / mcu_h);
+					progress_total += (image_w / mcu_w) * (image_h / mcu_h);
 			} while (block_y < block_max_y);
+			align_bits();
 			/* Process inter-scan chunks */
 			while (1) {
 				while ((data = _jpeg_getc()) == 0xff)
@@ -1465,17 +1735,24 @@ eoi_found:
 				cr -= 64;
 			}
 		}
-		for (block_y = 0; block_y < bmp->h / mcu_h; block_y++) {
-			for (block_x = 0; block_x < bmp->w / mcu_w; block_x++) {
+		if (scale_shift)
+			plot = plot_scaled;
+		for (block_y = 0; block_y < image_h / mcu_h; block_y++) {
+			for (block_x = 0; block_x < image_w / mcu_w; block_x++) {
 				coefs_ptr = coefs_buffer;
 				for (i = 0; i < blocks_in_mcu; i++) {
 					c = block_component[i];
 					temp_ptr = data_buffer[c][(block_y * blocks_per_row[c] * component_h[c]) + (blocks_per_row[c] * block_y_ofs[i]) + (block_x * component_w[c]) + block_x_ofs[i]].data;
 					zigzag_reorder(temp_ptr, coefs);
-					idct(coefs, coefs_ptr, (c == 0) ? luminance_quantization_table : chrominance_quantization_table, workspace);
+					if ((scale_shift) && (c == 0))
+						idct_scaled(coefs, coefs_ptr, luminance_quantization_table, 8 >> scale_shift, 8 >> scale_shift);
+					else if (scale_shift)
+						idct_scaled(coefs, coefs_ptr, chrominance_quantization_table, (8 >> scale_shift) * h_sampling, (8 >> scale_shift) * v_sampling);
+					else
+						IDCT(coefs, coefs_ptr, (c == 0) ? luminance_quantization_table : chrominance_quantization_table, workspace);
 					coefs_ptr += 64;
 				}
-				addr = (intptr_t)bmp->line[block_y * mcu_h] + (block_x * mcu_w * (jpeg_components == 1 ? 1 : 3));
+				addr = (intptr_t)bmp->line[(block_y * mcu_h) >> scale_shift] + (((block_x * mcu_w) >> scale_shift) * (jpeg_components == 1 ? 1 : 3));
 				plot(addr, pitch, y1, y2, y3, y4, cb, cr);
 			}
 		}
@@ -1497,8 +1774,8 @@ eoi_found:
 	 * We assume final user always to access data via line pointers and NEVER
 	 * assume data is linearly stored in memory starting at bmp->dat...
 	 */
-	bmp->w = bmp->cr = jpeg_w;
-	bmp->h = bmp->cb = jpeg_h;
+	bmp->w = bmp->cr = (jpeg_w + (1 << scale_shift) - 1) >> scale_shift;
+	bmp->h = bmp->cb = (jpeg_h + (1 << scale_shift) - 1) >> scale_shift;
 	
 exit_ok:
 	for (i = 0; i < jpeg_components; i++) {
@@ -1536,6 +1813,17 @@ load_jpg(AL_CONST char *filename, RGB *palette)
  */
 BITMAP *
 load_jpg_ex(AL_CONST char *filename, RGB *palette, void (*callback)(int progress))
+{
+	return load_jpg_scaled(filename, palette, 1, callback);
+}
+
+
+/* load_jpg_scaled:
+ *  Loads a JPG image from a file into a BITMAP, reduced to 1/2, 1/4 or 1/8
+ *  of its size while decoding.
+ */
+BITMAP *
+load_jpg_scaled(AL_CONST char *filename, RGB *palette, int scale, void (*callback)(int progress))
 {
 	PACKFILE *f;
 	BITMAP *bmp;
@@ -1570,7 +1858,7 @@ load_jpg_ex(AL_CONST char *filename, RGB *palette, void (*callback)(int progress
 	
 	TRACE("Loading JPG from file %s", filename);
 	
-	bmp = do_decode(palette, callback);
+	bmp = do_decode(palette, scale, callback);
 	
 	free(_jpeg_io.buffer_start);
 	return bmp;
@@ -1593,6 +1881,17 @@ load_memory_jpg(void *buffer, int size, RGB *palette)
  */
 BITMAP *
 load_memory_jpg_ex(void *buffer, int size, RGB *palette, void (*callback)(int progress))
+{
+	return load_memory_jpg_scaled(buffer, size, palette, 1, callback);
+}
+
+
+/* load_memory_jpg_scaled:
+ *  Loads a JPG image from a memory buffer into a BITMAP, reduced to 1/2, 1/4
+ *  or 1/8 of its size while decoding.
+ */
+BITMAP *
+load_memory_jpg_scaled(void *buffer, int size, RGB *palette, int scale, void (*callback)(int progress))
 {
 	BITMAP *bmp;
 	PALETTE pal;
@@ -1605,7 +1904,7 @@ load_memory_jpg_ex(void *buffer, int size, RGB *palette, void (*callback)(int pr
 	
 	TRACE("Loading JPG from memory buffer at %p (size = %d)", buffer, size);
 	
-	bmp = do_decode(palette, callback);
+	bmp = do_decode(palette, scale, callback);
 
 	return bmp;
 }
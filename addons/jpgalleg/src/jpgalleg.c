@@ -37,6 +37,17 @@ const unsigned char _jpeg_zigzag_scan[64] = {
 	35,36,48,49,57,58,62,63
 };
 
+const unsigned char _jpeg_natural_order[64] = {
+	 0, 1, 8,16, 9, 2, 3,10,
+	17,24,32,25,18,11, 4, 5,
+	12,19,26,33,40,48,41,34,
+	27,20,13, 6, 7,14,21,28,
+	35,42,49,56,57,50,43,36,
+	29,22,15,23,30,37,44,51,
+	58,59,52,45,38,31,39,46,
+	53,60,61,54,47,55,62,63
+};
+
 const char *_jpeg_component_name[] = { "Y", "Cb", "Cr" };
 
 int jpgalleg_error = JPG_ERROR_NONE;
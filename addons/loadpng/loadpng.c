@@ -82,30 +82,19 @@ static int check_if_png(PACKFILE *fp)
 
 
 
-/* really_load_png:
- *  Worker routine, used by load_png and load_memory_png.
+/* set_read_transforms:
+ *  Sets up the libpng transformations shared by the loaders.  If
+ *  keep_indices is set, paletted images are left paletted even if they
+ *  have a tRNS chunk.
  */
-static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal)
+static void set_read_transforms(png_structp png_ptr, png_infop info_ptr, int keep_indices)
 {
-    BITMAP *bmp;
-    PALETTE tmppal;
-    png_uint_32 width, height, rowbytes;
-    int bit_depth, color_type, interlace_type;
+    int bit_depth, color_type;
     double image_gamma, screen_gamma;
     int intent;
-    int bpp, dest_bpp;
-    int tRNS_to_alpha = FALSE;
-    int number_passes, pass;
 
-    ASSERT(png_ptr && info_ptr);
-
-    /* The call to png_read_info() gives us all of the information from the
-     * PNG file before the first IDAT (image data chunk).
-     */
-    png_read_info(png_ptr, info_ptr);
-
-    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
-		 &interlace_type, NULL, NULL);
+    bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+    color_type = png_get_color_type(png_ptr, info_ptr);
 
     /* Extract multiple pixels with bit depths of 1, 2, and 4 from a single
      * byte into separate bytes (useful for paletted and grayscale images).
@@ -118,10 +107,8 @@ static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal
 
     /* Adds a full alpha channel if there is transparency information
      * in a tRNS chunk. */
-    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+    if ((!keep_indices) && (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)))
 	png_set_tRNS_to_alpha(png_ptr);
-	tRNS_to_alpha = TRUE;
-    }
 
     /* Convert 16-bits per colour component to 8-bits per colour component. */
     if (bit_depth == 16)
@@ -145,22 +132,16 @@ static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal
 		png_set_gamma(png_ptr, screen_gamma, 0.45455);
 	}
     }
+}
 
-    /* Turn on interlace handling. */
-    number_passes = png_set_interlace_handling(png_ptr);
-    
-    /* Call to gamma correct and add the background to the palette
-     * and update info structure.
-     */
-    png_read_update_info(png_ptr, info_ptr);
-    
-    /* Even if the user doesn't supply space for a palette, we want
-     * one for the load process.
-     */
-    if (!pal)
-	pal = tmppal;
-    
-    /* Palettes. */
+
+
+/* read_palette:
+ *  Copies the palette of a paletted image into pal, or generates a 332
+ *  palette for other images.  color_type is the type given in the header.
+ */
+static void read_palette(png_structp png_ptr, png_infop info_ptr, int color_type, RGB *pal)
+{
     if (color_type & PNG_COLOR_MASK_PALETTE) {
 	int num_palette, i;
 	png_colorp palette;
@@ -180,6 +161,66 @@ static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal
     else {
 	generate_332_palette(pal);
     }
+}
+
+
+
+/* set_bgr:
+ *  Maybe flip RGB to BGR, for 24 and 32-bit rows.
+ */
+static void set_bgr(png_structp png_ptr, int bpp)
+{
+    int c = makecol_depth(bpp, 0, 0, 255);
+    unsigned char *pc = (unsigned char *)&c;
+    if (pc[0] == 255)
+	png_set_bgr(png_ptr);
+#ifdef ALLEGRO_BIG_ENDIAN	    
+    png_set_swap_alpha(png_ptr);
+#endif	    
+}
+
+
+
+/* really_load_png:
+ *  Worker routine, used by load_png and load_memory_png.
+ */
+static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal)
+{
+    BITMAP *bmp;
+    PALETTE tmppal;
+    png_uint_32 width, height, rowbytes;
+    int bit_depth, color_type, interlace_type;
+    int bpp, dest_bpp;
+    int number_passes, pass;
+
+    ASSERT(png_ptr && info_ptr);
+
+    /* The call to png_read_info() gives us all of the information from the
+     * PNG file before the first IDAT (image data chunk).
+     */
+    png_read_info(png_ptr, info_ptr);
+
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
+		 &interlace_type, NULL, NULL);
+
+    set_read_transforms(png_ptr, info_ptr, FALSE);
+
+    /* Turn on interlace handling. */
+    number_passes = png_set_interlace_handling(png_ptr);
+    
+    /* Call to gamma correct and add the background to the palette
+     * and update info structure.
+     */
+    png_read_update_info(png_ptr, info_ptr);
+    
+    /* Even if the user doesn't supply space for a palette, we want
+     * one for the load process.
+     */
+    if (!pal)
+	pal = tmppal;
+    
+    /* Palettes. */
+    read_palette(png_ptr, info_ptr, color_type, pal);
 
     rowbytes = png_get_rowbytes(png_ptr, info_ptr);
 
@@ -194,15 +235,8 @@ static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal
     bmp = create_bitmap_ex(bpp, width, height);
 
     /* Maybe flip RGB to BGR. */
-    if ((bpp == 24) || (bpp == 32)) {
-	int c = makecol_depth(bpp, 0, 0, 255);
-	unsigned char *pc = (unsigned char *)&c;
-	if (pc[0] == 255)
-	    png_set_bgr(png_ptr);
-#ifdef ALLEGRO_BIG_ENDIAN	    
-	png_set_swap_alpha(png_ptr);
-#endif	    
-    }
+    if ((bpp == 24) || (bpp == 32))
+	set_bgr(png_ptr, bpp);
 
     /* Read the image, one line at a line (easier to debug!) */
     for (pass = 0; pass < number_passes; pass++) {
@@ -223,44 +257,158 @@ static BITMAP *really_load_png(png_structp png_ptr, png_infop info_ptr, RGB *pal
 
 
 
-/* load_png:
- *  Load a PNG file from disk, doing colour coversion if required.
+/* write_row:
+ *  Stores the first w pixels of a decoded row in line y of dest.  Native
+ *  rows are already in the format of dest, the others are RGB triplets.
  */
-BITMAP *load_png(AL_CONST char *filename, RGB *pal)
+static void write_row(BITMAP *dest, int y, AL_CONST unsigned char *src, int w, int native)
 {
-    PACKFILE *fp;
-    BITMAP *bmp;
+    int depth = bitmap_color_depth(dest);
+    int x, c;
 
-    ASSERT(filename);
+    if ((native) && (is_memory_bitmap(dest))) {
+	memcpy(dest->line[y], src, w * BYTES_PER_PIXEL(depth));
+	return;
+    }
 
-    fp = pack_fopen(filename, "r");
-    if (!fp)
-	return NULL;
+    for (x = 0; x < w; x++) {
+	if (!native)
+	    c = makecol_depth(depth, src[x*3], src[x*3+1], src[x*3+2]);
+	else if (depth == 8)
+	    c = src[x];
+	else if (depth == 24)
+	    c = READ3BYTES(src + x*3);
+	else
+	    c = ((AL_CONST uint32_t *)src)[x];
+
+	if (!is_memory_bitmap(dest))
+	    putpixel(dest, x, y, c);
+	else if (depth == 8)
+	    dest->line[y][x] = c;
+	else
+	    ((unsigned short *)dest->line[y])[x] = c;
+    }
+}
 
-    bmp = load_png_pf(fp, pal);
 
-    pack_fclose(fp);
 
-    return bmp;
+/* really_load_png_into:
+ *  Worker routine for the load_png_into functions.  Any memory it needs
+ *  is returned in *buffer, for the caller to free even if libpng bails
+ *  out halfway through.
+ */
+static int really_load_png_into(png_structp png_ptr, png_infop info_ptr, BITMAP *dest, RGB *pal, unsigned char **buffer)
+{
+    png_uint_32 width, height, rowbytes, y;
+    int bit_depth, color_type, interlace_type;
+    int depth = bitmap_color_depth(dest);
+    int keep_indices, native, direct;
+    int number_passes, pass;
+    int w, h, rows;
+    unsigned char *row;
+
+    ASSERT(png_ptr && info_ptr);
+
+    png_read_info(png_ptr, info_ptr);
+
+    png_get_IHDR(png_ptr, info_ptr, &width, &height, &bit_depth, &color_type,
+		 &interlace_type, NULL, NULL);
+
+    /* Paletted images go into 8-bit bitmaps as they are, anything else
+     * is decoded into the format of the bitmap if libpng can do it, or
+     * into RGB triplets which we convert ourselves.
+     */
+    keep_indices = ((depth == 8) && (color_type == PNG_COLOR_TYPE_PALETTE));
+    native = ((keep_indices) || (depth == 24) || (depth == 32));
+
+    set_read_transforms(png_ptr, info_ptr, keep_indices);
+
+    if (!keep_indices) {
+	if (color_type == PNG_COLOR_TYPE_PALETTE)
+	    png_set_palette_to_rgb(png_ptr);
+
+	if ((depth == 32) && (!(color_type & PNG_COLOR_MASK_ALPHA)) &&
+	    (!png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))) {
+#ifdef ALLEGRO_BIG_ENDIAN
+	    png_set_filler(png_ptr, 0, PNG_FILLER_BEFORE);
+#else
+	    png_set_filler(png_ptr, 0, PNG_FILLER_AFTER);
+#endif
+	}
+	else if (depth != 32)
+	    png_set_strip_alpha(png_ptr);
+
+	if ((depth == 24) || (depth == 32))
+	    set_bgr(png_ptr, depth);
+    }
+
+    number_passes = png_set_interlace_handling(png_ptr);
+
+    png_read_update_info(png_ptr, info_ptr);
+
+    /* Truecolor images in 8-bit bitmaps are matched against the current
+     * palette, so there is nothing to return.
+     */
+    if ((pal) && ((depth != 8) || (keep_indices)))
+	read_palette(png_ptr, info_ptr, color_type, pal);
+
+    rowbytes = png_get_rowbytes(png_ptr, info_ptr);
+    w = MIN(width, (png_uint_32)dest->w);
+    h = MIN(height, (png_uint_32)dest->h);
+
+    /* Rows that fit are read straight into memory bitmaps.  Otherwise we
+     * need a row to decode into, or the whole visible part of the image if
+     * it is interlaced, plus a row where the clipped rows are thrown away.
+     */
+    direct = ((native) && (is_memory_bitmap(dest)) && (width <= (png_uint_32)dest->w));
+    rows = ((direct) || (number_passes == 1)) ? 0 : h;
+
+    *buffer = _AL_MALLOC_ATOMIC(rowbytes * (rows + 1));
+    if (!*buffer)
+	return -1;
+
+    for (pass = 0; pass < number_passes; pass++) {
+	for (y = 0; y < height; y++) {
+	    if (y >= (png_uint_32)h)
+		row = *buffer + rowbytes * rows;
+	    else if (direct)
+		row = dest->line[y];
+	    else if (rows)
+		row = *buffer + rowbytes * y;
+	    else
+		row = *buffer;
+
+	    png_read_row(png_ptr, row, NULL);
+
+	    if ((!direct) && (!rows) && (y < (png_uint_32)h))
+		write_row(dest, y, row, w, native);
+	}
+    }
+
+    if (rows) {
+	for (y = 0; y < (png_uint_32)h; y++)
+	    write_row(dest, y, *buffer + rowbytes * y, w, native);
+    }
+
+    png_read_end(png_ptr, info_ptr);
+
+    return 0;
 }
 
 
 
-/* load_png_pf:
- *  Load a PNG file from disk, doing colour coversion if required.
+/* read_png:
+ *  Reads a PNG through read_fn, the signature being already checked.
+ *  Loads it into a new bitmap if dest is NULL, or into dest otherwise.
+ *  Returns the bitmap, or NULL on error.
  */
-BITMAP *load_png_pf(PACKFILE *fp, RGB *pal)
+static BITMAP *read_png(png_rw_ptr read_fn, void *io_ptr, BITMAP *dest, RGB *pal)
 {
     jmp_buf jmpbuf;
     BITMAP *bmp;
     png_structp png_ptr;
     png_infop info_ptr;
-
-    ASSERT(fp);
-
-    if (!check_if_png(fp)) {
-	return NULL;
-    }
+    unsigned char *volatile buffer = NULL;
 
     /* Create and initialize the png_struct with the desired error handler
      * functions.  If you want to use the default stderr and longjump method,
@@ -270,9 +418,8 @@ BITMAP *load_png_pf(PACKFILE *fp, RGB *pal)
      */
     png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
 				     (void *)NULL, NULL, NULL);
-    if (!png_ptr) {
+    if (!png_ptr)
 	return NULL;
-    }
 
     /* Allocate/initialize the memory for image information. */
     info_ptr = png_create_info_struct(png_ptr);
@@ -285,28 +432,79 @@ BITMAP *load_png_pf(PACKFILE *fp, RGB *pal)
     if (setjmp(jmpbuf)) {
 	/* Free all of the memory associated with the png_ptr and info_ptr */
 	png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+	if (buffer)
+	    _AL_FREE(buffer);
 	/* If we get here, we had a problem reading the file */
 	return NULL;
     }
     png_set_error_fn(png_ptr, jmpbuf, user_error_fn, NULL);
 
-    /* Use Allegro packfile routines. */
-    png_set_read_fn(png_ptr, fp, (png_rw_ptr)read_data);
+    png_set_read_fn(png_ptr, io_ptr, read_fn);
 
     /* We have already read some of the signature. */
     png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
 
     /* Really load the image now. */
-    bmp = really_load_png(png_ptr, info_ptr, pal);
+    if (dest) {
+	if (really_load_png_into(png_ptr, info_ptr, dest, pal, (unsigned char **)&buffer) == 0)
+	    bmp = dest;
+	else
+	    bmp = NULL;
+    }
+    else
+	bmp = really_load_png(png_ptr, info_ptr, pal);
 
     /* Clean up after the read, and free any memory allocated. */
     png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
 
+    if (buffer)
+	_AL_FREE(buffer);
+
     return bmp;
 }
 
 
 
+/* load_png:
+ *  Load a PNG file from disk, doing colour coversion if required.
+ */
+BITMAP *load_png(AL_CONST char *filename, RGB *pal)
+{
+    PACKFILE *fp;
+    BITMAP *bmp;
+
+    ASSERT(filename);
+
+    fp = pack_fopen(filename, "r");
+    if (!fp)
+	return NULL;
+
+    bmp = load_png_pf(fp, pal);
+
+    pack_fclose(fp);
+
+    return bmp;
+}
+
+
+
+/* load_png_pf:
+ *  Load a PNG file from disk, doing colour coversion if required.
+ */
+BITMAP *load_png_pf(PACKFILE *fp, RGB *pal)
+{
+    ASSERT(fp);
+
+    if (!check_if_png(fp)) {
+	return NULL;
+    }
+
+    /* Use Allegro packfile routines. */
+    return read_png((png_rw_ptr)read_data, fp, NULL, pal);
+}
+
+
+
 /* read_data_memory:
  *  Custom reader function to read a PNG file from a memory buffer.
  */
@@ -346,11 +544,7 @@ static int check_if_png_memory(AL_CONST void *buffer)
  */
 BITMAP *load_memory_png(AL_CONST void *buffer, int bufsize, RGB *pal)
 {
-    jmp_buf jmpbuf;
     MEMORY_READER_STATE memory_reader_state;
-    BITMAP *bmp;
-    png_structp png_ptr;
-    png_infop info_ptr;
 
     if (!buffer || (bufsize <= 0))
     	return NULL;
@@ -358,49 +552,75 @@ BITMAP *load_memory_png(AL_CONST void *buffer, int bufsize, RGB *pal)
     if (!check_if_png_memory(buffer))
 	return NULL;
 
-    /* Create and initialize the png_struct with the desired error handler
-     * functions.  If you want to use the default stderr and longjump method,
-     * you can supply NULL for the last three parameters.  We also supply the
-     * the compiler header file version, so that we know if the application
-     * was compiled with a compatible version of the library.
-     */
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING,
-				     (void *)NULL, NULL, NULL);
-    if (!png_ptr)
-	return NULL;
-
-    /* Allocate/initialize the memory for image information. */
-    info_ptr = png_create_info_struct(png_ptr);
-    if (!info_ptr) {
-	png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
-	return NULL;
-    }
-
-    /* Set error handling. */
-    if (setjmp(jmpbuf)) {
-	/* Free all of the memory associated with the png_ptr and info_ptr */
-	png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-	/* If we get here, we had a problem reading the file */
-	return NULL;
-    }
-    png_set_error_fn(png_ptr, jmpbuf, user_error_fn, NULL);
-
     /* Set up the reader state. */
     memory_reader_state.buffer = (unsigned char *)buffer;
     memory_reader_state.bufsize = bufsize;
     memory_reader_state.current_pos = PNG_BYTES_TO_CHECK;
 
     /* Tell libpng to use our custom reader. */
-    png_set_read_fn(png_ptr, &memory_reader_state, (png_rw_ptr)read_data_memory);
+    return read_png((png_rw_ptr)read_data_memory, &memory_reader_state, NULL, pal);
+}
 
-    /* We have already read some of the signature. */
-    png_set_sig_bytes(png_ptr, PNG_BYTES_TO_CHECK);
 
-    /* Really load the image now. */
-    bmp = really_load_png(png_ptr, info_ptr, pal);
 
-    /* Clean up after the read, and free any memory allocated. */
-    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-    
-    return bmp;
+/* load_png_into:
+ *  Decode a PNG file from disk into an existing bitmap.
+ */
+int load_png_into(AL_CONST char *filename, BITMAP *dest, RGB *pal)
+{
+    PACKFILE *fp;
+    int ret;
+
+    ASSERT(filename);
+    ASSERT(dest);
+
+    fp = pack_fopen(filename, "r");
+    if (!fp)
+	return -1;
+
+    ret = load_png_pf_into(fp, dest, pal);
+
+    pack_fclose(fp);
+
+    return ret;
+}
+
+
+
+/* load_png_pf_into:
+ *  Decode a PNG file from a packfile into an existing bitmap.
+ */
+int load_png_pf_into(PACKFILE *fp, BITMAP *dest, RGB *pal)
+{
+    ASSERT(fp);
+    ASSERT(dest);
+
+    if (!check_if_png(fp))
+	return -1;
+
+    return read_png((png_rw_ptr)read_data, fp, dest, pal) ? 0 : -1;
+}
+
+
+
+/* load_memory_png_into:
+ *  Decode a PNG file from memory into an existing bitmap.
+ */
+int load_memory_png_into(AL_CONST void *buffer, int bufsize, BITMAP *dest, RGB *pal)
+{
+    MEMORY_READER_STATE memory_reader_state;
+
+    ASSERT(dest);
+
+    if (!buffer || (bufsize <= 0))
+    	return -1;
+
+    if (!check_if_png_memory(buffer))
+	return -1;
+
+    memory_reader_state.buffer = (unsigned char *)buffer;
+    memory_reader_state.bufsize = bufsize;
+    memory_reader_state.current_pos = PNG_BYTES_TO_CHECK;
+
+    return read_png((png_rw_ptr)read_data_memory, &memory_reader_state, dest, pal) ? 0 : -1;
 }
@@ -63,9 +63,44 @@ APNG_FUNC(BITMAP *, load_png_pf, (PACKFILE *fp, RGB *pal));
 /* Load a PNG from memory. */
 APNG_FUNC(BITMAP *, load_memory_png, (AL_CONST void *buffer, int buffer_size, RGB *pal));
 
+/* Decode a PNG straight into an existing bitmap (or sub-bitmap), at its
+ * top left corner and clipped to its size, without an intermediate
+ * bitmap.  The pixels are written in the colour depth of the bitmap:
+ * paletted images go into 8-bit bitmaps as they are, truecolor images
+ * in 8-bit bitmaps are matched against the current palette, and any
+ * alpha channel is kept for 32-bit bitmaps only.  pal, if not NULL,
+ * receives the palette like it does for load_png (except for truecolor
+ * images in 8-bit bitmaps).  Memory bitmaps at least as wide as the
+ * image in 8 (paletted images), 24 or 32 bpp are decoded into directly.
+ * Return 0 on success or -1 on error.
+ */
+APNG_FUNC(int, load_png_into, (AL_CONST char *filename, BITMAP *dest, RGB *pal));
+APNG_FUNC(int, load_png_pf_into, (PACKFILE *fp, BITMAP *dest, RGB *pal));
+APNG_FUNC(int, load_memory_png_into, (AL_CONST void *buffer, int buffer_size, BITMAP *dest, RGB *pal));
+
 /* Save a bitmap to disk in PNG format. */
 APNG_FUNC(int, save_png, (AL_CONST char *filename, BITMAP *bmp, AL_CONST RGB *pal));
 
+/* Row filters for save_png_ex().  These have the same values as the
+ * PNG_FILTER_* flags in png.h and can be or'ed together, in which case
+ * libpng picks the best one for each row.  LOADPNG_FILTER_DEFAULT leaves
+ * the choice to libpng, which is what save_png() does.
+ */
+#define LOADPNG_FILTER_DEFAULT	0x00
+#define LOADPNG_FILTER_NONE	0x08
+#define LOADPNG_FILTER_SUB	0x10
+#define LOADPNG_FILTER_UP	0x20
+#define LOADPNG_FILTER_AVG	0x40
+#define LOADPNG_FILTER_PAETH	0x80
+#define LOADPNG_FILTER_ALL	0xF8
+
+/* Save a bitmap to disk in PNG format, with the given zlib compression
+ * level (0 to 9, or -1 for _png_compression_level) and row filters.
+ * Low levels with a single filter, such as 1 and LOADPNG_FILTER_SUB,
+ * are many times faster than the defaults, at the cost of bigger files.
+ */
+APNG_FUNC(int, save_png_ex, (AL_CONST char *filename, BITMAP *bmp, AL_CONST RGB *pal, int level, int filters));
+
 /* Adds `PNG' to Allegro's internal file type table.
  * You can then just use load_bitmap and save_bitmap as usual.
  */
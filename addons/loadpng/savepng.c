@@ -96,7 +96,37 @@ static int save_rgb(png_structp png_ptr, BITMAP *bmp)
     for (y=0; y<bmp->h; y++) {
 	unsigned char *p = rowdata;
 
-	if (depth == 15) {
+	if (is_memory_bitmap(bmp)) { /* fast path */
+	    if (depth == 15) {
+		unsigned short *s = (unsigned short *)bmp->line[y];
+		for (x = 0; x < bmp->w; x++) {
+		    int c = *s++;
+		    *p++ = getr15(c);
+		    *p++ = getg15(c);
+		    *p++ = getb15(c);
+		}
+	    }
+	    else if (depth == 16) {
+		unsigned short *s = (unsigned short *)bmp->line[y];
+		for (x = 0; x < bmp->w; x++) {
+		    int c = *s++;
+		    *p++ = getr16(c);
+		    *p++ = getg16(c);
+		    *p++ = getb16(c);
+		}
+	    }
+	    else { /* depth == 24 */
+		unsigned char *s = bmp->line[y];
+		for (x = 0; x < bmp->w; x++) {
+		    int c = READ3BYTES(s);
+		    s += 3;
+		    *p++ = getr24(c);
+		    *p++ = getg24(c);
+		    *p++ = getb24(c);
+		}
+	    }
+	}
+	else if (depth == 15) {
 	    for (x = 0; x < bmp->w; x++) {
 		int c = getpixel(bmp, x, y);
 		*p++ = getr15(c);
@@ -147,14 +177,27 @@ static int save_rgba(png_structp png_ptr, BITMAP *bmp)
 
     for (y=0; y<bmp->h; y++) {
 	unsigned char *p = rowdata;
-	
-        for (x=0; x<bmp->w; x++) {
-            int c = getpixel(bmp, x, y);
-	    *p++ = getr32(c);
-	    *p++ = getg32(c);
-	    *p++ = getb32(c);
-	    *p++ = geta32(c);
-        }
+
+	if (is_memory_bitmap(bmp)) { /* fast path */
+	    uint32_t *s = (uint32_t *)bmp->line[y];
+
+	    for (x=0; x<bmp->w; x++) {
+		int c = *s++;
+		*p++ = getr32(c);
+		*p++ = getg32(c);
+		*p++ = getb32(c);
+		*p++ = geta32(c);
+	    }
+	}
+	else {
+	    for (x=0; x<bmp->w; x++) {
+		int c = getpixel(bmp, x, y);
+		*p++ = getr32(c);
+		*p++ = getg32(c);
+		*p++ = getb32(c);
+		*p++ = geta32(c);
+	    }
+	}
 
         png_write_row(png_ptr, rowdata);
     }
@@ -166,11 +209,13 @@ static int save_rgba(png_structp png_ptr, BITMAP *bmp)
 
 
 
-/* save_png:
+/* really_save_png:
  *  Writes a non-interlaced, no-frills PNG, taking the usual save_xyz
- *  parameters.  Returns non-zero on error.
+ *  parameters plus the compression level and row filters (see
+ *  save_png_ex).  Returns non-zero on error.
  */
-static int really_save_png(PACKFILE *fp, BITMAP *bmp, AL_CONST RGB *pal)
+static int really_save_png(PACKFILE *fp, BITMAP *bmp, AL_CONST RGB *pal,
+			   int level, int filters)
 {
     jmp_buf jmpbuf;
     png_structp png_ptr = NULL;
@@ -221,7 +266,11 @@ static int really_save_png(PACKFILE *fp, BITMAP *bmp, AL_CONST RGB *pal)
 	colour_type = PNG_COLOR_TYPE_RGB;
 
     /* Set compression level. */
-    png_set_compression_level(png_ptr, _png_compression_level);
+    png_set_compression_level(png_ptr, level);
+
+    /* Set the row filters to try, otherwise libpng picks them itself. */
+    if (filters)
+	png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, filters);
 
     png_set_IHDR(png_ptr, info_ptr, bmp->w, bmp->h, 8, colour_type,
 		 PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
@@ -294,19 +343,31 @@ static int really_save_png(PACKFILE *fp, BITMAP *bmp, AL_CONST RGB *pal)
 
 
 int save_png(AL_CONST char *filename, BITMAP *bmp, AL_CONST RGB *pal)
+{
+    return save_png_ex(filename, bmp, pal, -1, LOADPNG_FILTER_DEFAULT);
+}
+
+
+
+int save_png_ex(AL_CONST char *filename, BITMAP *bmp, AL_CONST RGB *pal,
+		int level, int filters)
 {
     PACKFILE *fp;
     int result;
 
     ASSERT(filename);
     ASSERT(bmp);
+    ASSERT(level <= 9);
+
+    if (level < 0)
+	level = _png_compression_level;
 
     fp = pack_fopen(filename, "w");
     if (!fp)
 	return -1;
     
     acquire_bitmap(bmp);
-    result = really_save_png(fp, bmp, pal);
+    result = really_save_png(fp, bmp, pal, level, filters);
     release_bitmap(bmp);
 
     pack_fclose(fp);
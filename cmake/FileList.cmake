@@ -1,4 +1,5 @@
 set(ALLEGRO_SRC_FILES
+        src/aaprim.c
         src/allegro.c
         src/blit.c
         src/bmp.c
@@ -37,18 +38,22 @@ set(ALLEGRO_SRC_FILES
         src/lzss.c
         src/math.c
         src/math3d.c
+        src/mesh3d.c
         src/midi.c
         src/mixer.c
         src/modesel.c
         src/mouse.c
+        src/offline.c
         src/pcx.c
         src/poly3d.c
         src/polygon.c
+        src/polyrast.c
         src/quantize.c
         src/quat.c
         src/readbmp.c
         src/readfont.c
         src/readsmp.c
+        src/resample.c
         src/rle.c
         src/rotate.c
         src/rsfb.c
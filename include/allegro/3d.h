@@ -27,6 +27,7 @@
 #endif
 
 struct BITMAP;
+struct MATRIX_f;
 
 typedef struct V3D                  /* a 3d point (fixed point version) */
 {
@@ -73,6 +74,26 @@ AL_FUNC(void, _soft_quad3d_f, (struct BITMAP *bmp, int type, struct BITMAP *text
 AL_FUNC(int, clip3d, (int type, fixed min_z, fixed max_z, int vc, AL_CONST V3D *vtx[], V3D *vout[], V3D *vtmp[], int out[]));
 AL_FUNC(int, clip3d_f, (int type, float min_z, float max_z, int vc, AL_CONST V3D_f *vtx[], V3D_f *vout[], V3D_f *vtmp[], int out[]));
 
+#define MESH3D_CULL_BACKFACES       1
+#define MESH3D_SCENE                2
+
+typedef struct MESH3D_f             /* an indexed triangle mesh */
+{
+   int vc;                          /* number of vertices */
+   V3D_f *vtx;                      /* vertex buffer */
+   int tc;                          /* number of triangles */
+   int *idx;                        /* index buffer, three per triangle */
+   int ec;                          /* number of distinct edges */
+   int *tri_edge;                   /* three edge numbers per triangle */
+   int *edge_vtx;                   /* two vertex numbers per edge */
+   void *cache;                     /* transformed vertices and edges */
+} MESH3D_f;
+
+AL_FUNC(int, mesh3d_f, (struct BITMAP *bmp, int type, struct BITMAP *texture, AL_CONST struct MATRIX_f *camera, float min_z, float max_z, int vc, AL_CONST V3D_f vtx[], int tc, AL_CONST int idx[], int flags));
+AL_FUNC(MESH3D_f *, create_mesh3d_f, (int vc, AL_CONST V3D_f vtx[], int tc, AL_CONST int idx[]));
+AL_FUNC(void, destroy_mesh3d_f, (MESH3D_f *mesh));
+AL_FUNC(int, draw_mesh3d_f, (struct BITMAP *bmp, int type, struct BITMAP *texture, MESH3D_f *mesh, AL_CONST struct MATRIX_f *camera, float min_z, float max_z, int flags));
+
 AL_FUNC(fixed, polygon_z_normal, (AL_CONST V3D *v1, AL_CONST V3D *v2, AL_CONST V3D *v3));
 AL_FUNC(float, polygon_z_normal_f, (AL_CONST V3D_f *v1, AL_CONST V3D_f *v2, AL_CONST V3D_f *v3));
 
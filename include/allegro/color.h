@@ -91,12 +91,15 @@ AL_FUNC(void, unselect_palette, (void));
 
 AL_FUNC(void, generate_332_palette, (PALETTE pal));
 AL_FUNC(int, generate_optimized_palette, (struct BITMAP *image, PALETTE pal, AL_CONST signed char rsvdcols[256]));
+AL_FUNC(int, generate_median_cut_palette, (struct BITMAP *image, PALETTE pal, AL_CONST signed char rsvdcols[256]));
+AL_FUNC(void, remap_to_palette, (struct BITMAP *src, struct BITMAP *dest, AL_CONST PALETTE pal, int dither));
 
 AL_FUNC(void, create_rgb_table, (RGB_MAP *table, AL_CONST PALETTE pal, AL_METHOD(void, callback, (int pos))));
 AL_FUNC(void, create_light_table, (COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, int b, AL_METHOD(void, callback, (int pos))));
 AL_FUNC(void, create_trans_table, (COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, int b, AL_METHOD(void, callback, (int pos))));
 AL_FUNC(void, create_color_table, (COLOR_MAP *table, AL_CONST PALETTE pal, AL_METHOD(void, blend, (AL_CONST PALETTE pal, int x, int y, RGB *rgb)), AL_METHOD(void, callback, (int pos))));
 AL_FUNC(void, create_blender_table, (COLOR_MAP *table, AL_CONST PALETTE pal, AL_METHOD(void, callback, (int pos))));
+AL_FUNC(void, set_color_table_cache, (AL_CONST char *path));
 
 typedef AL_METHOD(unsigned long, BLENDER_FUNC, (unsigned long x, unsigned long y, unsigned long n));
 
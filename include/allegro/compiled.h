@@ -41,6 +41,20 @@ typedef struct COMPILED_SPRITE
    } proc[4];
 } COMPILED_SPRITE;
 
+#elif (defined ALLEGRO_AMD64) && (defined ALLEGRO_UNIX) && (!defined __ILP32__)
+
+struct RLE_SPRITE;
+
+/* compiled sprite structure */
+typedef struct COMPILED_SPRITE
+{
+   short color_depth;               /* color depth of the image */
+   short w, h;                      /* size of the sprite */
+   void *draw;                      /* routine to draw the image, or NULL */
+   int len;                         /* length of the drawing function */
+   struct RLE_SPRITE *rle;          /* used when the routine can't be */
+} COMPILED_SPRITE;
+
 #else
 
 /* emulate compiled sprites using RLE on other platforms */
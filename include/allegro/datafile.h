@@ -97,6 +97,12 @@ AL_FUNC(struct BITMAP *, load_pcx_pf, (PACKFILE *f, struct RGB *pal));
 AL_FUNC(struct BITMAP *, load_tga, (AL_CONST char *filename, struct RGB *pal));
 AL_FUNC(struct BITMAP *, load_tga_pf, (PACKFILE *f, struct RGB *pal));
 
+AL_FUNC(int, load_bitmap_lines, (AL_CONST char *filename, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp));
+AL_FUNC(int, load_bmp_lines, (AL_CONST char *filename, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp));
+AL_FUNC(int, load_bmp_lines_pf, (PACKFILE *f, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp));
+AL_FUNC(int, load_tga_lines, (AL_CONST char *filename, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp));
+AL_FUNC(int, load_tga_lines_pf, (PACKFILE *f, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp));
+
 AL_FUNC(int, save_bitmap, (AL_CONST char *filename, struct BITMAP *bmp, AL_CONST struct RGB *pal));
 AL_FUNC(int, save_bmp, (AL_CONST char *filename, struct BITMAP *bmp, AL_CONST struct RGB *pal));
 AL_FUNC(int, save_bmp_pf, (PACKFILE *f, struct BITMAP *bmp, AL_CONST struct RGB *pal));
@@ -106,6 +112,7 @@ AL_FUNC(int, save_tga, (AL_CONST char *filename, struct BITMAP *bmp, AL_CONST st
 AL_FUNC(int, save_tga_pf, (PACKFILE *f, struct BITMAP *bmp, AL_CONST struct RGB *pal));
 
 AL_FUNC(void, register_bitmap_file_type, (AL_CONST char *ext, AL_METHOD(struct BITMAP *, load, (AL_CONST char *filename, struct RGB *pal)), AL_METHOD(int, save, (AL_CONST char *filename, struct BITMAP *bmp, AL_CONST struct RGB *pal))));
+AL_FUNC(void, register_bitmap_file_lines, (AL_CONST char *ext, AL_METHOD(int, load_lines, (AL_CONST char *filename, struct RGB *pal, AL_METHOD(int, callback, (struct BITMAP *line, int y, int h, void *dp)), void *dp))));
 
 #ifdef __cplusplus
    }
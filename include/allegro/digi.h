@@ -48,6 +48,7 @@ typedef struct SAMPLE                  /* a sample */
 
 #define DIGI_AUTODETECT       -1       /* for passing to install_sound() */
 #define DIGI_NONE             0
+#define DIGI_RENDER           AL_ID('R','E','N','D')   /* offline, see render_sound() */
 
 typedef struct DIGI_DRIVER             /* driver for playing digital sfx */
 {
@@ -136,7 +137,10 @@ AL_VAR(int, digi_card);
 
 AL_VAR(int, digi_input_card);
 
+AL_VAR(DIGI_DRIVER, digi_render);
+
 AL_FUNC(int, detect_digi_driver, (int driver_id));
+AL_FUNC(int, render_sound, (void *buf, int len));
 
 
 AL_FUNC(SAMPLE *, load_sample, (AL_CONST char *filename));
@@ -147,6 +151,8 @@ AL_FUNC(SAMPLE *, load_voc_pf, (struct PACKFILE *f));
 AL_FUNC(int, save_sample, (AL_CONST char *filename, SAMPLE *spl));
 AL_FUNC(SAMPLE *, create_sample, (int bits, int stereo, int freq, int len));
 AL_FUNC(void, destroy_sample, (SAMPLE *spl));
+AL_FUNC(SAMPLE *, convert_sample, (AL_CONST SAMPLE *spl, int bits, int stereo, int freq));
+AL_FUNC(void, set_sample_load_format, (int bits, int stereo, int freq));
 
 AL_FUNC(int, play_sample, (AL_CONST SAMPLE *spl, int vol, int pan, int freq, int loop));
 AL_FUNC(void, stop_sample, (AL_CONST SAMPLE *spl));
@@ -34,6 +34,11 @@
 #define DRAW_MODE_MASKED_PATTERN    4
 #define DRAW_MODE_TRANS             5
 
+#define DRAW_FILTER_NEAREST         0        /* flags for the *_filtered() functions */
+#define DRAW_FILTER_BILINEAR        1
+#define DRAW_FILTER_BICUBIC         2
+#define DRAW_FILTER_MIPMAP          0x100
+
 AL_FUNC(void, drawing_mode, (int mode, struct BITMAP *pattern, int x_anchor, int y_anchor));
 AL_FUNC(void, xor_mode, (int on));
 AL_FUNC(void, solid_mode, (void));
@@ -51,14 +56,39 @@ AL_FUNC(void, do_arc, (struct BITMAP *bmp, int x, int y, fixed ang1, fixed ang2,
 AL_FUNC(void, _soft_arc, (struct BITMAP *bmp, int x, int y, fixed ang1, fixed ang2, int r, int color));
 AL_FUNC(void, calc_spline, (AL_CONST int points[8], int npts, int *x, int *y));
 AL_FUNC(void, _soft_spline, (struct BITMAP *bmp, AL_CONST int points[8], int color));
+
+typedef struct POLYGON_RASTER POLYGON_RASTER;
+
+AL_FUNC(POLYGON_RASTER *, create_polygon_raster, (void));
+AL_FUNC(void, destroy_polygon_raster, (POLYGON_RASTER *pr));
+AL_FUNC(void, raster_polygon, (POLYGON_RASTER *pr, struct BITMAP *bmp, int vertices, AL_CONST int *points, int color));
+AL_FUNC(void, raster_polygons, (POLYGON_RASTER *pr, struct BITMAP *bmp, int count, AL_CONST int *vertices, AL_CONST int *points, AL_CONST int *colors));
+AL_FUNC(void, raster_polygon_aa, (POLYGON_RASTER *pr, struct BITMAP *bmp, int vertices, AL_CONST fixed *points, int color));
+AL_FUNC(void, line_aa, (struct BITMAP *bmp, fixed x1, fixed y1, fixed x2, fixed y2, int color));
+AL_FUNC(void, circle_aa, (struct BITMAP *bmp, fixed x, fixed y, fixed radius, int color));
+AL_FUNC(void, circlefill_aa, (struct BITMAP *bmp, fixed x, fixed y, fixed radius, int color));
+AL_FUNC(void, ellipse_aa, (struct BITMAP *bmp, fixed x, fixed y, fixed rx, fixed ry, int color));
+AL_FUNC(void, ellipsefill_aa, (struct BITMAP *bmp, fixed x, fixed y, fixed rx, fixed ry, int color));
+AL_FUNC(void, arc_aa, (struct BITMAP *bmp, fixed x, fixed y, fixed ang1, fixed ang2, fixed r, int color));
+AL_FUNC(void, spline_aa, (struct BITMAP *bmp, AL_CONST fixed points[8], int color));
 AL_FUNC(void, _soft_floodfill, (struct BITMAP *bmp, int x, int y, int color));
 AL_FUNC(void, blit, (struct BITMAP *source, struct BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
 AL_FUNC(void, masked_blit, (struct BITMAP *source, struct BITMAP *dest, int source_x, int source_y, int dest_x, int dest_y, int width, int height));
 AL_FUNC(void, stretch_blit, (struct BITMAP *s, struct BITMAP *d, int s_x, int s_y, int s_w, int s_h, int d_x, int d_y, int d_w, int d_h));
 AL_FUNC(void, masked_stretch_blit, (struct BITMAP *s, struct BITMAP *d, int s_x, int s_y, int s_w, int s_h, int d_x, int d_y, int d_w, int d_h));
+AL_FUNC(void, stretch_blit_filtered, (struct BITMAP *s, struct BITMAP *d, int s_x, int s_y, int s_w, int s_h, int d_x, int d_y, int d_w, int d_h, int filter));
 AL_FUNC(void, stretch_sprite, (struct BITMAP *bmp, struct BITMAP *sprite, int x, int y, int w, int h));
 AL_FUNC(void, _soft_draw_gouraud_sprite, (struct BITMAP *bmp, struct BITMAP *sprite, int x, int y, int c1, int c2, int c3, int c4));
 
+/* rotate+filter */
+typedef struct MIPMAP MIPMAP;
+
+AL_FUNC(void, rotate_scaled_sprite_filtered, (BITMAP *bmp, BITMAP *sprite, int x, int y, fixed angle, fixed scale, int filter));
+AL_FUNC(void, pivot_scaled_sprite_filtered, (BITMAP *bmp, BITMAP *sprite, int x, int y, int cx, int cy, fixed angle, fixed scale, int filter));
+AL_FUNC(MIPMAP *, create_mipmap, (BITMAP *sprite));
+AL_FUNC(void, destroy_mipmap, (MIPMAP *mip));
+AL_FUNC(void, rotate_scaled_sprite_mipmap, (BITMAP *bmp, MIPMAP *mip, int x, int y, fixed angle, fixed scale, int filter));
+AL_FUNC(void, pivot_scaled_sprite_mipmap, (BITMAP *bmp, MIPMAP *mip, int x, int y, int cx, int cy, fixed angle, fixed scale, int filter));
 /* rotate+trans */
 AL_FUNC(void, rotate_sprite_trans, (BITMAP *bmp, BITMAP *sprite, int x, int y, fixed angle));
 AL_FUNC(void, rotate_sprite_v_flip_trans, (BITMAP *bmp, BITMAP *sprite, int x, int y, fixed angle));
@@ -34,6 +34,22 @@ struct BITMAP;
 #define FLI_ERROR       -2
 #define FLI_NOT_OPEN    -3
 
+#define FLI_INDEX       1              /* flags for open_fli_player() */
+
+typedef struct FLI_PLAYER              /* an independent FLI player */
+{
+   struct BITMAP *bitmap;              /* current frame of the FLI */
+   PALETTE palette;                    /* current palette the FLI is using */
+   int bmp_dirty_from;                 /* what part of bitmap is dirty */
+   int bmp_dirty_to;
+   int pal_dirty_from;                 /* what part of palette is dirty */
+   int pal_dirty_to;
+   int frame;                          /* frames read so far */
+   int frame_count;                    /* frames in the FLI */
+   int speed;                          /* milliseconds per frame */
+   void *extra;                        /* decoder state, private */
+} FLI_PLAYER;
+
 AL_FUNC(int, play_fli, (AL_CONST char *filename, struct BITMAP *bmp, int loop, AL_METHOD(int, callback, (void))));
 AL_FUNC(int, play_fli_pf, (PACKFILE *pf, struct BITMAP *bmp, AL_METHOD(int, callback, (void))));
 AL_FUNC(int, play_memory_fli, (void *fli_data, struct BITMAP *bmp, int loop, AL_METHOD(int, callback, (void))));
@@ -45,6 +61,16 @@ AL_FUNC(void, close_fli, (void));
 AL_FUNC(int, next_fli_frame, (int loop));
 AL_FUNC(void, reset_fli_variables, (void));
 
+AL_FUNC(FLI_PLAYER *, open_fli_player, (AL_CONST char *filename, int flags));
+AL_FUNC(FLI_PLAYER *, open_fli_player_pf, (PACKFILE *pf));
+AL_FUNC(FLI_PLAYER *, open_memory_fli_player, (void *fli_data, int flags));
+AL_FUNC(void, close_fli_player, (FLI_PLAYER *fli));
+AL_FUNC(int, next_fli_player_frame, (FLI_PLAYER *fli, int loop));
+AL_FUNC(int, seek_fli_player, (FLI_PLAYER *fli, int frame));
+AL_FUNC(void, reset_fli_player_variables, (FLI_PLAYER *fli));
+AL_FUNC(void, blit_fli_player_dirty, (FLI_PLAYER *fli, struct BITMAP *dest, int dest_x, int dest_y));
+AL_FUNC(int, play_fli_player, (FLI_PLAYER *fli, struct BITMAP *bmp, int loop, AL_METHOD(int, callback, (void))));
+
 AL_VAR(struct BITMAP *, fli_bitmap);   /* current frame of the FLI */
 AL_VAR(PALETTE, fli_palette);          /* current FLI palette */
 
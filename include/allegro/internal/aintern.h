@@ -392,6 +392,7 @@ AL_FUNC(int, _color_load_depth, (int depth, int hasalpha));
 AL_VAR(int, _color_conv);
 
 AL_FUNC(BITMAP *, _fixup_loaded_bitmap, (BITMAP *bmp, PALETTE pal, int bpp));
+AL_FUNC(int, _feed_bitmap_lines, (BITMAP *bmp, AL_METHOD(int, callback, (BITMAP *line, int y, int h, void *dp)), void *dp));
 
 AL_FUNC(int, _bitmap_has_alpha, (BITMAP *bmp));
 
@@ -433,6 +434,8 @@ AL_VAR(unsigned int, _drawing_y_mask);
 
 AL_FUNCPTR(int *, _palette_expansion_table, (int bpp));
 
+AL_FUNC(void, _get_dither_row, (int depth, int y, AL_CONST unsigned short *row[8]));
+
 AL_VAR(int, _color_depth);
 
 AL_VAR(int, _current_palette_changed);
@@ -842,6 +845,37 @@ typedef struct POLYGON_INFO         /* a polygon waiting rendering */
 } POLYGON_INFO;
 
 
+typedef struct POLY_AA_EDGE         /* an edge for the anti-aliaser */
+{
+   int top, bottom;                 /* first and past the last sub-scanline */
+   int x, dx;                       /* 16.16 position relative to the clip */
+   int dir;                         /* +1 going down, -1 going up */
+} POLY_AA_EDGE;
+
+
+struct POLYGON_RASTER               /* reusable polygon rasteriser */
+{
+   POLYGON_EDGE *edge;              /* edge table */
+   int edge_size;
+   POLYGON_EDGE **order;            /* edges sorted by top line */
+   int order_size;
+   POLY_AA_EDGE *aa_edge;           /* anti-aliased edge table */
+   int aa_edge_size;
+   int *active;                     /* active anti-aliased edges */
+   int active_size;
+   int *cross;                      /* crossings of a sub-scanline */
+   int cross_size;
+   int *cover;                      /* coverage of the current pixel row */
+   int cover_size;
+   int cover_x, cover_w;            /* pixels the coverage buffer spans */
+   int cover_min, cover_max;        /* part of it that has been touched */
+};
+
+
+AL_FUNC(int, _poly_raster_grow, (void **buf, int *buf_size, int size));
+AL_FUNC(void, _poly_raster_aa, (struct POLYGON_RASTER *pr, BITMAP *bmp, int contours, AL_CONST int *counts, AL_CONST fixed *points, int color));
+
+
 /* global variable for z-buffer */
 AL_VAR(BITMAP *, _zbuffer);
 
@@ -855,6 +889,7 @@ AL_FUNC(int, _fill_3d_edge_structure_f, (POLYGON_EDGE *edge, AL_CONST V3D_f *v1,
 AL_FUNC(SCANLINE_FILLER, _get_scanline_filler, (int type, int *flags, POLYGON_SEGMENT *info, BITMAP *texture, BITMAP *bmp));
 AL_FUNC(void, _clip_polygon_segment, (POLYGON_SEGMENT *info, fixed gap, int flags));
 AL_FUNC(void, _clip_polygon_segment_f, (POLYGON_SEGMENT *info, int gap, int flags));
+AL_FUNC(void, _soft_triangle3d_edges_f, (BITMAP *bmp, int type, BITMAP *texture, V3D_f *v[3], AL_CONST POLYGON_EDGE *edge[3], AL_CONST int ok[3]));
 
 
 /* polygon scanline filler functions */
@@ -1148,6 +1183,9 @@ AL_FUNC(void, _mixer_stop_pan_sweep, (int voice));
 AL_FUNC(void, _mixer_set_echo, (int voice, int strength, int delay));
 AL_FUNC(void, _mixer_set_tremolo, (int voice, int rate, int depth));
 AL_FUNC(void, _mixer_set_vibrato, (int voice, int rate, int depth));
+AL_FUNC(int,  _mixer_set_sequencer, (AL_METHOD(void, proc, (void)), int delay));
+AL_FUNC(int,  _mixer_set_refill, (int voice, AL_METHOD(void, proc, (void *param, int pos, int count)), void *param));
+AL_FUNC(void, _mixer_render, (void *buf, int len, int issigned));
 
 AL_FUNC(void, _dummy_noop1, (int p));
 AL_FUNC(void, _dummy_noop2, (int p1, int p2));
@@ -1211,6 +1249,9 @@ AL_FUNC(void, _register_bitmap_file_type_init, (void));
 /* for readsmp.c */
 AL_FUNC(void, _register_sample_file_type_init, (void));
 
+/* for the sample loaders */
+AL_FUNC(SAMPLE *, _convert_loaded_sample, (SAMPLE *spl));
+
 /* for readfont.c */
 AL_FUNC(void, _register_font_file_type_init, (void));
 
@@ -87,6 +87,9 @@ typedef struct MIDI_DRIVER             /* driver for playing midi music */
 
 AL_VAR(MIDI_DRIVER, midi_digmid);
 
+#define MIDI_TIMING_TIMER     0
+#define MIDI_TIMING_MIXER     1
+
 AL_ARRAY(_DRIVER_INFO, _midi_driver_list);
 
 
@@ -131,6 +134,10 @@ AL_FUNC(int, midi_seek, (int target));
 AL_FUNC(int, get_midi_length, (MIDI *midi));
 AL_FUNC(void, midi_out, (unsigned char *data, int length));
 AL_FUNC(int, load_midi_patches, (void));
+AL_FUNC(int, save_midi_patch_cache, (AL_CONST char *filename));
+AL_FUNC(int, set_midi_timing, (int mode));
+AL_FUNC(long, render_midi, (MIDI *midi, void *buf, long len));
+AL_FUNC(long, render_midi_wav, (MIDI *midi, struct PACKFILE *f));
 
 AL_FUNCPTR(void, midi_msg_callback, (int msg, int byte1, int byte2));
 AL_FUNCPTR(void, midi_meta_callback, (int type, AL_CONST unsigned char *data, int length));
@@ -0,0 +1,416 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Anti-aliased lines, circles, ellipses, arcs and splines with
+ *      sub-pixel coordinates. The shapes are turned into outlines and
+ *      handed to the coverage rasteriser in polyrast.c.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <math.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* half the width of the strokes, in pixels */
+#define AA_HALF_WIDTH      0.5
+
+/* how far a flattened curve may stray from the real one, in pixels */
+#define AA_TOLERANCE       (1.0 / 16.0)
+
+#define AA_MAX_SEGMENTS    4096
+
+
+static POLYGON_RASTER *aa_raster = NULL;
+
+static fixed *aa_point = NULL;         /* the path being built */
+static int aa_point_size = 0;
+static int aa_points = 0;
+
+static int *aa_count = NULL;           /* points in each of its contours */
+static int aa_count_size = 0;
+static int aa_contours = 0;
+
+
+
+/* aa_exit:
+ *  Frees the path buffers and the rasteriser at shutdown time.
+ */
+static void aa_exit(void)
+{
+   if (aa_raster) {
+      destroy_polygon_raster(aa_raster);
+      aa_raster = NULL;
+   }
+
+   if (aa_point) {
+      _AL_FREE(aa_point);
+      aa_point = NULL;
+   }
+
+   if (aa_count) {
+      _AL_FREE(aa_count);
+      aa_count = NULL;
+   }
+
+   aa_point_size = 0;
+   aa_count_size = 0;
+
+   _remove_exit_func(aa_exit);
+}
+
+
+
+/* begin_path:
+ *  Starts a new path with room for the given number of points and
+ *  contours. Returns zero if we are out of memory.
+ */
+static int begin_path(int points, int contours)
+{
+   if (!aa_raster) {
+      aa_raster = create_polygon_raster();
+      if (!aa_raster)
+	 return FALSE;
+
+      _add_exit_func(aa_exit, "aa_exit");
+   }
+
+   if ((!_poly_raster_grow((void **)&aa_point, &aa_point_size, sizeof(fixed) * 2 * points)) ||
+       (!_poly_raster_grow((void **)&aa_count, &aa_count_size, sizeof(int) * contours)))
+      return FALSE;
+
+   aa_points = 0;
+   aa_contours = 0;
+   aa_count[0] = 0;
+
+   return TRUE;
+}
+
+
+
+/* add_point:
+ *  Adds a point to the current contour of the path.
+ */
+static void add_point(double x, double y)
+{
+   aa_point[aa_points*2] = ftofix(x);
+   aa_point[aa_points*2+1] = ftofix(y);
+
+   aa_points++;
+   aa_count[aa_contours]++;
+}
+
+
+
+/* end_contour:
+ *  Closes the current contour of the path and starts the next one.
+ */
+static void end_contour(int max_contours)
+{
+   if (aa_count[aa_contours] > 0) {
+      aa_contours++;
+      if (aa_contours < max_contours)
+	 aa_count[aa_contours] = 0;
+   }
+}
+
+
+
+/* draw_path:
+ *  Renders the path built so far.
+ */
+static void draw_path(BITMAP *bmp, int color)
+{
+   if (aa_contours > 0)
+      _poly_raster_aa(aa_raster, bmp, aa_contours, aa_count, aa_point, color);
+}
+
+
+
+/* add_segment:
+ *  Adds a one pixel wide rectangle around the segment (x1, y1) - (x2, y2),
+ *  extended by half a pixel at either end, as a contour of the path. All
+ *  the rectangles wind the same way, so where they overlap the non-zero
+ *  winding rule merges them rather than drawing the overlap twice.
+ */
+static void add_segment(double x1, double y1, double x2, double y2, int max_contours)
+{
+   double dx = x2 - x1;
+   double dy = y2 - y1;
+   double len = sqrt(dx*dx + dy*dy);
+   double ux, uy;
+
+   if (len > 0) {
+      ux = dx / len * AA_HALF_WIDTH;
+      uy = dy / len * AA_HALF_WIDTH;
+   }
+   else {
+      ux = AA_HALF_WIDTH;
+      uy = 0;
+   }
+
+   add_point(x1 - ux - uy, y1 - uy + ux);
+   add_point(x2 + ux - uy, y2 + uy + ux);
+   add_point(x2 + ux + uy, y2 + uy - ux);
+   add_point(x1 - ux + uy, y1 - uy - ux);
+
+   end_contour(max_contours);
+}
+
+
+
+/* curve_segments:
+ *  Returns how many straight segments a full ellipse with the given
+ *  largest radius needs to stay within AA_TOLERANCE of the real curve.
+ */
+static int curve_segments(double r)
+{
+   int n;
+
+   if (r <= 0)
+      return 8;
+
+   /* a chord spanning angle a strays r * (1 - cos(a/2)) ~= r * a^2 / 8 */
+   n = (int)ceil(AL_PI * sqrt(r / (2.0 * AA_TOLERANCE)));
+
+   return MID(8, n, AA_MAX_SEGMENTS);
+}
+
+
+
+/* add_ellipse:
+ *  Adds the outline of an ellipse with centre (cx, cy) as a contour of the
+ *  path, in the given direction, between angles a1 and a2 (radians).
+ */
+static void add_ellipse(double cx, double cy, double rx, double ry, double a1, double a2, int n)
+{
+   double a, step = (a2 - a1) / n;
+   int i;
+
+   for (i=0; i<=n; i++) {
+      if ((i == n) && (fabs(a2 - a1) >= 2 * AL_PI))
+	 break;
+
+      a = a1 + step * i;
+      add_point(cx + rx * cos(a), cy - ry * sin(a));
+   }
+}
+
+
+
+/* draw_ellipse:
+ *  Helper for the circle and ellipse functions. Draws either a filled
+ *  ellipse or a one pixel wide ring between the given angles (radians).
+ */
+static void draw_ellipse(BITMAP *bmp, fixed x, fixed y, fixed rx, fixed ry, double a1, double a2, int filled, int color)
+{
+   double cx = fixtof(x) + 0.5;
+   double cy = fixtof(y) + 0.5;
+   double orx = fabs(fixtof(rx)) + AA_HALF_WIDTH;
+   double ory = fabs(fixtof(ry)) + AA_HALF_WIDTH;
+   double irx = orx - 2 * AA_HALF_WIDTH;
+   double iry = ory - 2 * AA_HALF_WIDTH;
+   int full = (a2 - a1 >= 2 * AL_PI);
+   int n;
+
+   n = curve_segments(MAX(orx, ory));
+   n = MAX((int)ceil(n * (a2 - a1) / (2 * AL_PI)), 1);
+
+   /* too small to have a hole in the middle */
+   if ((irx <= 0) || (iry <= 0))
+      filled = TRUE;
+
+   if (filled) {
+      /* the whole ellipse, or a pie slice of it */
+      if (!begin_path(n + 2, 1))
+	 return;
+
+      add_ellipse(cx, cy, orx, ory, a1, a2, n);
+      if (!full)
+	 add_point(cx, cy);
+
+      end_contour(1);
+   }
+   else if (full) {
+      /* a ring: outer contour one way, inner contour the other */
+      if (!begin_path(2 * n, 2))
+	 return;
+
+      add_ellipse(cx, cy, orx, ory, a1, a2, n);
+      end_contour(2);
+
+      add_ellipse(cx, cy, irx, iry, a2, a1, n);
+      end_contour(2);
+   }
+   else {
+      /* an open arc: along the outer edge and back along the inner one */
+      if (!begin_path(2 * n + 2, 1))
+	 return;
+
+      add_ellipse(cx, cy, orx, ory, a1, a2, n);
+      add_ellipse(cx, cy, irx, iry, a2, a1, n);
+
+      end_contour(1);
+   }
+
+   draw_path(bmp, color);
+}
+
+
+
+/* line_aa:
+ *  Draws an anti-aliased line with sub-pixel end points. Like line(), both
+ *  end pixels are covered, so integer coordinates give the same length.
+ */
+void line_aa(BITMAP *bmp, fixed x1, fixed y1, fixed x2, fixed y2, int color)
+{
+   ASSERT(bmp);
+
+   if (!begin_path(4, 1))
+      return;
+
+   add_segment(fixtof(x1) + 0.5, fixtof(y1) + 0.5, fixtof(x2) + 0.5, fixtof(y2) + 0.5, 1);
+
+   draw_path(bmp, color);
+}
+
+
+
+/* circle_aa:
+ *  Draws an anti-aliased circle outline with a sub-pixel centre and radius.
+ */
+void circle_aa(BITMAP *bmp, fixed x, fixed y, fixed radius, int color)
+{
+   ASSERT(bmp);
+
+   draw_ellipse(bmp, x, y, radius, radius, 0, 2 * AL_PI, FALSE, color);
+}
+
+
+
+/* circlefill_aa:
+ *  Draws an anti-aliased filled circle with a sub-pixel centre and radius.
+ */
+void circlefill_aa(BITMAP *bmp, fixed x, fixed y, fixed radius, int color)
+{
+   ASSERT(bmp);
+
+   draw_ellipse(bmp, x, y, radius, radius, 0, 2 * AL_PI, TRUE, color);
+}
+
+
+
+/* ellipse_aa:
+ *  Draws an anti-aliased ellipse outline with sub-pixel centre and radii.
+ */
+void ellipse_aa(BITMAP *bmp, fixed x, fixed y, fixed rx, fixed ry, int color)
+{
+   ASSERT(bmp);
+
+   draw_ellipse(bmp, x, y, rx, ry, 0, 2 * AL_PI, FALSE, color);
+}
+
+
+
+/* ellipsefill_aa:
+ *  Draws an anti-aliased filled ellipse with sub-pixel centre and radii.
+ */
+void ellipsefill_aa(BITMAP *bmp, fixed x, fixed y, fixed rx, fixed ry, int color)
+{
+   ASSERT(bmp);
+
+   draw_ellipse(bmp, x, y, rx, ry, 0, 2 * AL_PI, TRUE, color);
+}
+
+
+
+/* arc_aa:
+ *  Draws an anti-aliased circular arc, anticlockwise from ang1 to ang2,
+ *  with the angles in the same units as arc(). Equal angles give a full
+ *  circle.
+ */
+void arc_aa(BITMAP *bmp, fixed x, fixed y, fixed ang1, fixed ang2, fixed r, int color)
+{
+   double a1, a2;
+   ASSERT(bmp);
+
+   ang1 &= 0xFFFFFF;
+   ang2 &= 0xFFFFFF;
+
+   if (ang2 <= ang1)
+      ang2 += 0x1000000;
+
+   a1 = fixtof(ang1) * AL_PI / 128.0;
+   a2 = fixtof(ang2) * AL_PI / 128.0;
+
+   draw_ellipse(bmp, x, y, r, r, a1, a2, FALSE, color);
+}
+
+
+
+/* spline_aa:
+ *  Draws an anti-aliased Bezier spline, using the same four control points
+ *  as spline() but in fixed point.
+ */
+void spline_aa(BITMAP *bmp, AL_CONST fixed points[8], int color)
+{
+   double px[4], py[4];
+   double ddx, ddy, dd, t, x, y, lx, ly;
+   int i, n;
+   ASSERT(bmp);
+   ASSERT(points);
+
+   for (i=0; i<4; i++) {
+      px[i] = fixtof(points[i*2]) + 0.5;
+      py[i] = fixtof(points[i*2+1]) + 0.5;
+   }
+
+   /* Wang's formula for the number of segments */
+   ddx = px[0] - 2*px[1] + px[2];
+   ddy = py[0] - 2*py[1] + py[2];
+   dd = sqrt(ddx*ddx + ddy*ddy);
+
+   ddx = px[1] - 2*px[2] + px[3];
+   ddy = py[1] - 2*py[2] + py[3];
+   dd = MAX(dd, sqrt(ddx*ddx + ddy*ddy));
+
+   n = (int)ceil(sqrt(0.75 * dd / AA_TOLERANCE));
+   n = MID(1, n, AA_MAX_SEGMENTS);
+
+   if (!begin_path(4 * n, n))
+      return;
+
+   lx = px[0];
+   ly = py[0];
+
+   for (i=1; i<=n; i++) {
+      double a, b, c, d;
+
+      t = (double)i / n;
+      a = (1-t) * (1-t) * (1-t);
+      b = 3 * t * (1-t) * (1-t);
+      c = 3 * t * t * (1-t);
+      d = t * t * t;
+
+      x = a*px[0] + b*px[1] + c*px[2] + d*px[3];
+      y = a*py[0] + b*py[1] + c*py[2] + d*py[3];
+
+      add_segment(lx, ly, x, y, n);
+
+      lx = x;
+      ly = y;
+   }
+
+   draw_path(bmp, color);
+}
@@ -157,7 +157,7 @@ static void blit_from_256(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x,
 
 
 /* worker macro for converting between two color formats, possibly with dithering */
-#define CONVERT_BLIT_EX(sbits, ssize, dbits, dsize, MAKECOL)                 \
+#define CONVERT_BLIT_EX(sbits, ssize, dbits, dsize, BEGIN_LINE, MAKECOL)     \
 {                                                                            \
    if (_color_conv & COLORCONV_KEEP_TRANS) {                                 \
       int rc = get_replacement_mask_color(dest);                             \
@@ -167,6 +167,7 @@ static void blit_from_256(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x,
       for (y=0; y<h; y++) {                                                  \
 	 s = bmp_read_line(src, s_y+y) + s_x*ssize;                          \
 	 d = bmp_write_line(dest, d_y+y) + d_x*dsize;                        \
+	 BEGIN_LINE;                                                         \
                                                                              \
          for (x=0; x<w; x++) {                                               \
             bmp_select(src);                                                 \
@@ -195,6 +196,7 @@ static void blit_from_256(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x,
       for (y=0; y<h; y++) {                                                  \
 	 s = bmp_read_line(src, s_y+y) + s_x*ssize;                          \
 	 d = bmp_write_line(dest, d_y+y) + d_x*dsize;                        \
+	 BEGIN_LINE;                                                         \
                                                                              \
          for (x=0; x<w; x++) {                                               \
             bmp_select(src);                                                 \
@@ -218,17 +220,95 @@ static void blit_from_256(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x,
 }
 
 #define CONVERT_BLIT(sbits, ssize, dbits, dsize) \
-   CONVERT_BLIT_EX(sbits, ssize, dbits, dsize, makecol##dbits(r, g, b))
-#define CONVERT_DITHER_BLIT(sbits, ssize, dbits, dsize) \
-   CONVERT_BLIT_EX(sbits, ssize, dbits, dsize, \
-                   makecol##dbits##_dither(r, g, b, x, y))
+   CONVERT_BLIT_EX(sbits, ssize, dbits, dsize, (void)0, makecol##dbits(r, g, b))
+
+/* same as makecol##dbits##_dither(r, g, b, x, y), with tables set up per line */
+#define CONVERT_DITHER_BLIT(sbits, ssize, dbits, dsize)                      \
+{                                                                            \
+   AL_CONST unsigned short *dither_row[8], *dt;                              \
+                                                                             \
+   CONVERT_BLIT_EX(sbits, ssize, dbits, dsize,                               \
+		   _get_dither_row(dbits, y, dither_row),                    \
+		   (dt = dither_row[x & 7], dt[r] | dt[256+g] | dt[512+b]))  \
+}
 
 
 
 #if (defined ALLEGRO_COLOR8) || (defined ALLEGRO_GFX_HAS_VGA)
 
+/* dither_read_line:
+ *  Reads a line of the source image for dither_blit(), as raw colors and
+ *  as 8 bit red, green and blue values.
+ */
+static void dither_read_line(BITMAP *src, int s_x, int s_y, int w, int *line, int *rgb)
+{
+   int depth = bitmap_color_depth(src);
+   uintptr_t s;
+   int x, c;
+
+   if (!is_linear_bitmap(src)) {
+      for (x=0; x<w; x++) {
+	 c = line[x] = getpixel(src, s_x+x, s_y);
+	 rgb[x*3] = getr_depth(depth, c);
+	 rgb[x*3+1] = getg_depth(depth, c);
+	 rgb[x*3+2] = getb_depth(depth, c);
+      }
+      return;
+   }
+
+   bmp_select(src);
+
+   switch (depth) {
+
+      case 15:
+	 s = bmp_read_line(src, s_y) + s_x*sizeof(int16_t);
+	 for (x=0; x<w; x++, s+=sizeof(int16_t)) {
+	    c = line[x] = bmp_read15(s);
+	    rgb[x*3] = getr15(c);
+	    rgb[x*3+1] = getg15(c);
+	    rgb[x*3+2] = getb15(c);
+	 }
+	 break;
+
+      case 16:
+	 s = bmp_read_line(src, s_y) + s_x*sizeof(int16_t);
+	 for (x=0; x<w; x++, s+=sizeof(int16_t)) {
+	    c = line[x] = bmp_read16(s);
+	    rgb[x*3] = getr16(c);
+	    rgb[x*3+1] = getg16(c);
+	    rgb[x*3+2] = getb16(c);
+	 }
+	 break;
+
+      case 24:
+	 s = bmp_read_line(src, s_y) + s_x*3;
+	 for (x=0; x<w; x++, s+=3) {
+	    c = line[x] = bmp_read24(s);
+	    rgb[x*3] = getr24(c);
+	    rgb[x*3+1] = getg24(c);
+	    rgb[x*3+2] = getb24(c);
+	 }
+	 break;
+
+      case 32:
+	 s = bmp_read_line(src, s_y) + s_x*sizeof(int32_t);
+	 for (x=0; x<w; x++, s+=sizeof(int32_t)) {
+	    c = line[x] = bmp_read32(s);
+	    rgb[x*3] = getr32(c);
+	    rgb[x*3+1] = getg32(c);
+	    rgb[x*3+2] = getb32(c);
+	 }
+	 break;
+   }
+
+   bmp_unwrite_line(src);
+}
+
+
+
 /* dither_blit:
- *  Blits with Floyd-Steinberg error diffusion.
+ *  Blits with Floyd-Steinberg error diffusion. Works a line at a time,
+ *  reading and writing memory bitmaps directly.
  */
 static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, int d_y, int w, int h)
 {
@@ -236,9 +316,16 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
    int *errline[3];
    int *errnextline[3];
    int errpixel[3];
+   int *line, *rgb;
+   unsigned char *out;
    int v[3], e[3], n[3];
    int x, y, i;
-   int c, nc, rc;
+   int nc, rc, src_mask, dest_mask;
+   uintptr_t d;
+
+   line = _AL_MALLOC_ATOMIC(sizeof(int) * w * 4);
+   out = _AL_MALLOC_ATOMIC(w);
+   rgb = (line) ? line + w : NULL;
 
    /* allocate memory for the error buffers */
    for (i=0; i<3; i++) {
@@ -247,6 +334,9 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
    }
 
    /* free the buffers if there was an error allocating one */
+   if ((!line) || (!out))
+      goto getout;
+
    for (i=0; i<3; i++) {
       if ((!errline[i]) || (!errnextline[i]))
       goto getout;
@@ -261,21 +351,20 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
 
    /* get the replacement color */
    rc = get_replacement_mask_color(dest);
+   src_mask = bitmap_mask_color(src);
+   dest_mask = bitmap_mask_color(dest);
 
    _drawing_mode = DRAW_MODE_SOLID;
 
    /* dither!!! */
    for (y =0; y<h; y++) {
-      for (x =0; x<w; x++) {
-         /* get the colour from the source bitmap */
-         c = getpixel(src, s_x+x, s_y+y);
-         v[0] = getr_depth(bitmap_color_depth(src), c);
-         v[1] = getg_depth(bitmap_color_depth(src), c);
-         v[2] = getb_depth(bitmap_color_depth(src), c);
+      /* get the colours from the source bitmap */
+      dither_read_line(src, s_x, s_y+y, w, line, rgb);
 
+      for (x =0; x<w; x++) {
          /* add the error from previous pixels */
          for (i=0; i<3; i++) {
-            n[i] = v[i] + errline[i][x] + errpixel[i];
+            n[i] = rgb[x*3+i] + errline[i][x] + errpixel[i];
 
             if (n[i] > 255)
                n[i] = 255;
@@ -287,15 +376,15 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
          /* find the nearest matching colour */
          nc = makecol8(n[0], n[1], n[2]);
          if (_color_conv & COLORCONV_KEEP_TRANS) {
-            if (c == bitmap_mask_color(src))
-               putpixel(dest, d_x+x, d_y+y, bitmap_mask_color(dest));
-            else if (nc == bitmap_mask_color(dest))
-               putpixel(dest, d_x+x, d_y+y, rc);
+            if (line[x] == src_mask)
+               out[x] = dest_mask;
+            else if (nc == dest_mask)
+               out[x] = rc;
             else
-               putpixel(dest, d_x+x, d_y+y, nc);
+               out[x] = nc;
          }
          else {
-            putpixel(dest, d_x+x, d_y+y, nc);
+            out[x] = nc;
          }
          v[0] = getr8(nc);
          v[1] = getg8(nc);
@@ -312,6 +401,21 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
          }
       }
 
+      /* write the line to the destination bitmap */
+      if (is_linear_bitmap(dest)) {
+         d = bmp_write_line(dest, d_y+y) + d_x;
+         bmp_select(dest);
+
+         for (x=0; x<w; x++)
+            bmp_write8(d+x, out[x]);
+
+         bmp_unwrite_line(dest);
+      }
+      else {
+         for (x=0; x<w; x++)
+            putpixel(dest, d_x+x, d_y+y, out[x]);
+      }
+
       /* update error buffers */
       for (i=0; i<3; i++) {
          memcpy(errline[i], errnextline[i], sizeof(int) * w);
@@ -323,6 +427,12 @@ static void dither_blit(BITMAP *src, BITMAP *dest, int s_x, int s_y, int d_x, in
 
  getout:
 
+   if (line)
+      _AL_FREE(line);
+
+   if (out)
+      _AL_FREE(out);
+
    for (i=0; i<3; i++) {
       if (errline[i])
          _AL_FREE(errline[i]);
@@ -337,112 +337,132 @@ static void read_32bit_line(int length, PACKFILE *f, BITMAP *bmp, int line)
 
 
 
-/* read_bitfields_image:
- *  For reading the bitfield compressed BMP image format.
+/* read_bitfields_line:
+ *  Support function for reading the bitfield compressed BMP image format.
  */
-static void read_bitfields_image(PACKFILE *f, BITMAP *bmp, AL_CONST BITMAPINFOHEADER *infoheader)
+static void read_bitfields_line(int length, PACKFILE *f, BITMAP *bmp, int line)
 {
-   int k, i, line, height, dir;
+   int k;
    int bpp;
    int bytes_per_pixel;
    int red, grn, blu;
    unsigned long buffer;
 
-   height = infoheader->biHeight;
-   line   = height < 0 ? 0 : height-1;
-   dir    = height < 0 ? 1 : -1;
-   height = ABS(height);
-   
    bpp = bitmap_color_depth(bmp);
    bytes_per_pixel = BYTES_PER_PIXEL(bpp);
 
-   for (i=0; i<height; i++, line+=dir) {
-      for (k=0; k<(int)infoheader->biWidth; k++) {
-
-	 pack_fread(&buffer, bytes_per_pixel, f);
+   for (k=0; k<length; k++) {
 
-	 if (bpp == 15) {
-	    red = (buffer >> 10) & 0x1f;
-	    grn = (buffer >> 5) & 0x1f;
-	    blu = (buffer) & 0x1f;
-	    buffer = (red << _rgb_r_shift_15) |
-		     (grn << _rgb_g_shift_15) |
-		     (blu << _rgb_b_shift_15);
-	 }
-	 else if (bpp == 16) {
-	    red = (buffer >> 11) & 0x1f;
-	    grn = (buffer >> 5) & 0x3f;
-	    blu = (buffer) & 0x1f;
-	    buffer = (red << _rgb_r_shift_16) |
-		     (grn << _rgb_g_shift_16) |
-		     (blu << _rgb_b_shift_16);
-	 }
-	 else {
-	    red = (buffer >> 16) & 0xff;
-	    grn = (buffer >> 8) & 0xff;
-	    blu = (buffer) & 0xff;
-	    buffer = (red << _rgb_r_shift_32) |
-		     (grn << _rgb_g_shift_32) |
-		     (blu << _rgb_b_shift_32);
-	 }
+      pack_fread(&buffer, bytes_per_pixel, f);
 
-	 memcpy(&bmp->line[line][k * bytes_per_pixel], &buffer, bytes_per_pixel);
+      if (bpp == 15) {
+	 red = (buffer >> 10) & 0x1f;
+	 grn = (buffer >> 5) & 0x1f;
+	 blu = (buffer) & 0x1f;
+	 buffer = (red << _rgb_r_shift_15) |
+		  (grn << _rgb_g_shift_15) |
+		  (blu << _rgb_b_shift_15);
       }
-
-      /* padding */
-      k = (k * bytes_per_pixel) % 4;
-      if (k > 0) {
-	 while (k++ < 4)
-	    pack_getc(f);
+      else if (bpp == 16) {
+	 red = (buffer >> 11) & 0x1f;
+	 grn = (buffer >> 5) & 0x3f;
+	 blu = (buffer) & 0x1f;
+	 buffer = (red << _rgb_r_shift_16) |
+		  (grn << _rgb_g_shift_16) |
+		  (blu << _rgb_b_shift_16);
+      }
+      else {
+	 red = (buffer >> 16) & 0xff;
+	 grn = (buffer >> 8) & 0xff;
+	 blu = (buffer) & 0xff;
+	 buffer = (red << _rgb_r_shift_32) |
+		  (grn << _rgb_g_shift_32) |
+		  (blu << _rgb_b_shift_32);
       }
+
+      memcpy(&bmp->line[line][k * bytes_per_pixel], &buffer, bytes_per_pixel);
+   }
+
+   /* padding */
+   k = (k * bytes_per_pixel) % 4;
+   if (k > 0) {
+      while (k++ < 4)
+	 pack_getc(f);
    }
 }
 
 
-/* read_image:
- *  For reading the noncompressed BMP image format.
+
+/* read_bitfields_image:
+ *  For reading the bitfield compressed BMP image format.
  */
-static void read_image(PACKFILE *f, BITMAP *bmp, AL_CONST BITMAPINFOHEADER *infoheader)
+static void read_bitfields_image(PACKFILE *f, BITMAP *bmp, AL_CONST BITMAPINFOHEADER *infoheader)
 {
    int i, line, height, dir;
 
    height = infoheader->biHeight;
-   line   = height < 0 ? 0: height-1;
-   dir    = height < 0 ? 1: -1;
+   line   = height < 0 ? 0 : height-1;
+   dir    = height < 0 ? 1 : -1;
    height = ABS(height);
 
-   for (i=0; i<height; i++, line+=dir) {
-      switch (infoheader->biBitCount) {
+   for (i=0; i<height; i++, line+=dir)
+      read_bitfields_line(infoheader->biWidth, f, bmp, line);
+}
 
-	 case 1:
-	    read_1bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
 
-	 case 4:
-	    read_4bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
+/* read_line:
+ *  Reads one line of the noncompressed BMP image format.
+ */
+static void read_line(PACKFILE *f, BITMAP *bmp, int line, AL_CONST BITMAPINFOHEADER *infoheader)
+{
+   switch (infoheader->biBitCount) {
 
-	 case 8:
-	    read_8bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
+      case 1:
+	 read_1bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
 
-	 case 16:
-	    read_16bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
+      case 4:
+	 read_4bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
 
-	 case 24:
-	    read_24bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
+      case 8:
+	 read_8bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
 
-	 case 32:
-	    read_32bit_line(infoheader->biWidth, f, bmp, line);
-	    break;
-      }
+      case 16:
+	 read_16bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
+
+      case 24:
+	 read_24bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
+
+      case 32:
+	 read_32bit_line(infoheader->biWidth, f, bmp, line);
+	 break;
    }
 }
 
 
 
+/* read_image:
+ *  For reading the noncompressed BMP image format.
+ */
+static void read_image(PACKFILE *f, BITMAP *bmp, AL_CONST BITMAPINFOHEADER *infoheader)
+{
+   int i, line, height, dir;
+
+   height = infoheader->biHeight;
+   line   = height < 0 ? 0: height-1;
+   dir    = height < 0 ? 1: -1;
+   height = ABS(height);
+
+   for (i=0; i<height; i++, line+=dir)
+      read_line(f, bmp, line, infoheader);
+}
+
+
+
 /* read_RLE8_compressed_image:
  *  For reading the 8 bit RLE compressed BMP image format.
  */
@@ -591,6 +611,72 @@ static void read_RLE4_compressed_image(PACKFILE *f, BITMAP *bmp, AL_CONST BITMAP
 
 
 
+/* read_bmp_header:
+ *  Reads the headers and the palette of a BMP file, and works out the
+ *  color depth of the image. Returns zero on success.
+ */
+static int read_bmp_header(PACKFILE *f, RGB *pal, BITMAPINFOHEADER *infoheader, int *bpp)
+{
+   BITMAPFILEHEADER fileheader;
+   unsigned long biSize;
+
+   if (read_bmfileheader(f, &fileheader) != 0) {
+      return -1;
+   }
+
+   biSize = pack_igetl(f);
+
+   if (biSize == WININFOHEADERSIZE) {
+      if (read_win_bminfoheader(f, infoheader) != 0) {
+	 return -1;
+      }
+      if (infoheader->biCompression != BI_BITFIELDS)
+	 read_bmicolors(fileheader.bfOffBits - 54, pal, f, 1);
+   }
+   else if (biSize == OS2INFOHEADERSIZE) {
+      if (read_os2_bminfoheader(f, infoheader) != 0) {
+	 return -1;
+      }
+      if (infoheader->biCompression != BI_BITFIELDS)
+	 read_bmicolors(fileheader.bfOffBits - 26, pal, f, 0);
+   }
+   else {
+      return -1;
+   }
+
+   if (infoheader->biBitCount == 24)
+      *bpp = 24;
+   else if (infoheader->biBitCount == 16)
+      *bpp = 16;
+   else if (infoheader->biBitCount == 32)
+      *bpp = 32;
+   else
+      *bpp = 8;
+
+   if (infoheader->biCompression == BI_BITFIELDS) {
+      unsigned long redMask = pack_igetl(f);
+      unsigned long grnMask = pack_igetl(f);
+      unsigned long bluMask = pack_igetl(f);
+
+      (void)grnMask;
+
+      if ((bluMask == 0x001f) && (redMask == 0x7C00))
+	 *bpp = 15;
+      else if ((bluMask == 0x001f) && (redMask == 0xF800))
+	 *bpp = 16;
+      else if ((bluMask == 0x0000FF) && (redMask == 0xFF0000))
+	 *bpp = 32;
+      else {
+	 /* Unrecognised bit masks/depth, refuse to load. */
+	 return -1;
+      }
+   }
+
+   return 0;
+}
+
+
+
 /* load_bmp:
  *  Loads a Windows BMP file, returning a bitmap structure and storing
  *  the palette data in the specified palette (this should be an array of
@@ -626,12 +712,10 @@ BITMAP *load_bmp(AL_CONST char *filename, RGB *pal)
  */
 BITMAP *load_bmp_pf(PACKFILE *f, RGB *pal)
 {
-   BITMAPFILEHEADER fileheader;
    BITMAPINFOHEADER infoheader;
    BITMAP *bmp;
    PALETTE tmppal;
    int want_palette = TRUE;
-   unsigned long biSize;
    int bpp, dest_depth;
    ASSERT(f);
 
@@ -641,58 +725,8 @@ BITMAP *load_bmp_pf(PACKFILE *f, RGB *pal)
       pal = tmppal;
    }
 
-   if (read_bmfileheader(f, &fileheader) != 0) {
+   if (read_bmp_header(f, pal, &infoheader, &bpp) != 0)
       return NULL;
-   }
-
-   biSize = pack_igetl(f);
-
-   if (biSize == WININFOHEADERSIZE) {
-      if (read_win_bminfoheader(f, &infoheader) != 0) {
-	 return NULL;
-      }
-      if (infoheader.biCompression != BI_BITFIELDS)
-	 read_bmicolors(fileheader.bfOffBits - 54, pal, f, 1);
-   }
-   else if (biSize == OS2INFOHEADERSIZE) {
-      if (read_os2_bminfoheader(f, &infoheader) != 0) {
-	 return NULL;
-      }
-      if (infoheader.biCompression != BI_BITFIELDS)
-	 read_bmicolors(fileheader.bfOffBits - 26, pal, f, 0);
-   }
-   else {
-      return NULL;
-   }
-
-   if (infoheader.biBitCount == 24)
-      bpp = 24;
-   else if (infoheader.biBitCount == 16)
-      bpp = 16;
-   else if (infoheader.biBitCount == 32)
-      bpp = 32;
-   else
-      bpp = 8;
-
-   if (infoheader.biCompression == BI_BITFIELDS) {
-      unsigned long redMask = pack_igetl(f);
-      unsigned long grnMask = pack_igetl(f);
-      unsigned long bluMask = pack_igetl(f);
-
-      (void)grnMask;
-
-      if ((bluMask == 0x001f) && (redMask == 0x7C00))
-	 bpp = 15;
-      else if ((bluMask == 0x001f) && (redMask == 0xF800))
-	 bpp = 16;
-      else if ((bluMask == 0x0000FF) && (redMask == 0xFF0000))
-	 bpp = 32;
-      else {
-	 /* Unrecognised bit masks/depth, refuse to load. */
-	 return NULL;
-      }
-   }
-
 
    dest_depth = _color_load_depth(bpp, FALSE);
 
@@ -745,6 +779,116 @@ BITMAP *load_bmp_pf(PACKFILE *f, RGB *pal)
 
 
 
+/* load_bmp_lines:
+ *  Reads a BMP file a line at a time, see load_bitmap_lines().
+ */
+int load_bmp_lines(AL_CONST char *filename, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   PACKFILE *f;
+   int ret;
+   ASSERT(filename);
+
+   f = pack_fopen(filename, F_READ);
+   if (!f)
+      return -1;
+
+   ret = load_bmp_lines_pf(f, pal, callback, dp);
+
+   pack_fclose(f);
+
+   return ret;
+}
+
+
+
+/* load_bmp_lines_pf:
+ *  Like load_bmp_lines, but starts reading from the current place in the
+ *  PACKFILE specified. Only one line of the image is held in memory at a
+ *  time, except for the RLE compressed formats.
+ */
+int load_bmp_lines_pf(PACKFILE *f, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   BITMAPINFOHEADER infoheader;
+   BITMAP *bmp;
+   PALETTE tmppal;
+   int want_palette = TRUE;
+   int bpp, i, line, height, dir, ret;
+   ASSERT(f);
+   ASSERT(callback);
+
+   /* we really need a palette */
+   if (!pal) {
+      want_palette = FALSE;
+      pal = tmppal;
+   }
+
+   if (read_bmp_header(f, pal, &infoheader, &bpp) != 0)
+      return -1;
+
+   /* construct a fake palette if 8-bit mode is not involved */
+   if ((bpp != 8) && want_palette)
+      generate_332_palette(pal);
+
+   height = infoheader.biHeight;
+
+   if ((infoheader.biCompression == BI_RLE8) || (infoheader.biCompression == BI_RLE4)) {
+      /* these can skip around the image, so read them whole */
+      bmp = create_bitmap_ex(8, infoheader.biWidth, ABS(height));
+      if (!bmp)
+	 return -1;
+
+      clear_bitmap(bmp);
+
+      if (infoheader.biCompression == BI_RLE8)
+	 read_RLE8_compressed_image(f, bmp, &infoheader);
+      else
+	 read_RLE4_compressed_image(f, bmp, &infoheader);
+
+      ret = _feed_bitmap_lines(bmp, callback, dp);
+      destroy_bitmap(bmp);
+
+      return ret;
+   }
+
+   if ((infoheader.biCompression != BI_RGB) && (infoheader.biCompression != BI_BITFIELDS))
+      return -1;
+
+   bmp = create_bitmap_ex(bpp, infoheader.biWidth, 1);
+   if (!bmp)
+      return -1;
+
+   clear_bitmap(bmp);
+
+   line   = height < 0 ? 0 : height-1;
+   dir    = height < 0 ? 1 : -1;
+   height = ABS(height);
+
+   *allegro_errno = 0;
+   ret = 0;
+
+   for (i=0; i<height; i++, line+=dir) {
+      if (infoheader.biCompression == BI_BITFIELDS)
+	 read_bitfields_line(infoheader.biWidth, f, bmp, 0);
+      else
+	 read_line(f, bmp, 0, &infoheader);
+
+      if (*allegro_errno) {
+	 ret = -1;
+	 break;
+      }
+
+      ret = callback(bmp, line, height, dp);
+      if (ret)
+	 break;
+   }
+
+   destroy_bitmap(bmp);
+
+   return ret;
+}
+
+
+
 /* save_bmp:
  *  Writes a bitmap into a BMP file, using the specified palette (this
  *  should be an array of at least 256 RGB structures).
@@ -8,7 +8,7 @@
  *                                           /\____/
  *                                           \_/__/
  *
- *      Compiled sprite routines for some unknown platforms.
+ *      Compiled sprite routines for x86-64 and some unknown platforms.
  *
  *      By Michael Bukin.
  *
@@ -16,7 +16,362 @@
  */
 
 
+#include <string.h>
+
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+#if (defined ALLEGRO_AMD64) && (defined ALLEGRO_UNIX) && (!defined __ILP32__)
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#ifndef MAP_ANONYMOUS
+   #define MAP_ANONYMOUS   MAP_ANON
+#endif
+
+
+/* The generated routine is called with a pointer to the line table of the
+ * destination, starting at the top of the sprite, and the byte offset of
+ * its left edge. Every sprite line that has something to draw loads its
+ * address and then stores the pixels with mov instructions, taking runs
+ * of 16 bytes or more from a constant pool after the code with SSE2.
+ */
+typedef void (*COMPILED_DRAWER)(unsigned char **line, long offset);
+
+
+typedef struct CODE_BUFFER
+{
+   unsigned char *code;             /* NULL while measuring the code */
+   int pos;                         /* size of the code so far */
+   int pool;                        /* offset of the constant pool */
+   int pool_pos;                    /* size of the constant pool so far */
+} CODE_BUFFER;
+
+
+
+/* emit_byte:
+ *  Helper for adding a byte to the generated code.
+ */
+static void emit_byte(CODE_BUFFER *cb, int val)
+{
+   if (cb->code)
+      cb->code[cb->pos] = val;
+
+   cb->pos++;
+}
+
+
+
+/* emit_data:
+ *  Helper for adding immediate data to the generated code.
+ */
+static void emit_data(CODE_BUFFER *cb, AL_CONST void *data, int size)
+{
+   if (cb->code)
+      memcpy(cb->code + cb->pos, data, size);
+
+   cb->pos += size;
+}
+
+
+
+/* emit_long:
+ *  Helper for adding a 32-bit value to the generated code.
+ */
+static void emit_long(CODE_BUFFER *cb, int val)
+{
+   uint32_t v = val;
+
+   emit_data(cb, &v, 4);
+}
+
+
+
+/* emit_modrm:
+ *  Helper for encoding an [rax+offset] operand, with the given register
+ *  in the reg field of the ModR/M byte.
+ */
+static void emit_modrm(CODE_BUFFER *cb, int reg, int offset)
+{
+   if ((offset >= -128) && (offset <= 127)) {
+      emit_byte(cb, 0x40 | (reg << 3));
+      emit_byte(cb, offset);
+   }
+   else {
+      emit_byte(cb, 0x80 | (reg << 3));
+      emit_long(cb, offset);
+   }
+}
+
+
+
+/* compile_run:
+ *  Generates the stores for a run of len solid bytes, at the given offset
+ *  from the start of the line in rax.
+ */
+static void compile_run(CODE_BUFFER *cb, AL_CONST unsigned char *src, int offset, int len)
+{
+   while (len >= 16) {
+      /* movdqu xmm0, [rip+pool] */
+      emit_byte(cb, 0xF3);
+      emit_byte(cb, 0x0F);
+      emit_byte(cb, 0x6F);
+      emit_byte(cb, 0x05);
+      emit_long(cb, cb->pool + cb->pool_pos - (cb->pos + 4));
+
+      if (cb->code)
+	 memcpy(cb->code + cb->pool + cb->pool_pos, src, 16);
+      cb->pool_pos += 16;
+
+      /* movdqu [rax+offset], xmm0 */
+      emit_byte(cb, 0xF3);
+      emit_byte(cb, 0x0F);
+      emit_byte(cb, 0x7F);
+      emit_modrm(cb, 0, offset);
+
+      src += 16;
+      offset += 16;
+      len -= 16;
+   }
+
+   if (len >= 8) {
+      /* movabs rdx, imm64 */
+      emit_byte(cb, 0x48);
+      emit_byte(cb, 0xBA);
+      emit_data(cb, src, 8);
+
+      /* mov [rax+offset], rdx */
+      emit_byte(cb, 0x48);
+      emit_byte(cb, 0x89);
+      emit_modrm(cb, 2, offset);
+
+      src += 8;
+      offset += 8;
+      len -= 8;
+   }
+
+   if (len >= 4) {
+      /* mov dword [rax+offset], imm32 */
+      emit_byte(cb, 0xC7);
+      emit_modrm(cb, 0, offset);
+      emit_data(cb, src, 4);
+
+      src += 4;
+      offset += 4;
+      len -= 4;
+   }
+
+   if (len >= 2) {
+      /* mov word [rax+offset], imm16 */
+      emit_byte(cb, 0x66);
+      emit_byte(cb, 0xC7);
+      emit_modrm(cb, 0, offset);
+      emit_data(cb, src, 2);
+
+      src += 2;
+      offset += 2;
+      len -= 2;
+   }
+
+   if (len > 0) {
+      /* mov byte [rax+offset], imm8 */
+      emit_byte(cb, 0xC6);
+      emit_modrm(cb, 0, offset);
+      emit_byte(cb, *src);
+   }
+}
+
+
+
+/* is_solid:
+ *  Helper for checking whether a pixel of the sprite has to be drawn.
+ */
+static int is_solid(BITMAP *b, int x, int y)
+{
+   switch (bitmap_color_depth(b)) {
+
+      case 8:
+	 return (b->line[y][x] != MASK_COLOR_8);
+
+      case 15:
+      case 16:
+	 return (((unsigned short *)b->line[y])[x] != (unsigned)b->vtable->mask_color);
+
+      case 24:
+	 return (READ3BYTES(b->line[y] + x*3) != b->vtable->mask_color);
+
+      case 32:
+	 return (((uint32_t *)b->line[y])[x] != (unsigned)b->vtable->mask_color);
+   }
+
+   return FALSE;
+}
+
+
+
+/* compile_sprite:
+ *  Generates the drawing routine for a sprite, or just measures it if
+ *  cb->code is NULL.
+ */
+static void compile_sprite(BITMAP *b, CODE_BUFFER *cb)
+{
+   int bpp = BYTES_PER_PIXEL(bitmap_color_depth(b));
+   int x, y, start, loaded;
+
+   for (y=0; y<b->h; y++) {
+      loaded = FALSE;
+      x = 0;
+
+      while (x < b->w) {
+	 if (!is_solid(b, x, y)) {
+	    x++;
+	    continue;
+	 }
+
+	 start = x;
+	 while ((x < b->w) && (is_solid(b, x, y)))
+	    x++;
+
+	 if (!loaded) {
+	    /* mov rax, [rdi+y*8] */
+	    emit_byte(cb, 0x48);
+	    emit_byte(cb, 0x8B);
+	    if (y < 16) {
+	       emit_byte(cb, 0x47);
+	       emit_byte(cb, y*8);
+	    }
+	    else {
+	       emit_byte(cb, 0x87);
+	       emit_long(cb, y*8);
+	    }
+
+	    /* add rax, rsi */
+	    emit_byte(cb, 0x48);
+	    emit_byte(cb, 0x01);
+	    emit_byte(cb, 0xF0);
+
+	    loaded = TRUE;
+	 }
+
+	 compile_run(cb, b->line[y] + start*bpp, start*bpp, (x-start)*bpp);
+      }
+   }
+
+   /* ret */
+   emit_byte(cb, 0xC3);
+}
+
+
+
+/* get_compiled_sprite:
+ *  Creates a compiled sprite based on the specified bitmap. The code is
+ *  written into pages that are only made executable once they are no
+ *  longer writable, and if that isn't allowed the sprite is drawn from
+ *  its RLE version instead.
+ */
+COMPILED_SPRITE *get_compiled_sprite(BITMAP *bitmap, int planar)
+{
+   COMPILED_SPRITE *s;
+   CODE_BUFFER cb;
+   void *p;
+   int size;
+   ASSERT(bitmap);
+
+   s = _AL_MALLOC(sizeof(COMPILED_SPRITE));
+   if (!s)
+      return NULL;
+
+   s->color_depth = bitmap_color_depth(bitmap);
+   s->w = bitmap->w;
+   s->h = bitmap->h;
+   s->draw = NULL;
+   s->len = 0;
+
+   /* clipped drawing and video bitmaps still need the RLE sprite */
+   s->rle = get_rle_sprite(bitmap);
+   if (!s->rle) {
+      _AL_FREE(s);
+      return NULL;
+   }
+
+   if (!is_memory_bitmap(bitmap))
+      return s;
+
+   cb.code = NULL;
+   cb.pos = 0;
+   cb.pool = 0;
+   cb.pool_pos = 0;
+
+   compile_sprite(bitmap, &cb);
+
+   cb.pool = (cb.pos + 15) & ~15;
+   size = cb.pool + cb.pool_pos;
+
+   p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (p == MAP_FAILED)
+      return s;
+
+   cb.code = p;
+   cb.pos = 0;
+   cb.pool_pos = 0;
+
+   compile_sprite(bitmap, &cb);
+
+   if (mprotect(p, size, PROT_READ | PROT_EXEC) != 0) {
+      munmap(p, size);
+      return s;
+   }
+
+   s->draw = p;
+   s->len = size;
+
+   return s;
+}
+
+
+
+/* destroy_compiled_sprite:
+ *  Destroys a compiled sprite structure returned by get_compiled_sprite().
+ */
+void destroy_compiled_sprite(COMPILED_SPRITE *sprite)
+{
+   if (sprite) {
+      if (sprite->draw)
+	 munmap(sprite->draw, sprite->len);
+
+      destroy_rle_sprite(sprite->rle);
+      _AL_FREE(sprite);
+   }
+}
+
+
+
+/* draw_compiled_sprite:
+ *  Draws a compiled sprite onto the specified bitmap at the specified
+ *  position. Sprites that don't fit inside the clipping rectangle of
+ *  a memory bitmap are drawn with the RLE routines.
+ */
+void draw_compiled_sprite(BITMAP *dst, AL_CONST COMPILED_SPRITE *src, int x, int y)
+{
+   ASSERT(dst);
+   ASSERT(src);
+
+   if ((src->draw) && (is_memory_bitmap(dst)) &&
+       (x >= dst->cl) && (y >= dst->ct) &&
+       (x + src->w <= dst->cr) && (y + src->h <= dst->cb)) {
+      ASSERT(bitmap_color_depth(dst) == src->color_depth);
+      ((COMPILED_DRAWER)src->draw)(dst->line + y, (long)x * BYTES_PER_PIXEL(src->color_depth));
+   }
+   else
+      draw_rle_sprite(dst, src->rle, x, y);
+}
+
+
+
+#else
 
 
 
@@ -53,3 +408,6 @@ void draw_compiled_sprite(BITMAP *dst, AL_CONST COMPILED_SPRITE *src, int x, int
    draw_rle_sprite(dst, (COMPILED_SPRITE *)src, x, y);
 }
 
+
+
+#endif
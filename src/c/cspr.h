@@ -18,6 +18,32 @@
 #ifndef __bma_cspr_h
 #define __bma_cspr_h
 
+#include <string.h>
+
+
+/* RLE_MEMCPY_RUN is the shortest run of solid pixels that draw_rle_sprite
+ * copies with memcpy() instead of a pixel at a time, when the RLE data is
+ * in the same format as the bitmap (all depths but 24 bpp).
+ */
+#define RLE_MEMCPY_RUN 8
+
+#define RLE_COPY_RUN(d, s, n)                                                \
+{                                                                            \
+   if ((sizeof(*(s)) == sizeof(*(d)) * PTR_PER_PIXEL) &&                     \
+       ((n) >= RLE_MEMCPY_RUN)) {                                            \
+      memcpy((d), (s), (n) * sizeof(*(s)));                                  \
+      (s) += (n);                                                            \
+      (d) = OFFSET_PIXEL_PTR((d), (n));                                      \
+   }                                                                         \
+   else {                                                                    \
+      long i;                                                                \
+      for (i = (n) - 1; i >= 0; (s)++, INC_PIXEL_PTR(d), i--) {              \
+	 unsigned long col = *(s);                                           \
+	 PUT_PIXEL((d), col);                                                \
+      }                                                                      \
+   }                                                                         \
+}
+
 
 /* _linear_draw_sprite_ex:
  *  Draws a masked sprite onto a linear bitmap at the specified dx, dy position,
@@ -1027,18 +1053,12 @@ void FUNC_LINEAR_DRAW_RLE_SPRITE(BITMAP *dst, AL_CONST RLE_SPRITE *src, int dx,
 	       if ((x - c) >= 0) {
 	          /* Fully visible.  */
 	          x -= c;
-	          for (c--; c >= 0; s++, INC_PIXEL_PTR(d), c--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_COPY_RUN(d, s, c);
 	       }
 	       else {
 	          /* Clipped on the right.  */
 	          c -= x;
-	          for (x--; x >= 0; s++, INC_PIXEL_PTR(d), x--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_COPY_RUN(d, s, x);
 	          break;
 	       }
 	    }
@@ -1075,18 +1095,12 @@ void FUNC_LINEAR_DRAW_RLE_SPRITE(BITMAP *dst, AL_CONST RLE_SPRITE *src, int dx,
 	       if ((x - c) >= 0) {
 	          /* Fully visible.  */
 	          x -= c;
-	          for (c--; c >= 0; s++, INC_PIXEL_PTR(d), c--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_COPY_RUN(d, s, c);
 	       }
 	       else {
 	          /* Clipped on the right.  */
 	          c -= x;
-	          for (x--; x >= 0; s++, INC_PIXEL_PTR(d), x--) {
-		     unsigned long col = *s;
-		     PUT_PIXEL(d, col);
-	          }
+	          RLE_COPY_RUN(d, s, x);
 	          break;
 	       }
 	    }
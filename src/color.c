@@ -27,6 +27,7 @@
 
 
 #include <limits.h>
+#include <stdio.h>
 #include <string.h>
 #include <math.h>
 
@@ -283,10 +284,10 @@ static void bestfit_init(void)
 
 
 
-/* bestfit_color:
+/* bestfit_scan:
  *  Searches a palette for the color closest to the requested R, G, B value.
  */
-int bestfit_color(AL_CONST PALETTE pal, int r, int g, int b)
+static int bestfit_scan(AL_CONST PALETTE pal, int r, int g, int b)
 {
    int i, coldiff, lowest, bestfit;
 
@@ -329,6 +330,251 @@ int bestfit_color(AL_CONST PALETTE pal, int r, int g, int b)
 
 
 
+/* Palette searches for the table builders. The colors are sorted by their
+ * green component, which has the largest weight in the distance, so a
+ * search can start from the closest green and stop in each direction as
+ * soon as the green difference alone is worse than the best match so far.
+ * The answers are also remembered, since building a table or converting
+ * an image asks for the same colors over and over again. The result is
+ * always exactly what a linear search of the palette would return.
+ */
+#define BESTFIT_MEMO_SIZE  (64*64*64)
+
+
+typedef struct BESTFIT_SEARCH
+{
+   AL_CONST RGB *pal;
+   int valid;                       /* all components in the 0-63 range? */
+   int start[65];                   /* first sorted color of each green */
+   unsigned char idx[PAL_SIZE];     /* colors 1-255 sorted by green */
+   unsigned char *memo;             /* remembered answers */
+   unsigned char *known;            /* one bit per remembered answer */
+} BESTFIT_SEARCH;
+
+
+
+/* bestfit_reset:
+ *  Sorts a new palette for bestfit_search() and forgets the old answers.
+ */
+static void bestfit_reset(BESTFIT_SEARCH *bs, AL_CONST PALETTE pal)
+{
+   int count[64];
+   int i;
+
+   bs->pal = pal;
+   bs->valid = TRUE;
+
+   for (i=0; i<PAL_SIZE; i++) {
+      if ((pal[i].r > 63) || (pal[i].g > 63) || (pal[i].b > 63)) {
+	 bs->valid = FALSE;
+	 return;
+      }
+   }
+
+   /* counting sort, which keeps equal greens in palette order */
+   memset(count, 0, sizeof(count));
+
+   for (i=1; i<PAL_SIZE; i++)
+      count[pal[i].g]++;
+
+   bs->start[0] = 0;
+   for (i=0; i<64; i++)
+      bs->start[i+1] = bs->start[i] + count[i];
+
+   memcpy(count, bs->start, sizeof(count));
+
+   for (i=1; i<PAL_SIZE; i++)
+      bs->idx[count[pal[i].g]++] = i;
+
+   if (!bs->memo) {
+      bs->memo = _AL_MALLOC(BESTFIT_MEMO_SIZE + BESTFIT_MEMO_SIZE/8);
+      if (bs->memo)
+	 bs->known = bs->memo + BESTFIT_MEMO_SIZE;
+   }
+
+   if (bs->memo)
+      memset(bs->known, 0, BESTFIT_MEMO_SIZE/8);
+}
+
+
+
+/* bestfit_begin:
+ *  Prepares a palette for bestfit_search().
+ */
+static void bestfit_begin(BESTFIT_SEARCH *bs, AL_CONST PALETTE pal)
+{
+   if (col_diff[1] == 0)
+      bestfit_init();
+
+   bs->memo = NULL;
+   bs->known = NULL;
+
+   bestfit_reset(bs, pal);
+}
+
+
+
+/* bestfit_end:
+ *  Frees what bestfit_begin() allocated.
+ */
+static void bestfit_end(BESTFIT_SEARCH *bs)
+{
+   if (bs->memo) {
+      _AL_FREE(bs->memo);
+      bs->memo = NULL;
+   }
+}
+
+
+
+/* bestfit_search:
+ *  Faster equivalent of bestfit_scan(), for repeated searches of a palette.
+ */
+static int bestfit_search(BESTFIT_SEARCH *bs, int r, int g, int b)
+{
+   AL_CONST RGB *pal = bs->pal;
+   AL_CONST RGB *rgb;
+   int lo, hi, i, n, coldiff, lowest, bestfit, key;
+
+   ASSERT(r >= 0 && r <= 63);
+   ASSERT(g >= 0 && g <= 63);
+   ASSERT(b >= 0 && b <= 63);
+
+   if (!bs->valid)
+      return bestfit_scan(pal, r, g, b);
+
+   key = (r << 12) | (g << 6) | b;
+
+   if ((bs->memo) && (bs->known[key >> 3] & (1 << (key & 7))))
+      return bs->memo[key];
+
+   bestfit = 0;
+   lowest = INT_MAX;
+
+   /* only the transparent (pink) color can be mapped to index 0 */
+   if ((r == 63) && (g == 0) && (b == 63)) {
+      lowest = (col_diff + 0) [ (pal[0].g - g) & 0x7F ] +
+	       (col_diff + 128) [ (pal[0].r - r) & 0x7F ] +
+	       (col_diff + 256) [ (pal[0].b - b) & 0x7F ];
+   }
+
+   /* walk outwards from the closest green, preferring lower indices on
+    * ties like the linear search does
+    */
+   n = PAL_SIZE - 1;
+   hi = bs->start[g];
+   lo = hi - 1;
+
+   while ((lowest > 0) && ((lo >= 0) || (hi < n))) {
+      if (hi < n) {
+	 rgb = &pal[bs->idx[hi]];
+	 coldiff = (col_diff + 0) [ (rgb->g - g) & 0x7F ];
+	 if (coldiff > lowest) {
+	    hi = n;
+	 }
+	 else {
+	    coldiff += (col_diff + 128) [ (rgb->r - r) & 0x7F ];
+	    coldiff += (col_diff + 256) [ (rgb->b - b) & 0x7F ];
+	    i = bs->idx[hi];
+	    if ((coldiff < lowest) || ((coldiff == lowest) && (i < bestfit))) {
+	       lowest = coldiff;
+	       bestfit = i;
+	    }
+	    hi++;
+	 }
+      }
+
+      if (lo >= 0) {
+	 rgb = &pal[bs->idx[lo]];
+	 coldiff = (col_diff + 0) [ (rgb->g - g) & 0x7F ];
+	 if (coldiff > lowest) {
+	    lo = -1;
+	 }
+	 else {
+	    coldiff += (col_diff + 128) [ (rgb->r - r) & 0x7F ];
+	    coldiff += (col_diff + 256) [ (rgb->b - b) & 0x7F ];
+	    i = bs->idx[lo];
+	    if ((coldiff < lowest) || ((coldiff == lowest) && (i < bestfit))) {
+	       lowest = coldiff;
+	       bestfit = i;
+	    }
+	    lo--;
+	 }
+      }
+   }
+
+   if (bs->memo) {
+      bs->memo[key] = bestfit;
+      bs->known[key >> 3] |= 1 << (key & 7);
+   }
+
+   return bestfit;
+}
+
+
+
+/* The search for the current palette is kept around between calls, and
+ * rebuilt when set_palette() or select_palette() change the palette.
+ */
+#define BESTFIT_PALETTE_CHANGED  1
+
+
+static BESTFIT_SEARCH current_search;
+static int current_search_ready = FALSE;
+
+
+
+/* bestfit_current_exit:
+ *  Frees the search for the current palette at shutdown time.
+ */
+static void bestfit_current_exit(void)
+{
+   bestfit_end(&current_search);
+   current_search_ready = FALSE;
+
+   _remove_exit_func(bestfit_current_exit);
+}
+
+
+
+/* bestfit_current:
+ *  Returns the search for the current palette, bringing it up to date.
+ */
+static BESTFIT_SEARCH *bestfit_current(void)
+{
+   if (!current_search_ready) {
+      bestfit_begin(&current_search, _current_palette);
+      current_search_ready = TRUE;
+      _current_palette_changed &= ~BESTFIT_PALETTE_CHANGED;
+      _add_exit_func(bestfit_current_exit, "bestfit_current_exit");
+   }
+   else if (_current_palette_changed & BESTFIT_PALETTE_CHANGED) {
+      bestfit_reset(&current_search, _current_palette);
+      _current_palette_changed &= ~BESTFIT_PALETTE_CHANGED;
+   }
+
+   return &current_search;
+}
+
+
+
+/* bestfit_color:
+ *  Searches a palette for the color closest to the requested R, G, B value.
+ *  Searches of the current palette go through a cached lookup, which only
+ *  has room for values in the 0-63 range; anything else gets the plain
+ *  linear search.
+ */
+int bestfit_color(AL_CONST PALETTE pal, int r, int g, int b)
+{
+   if ((pal == _current_palette) &&
+       ((unsigned)r <= 63) && ((unsigned)g <= 63) && ((unsigned)b <= 63))
+      return bestfit_search(bestfit_current(), r, g, b);
+
+   return bestfit_scan(pal, r, g, b);
+}
+
+
+
 /* makecol8: 
  *  Converts R, G, and B values (ranging 0-255) to an 8 bit paletted color.
  *  If the global rgb_map table is initialised, it uses that, otherwise
@@ -344,6 +590,183 @@ int makecol8(int r, int g, int b)
 
 
 
+/* On-disk cache for the table builders, disabled unless a directory has
+ * been given to set_color_table_cache(). Each table is stored in its own
+ * file, named after a hash of everything it was built from, and the file
+ * also holds that whole key so a hash collision can't return the wrong
+ * table.
+ */
+#define COLOR_CACHE_MAGIC  AL_ID('A','C','T','1')
+#define COLOR_CACHE_KEY    (PAL_SIZE*3 + 16)
+
+
+static char *color_table_cache = NULL;
+
+
+
+/* set_color_table_cache:
+ *  Sets the directory used to cache the tables made by create_rgb_table(),
+ *  create_light_table() and create_trans_table(), or disables the cache
+ *  when passed NULL.
+ */
+void set_color_table_cache(AL_CONST char *path)
+{
+   if (color_table_cache) {
+      _AL_FREE(color_table_cache);
+      color_table_cache = NULL;
+   }
+
+   if ((path) && (ugetc(path)))
+      color_table_cache = _al_ustrdup(path);
+}
+
+
+
+/* color_cache_key:
+ *  Builds the cache key of a table from its palette and parameters, and
+ *  the contents of rgb_map if the builder will use it. Returns the size
+ *  of the key.
+ */
+static int color_cache_key(unsigned char *key, AL_CONST PALETTE pal, int use_rgb_map, int r, int g, int b)
+{
+   unsigned long hash;
+   unsigned char *p;
+   int i, n = 0;
+
+   for (i=0; i<PAL_SIZE; i++) {
+      key[n++] = pal[i].r;
+      key[n++] = pal[i].g;
+      key[n++] = pal[i].b;
+   }
+
+   key[n++] = r;
+   key[n++] = g;
+   key[n++] = b;
+
+   if ((use_rgb_map) && (rgb_map)) {
+      /* FNV-1a of the whole map */
+      hash = 2166136261UL;
+      p = (unsigned char *)rgb_map->data;
+
+      for (i=0; i<(int)sizeof(rgb_map->data); i++)
+	 hash = ((hash ^ p[i]) * 16777619UL) & 0xFFFFFFFFUL;
+
+      key[n++] = 1;
+      key[n++] = (hash >> 24) & 0xFF;
+      key[n++] = (hash >> 16) & 0xFF;
+      key[n++] = (hash >> 8) & 0xFF;
+      key[n++] = hash & 0xFF;
+   }
+   else
+      key[n++] = 0;
+
+   return n;
+}
+
+
+
+/* color_cache_file:
+ *  Works out the cache file name for a table key.
+ */
+static void color_cache_file(char *filename, int size, int kind, AL_CONST unsigned char *key, int key_size)
+{
+   unsigned long hash = 2166136261UL;
+   char name[16], tmp[64];
+   int i;
+
+   for (i=0; i<key_size; i++)
+      hash = ((hash ^ key[i]) * 16777619UL) & 0xFFFFFFFFUL;
+
+   sprintf(name, "%c%07lx.tbl", kind, hash & 0xFFFFFFFUL);
+
+   append_filename(filename, color_table_cache, uconvert_ascii(name, tmp), size);
+}
+
+
+
+/* load_color_cache:
+ *  Tries to read a table from the cache. Returns TRUE on success.
+ */
+static int load_color_cache(int kind, AL_CONST unsigned char *key, int key_size, void *table, int size)
+{
+   unsigned char stored[COLOR_CACHE_KEY];
+   char filename[1024];
+   PACKFILE *f;
+   int ok;
+
+   if (!color_table_cache)
+      return FALSE;
+
+   color_cache_file(filename, sizeof(filename), kind, key, key_size);
+
+   f = pack_fopen(filename, F_READ);
+   if (!f)
+      return FALSE;
+
+   ok = ((pack_mgetl(f) == COLOR_CACHE_MAGIC) &&
+	 (pack_mgetl(f) == key_size) &&
+	 (pack_fread(stored, key_size, f) == key_size) &&
+	 (memcmp(stored, key, key_size) == 0) &&
+	 (pack_mgetl(f) == size) &&
+	 (pack_fread(table, size, f) == size));
+
+   pack_fclose(f);
+
+   return ok;
+}
+
+
+
+/* save_color_cache:
+ *  Writes a freshly built table to the cache, ignoring any errors.
+ */
+static void save_color_cache(int kind, AL_CONST unsigned char *key, int key_size, AL_CONST void *table, int size)
+{
+   char filename[1024];
+   PACKFILE *f;
+   int ok;
+
+   if (!color_table_cache)
+      return;
+
+   color_cache_file(filename, sizeof(filename), kind, key, key_size);
+
+   f = pack_fopen(filename, F_WRITE);
+   if (!f)
+      return;
+
+   pack_mputl(COLOR_CACHE_MAGIC, f);
+   pack_mputl(key_size, f);
+   pack_fwrite(key, key_size, f);
+   pack_mputl(size, f);
+   pack_fwrite(table, size, f);
+
+   ok = !pack_ferror(f);
+   pack_fclose(f);
+
+   /* don't leave a truncated file behind */
+   if (!ok)
+      delete_file(filename);
+}
+
+
+
+/* color_cache_progress:
+ *  Calls the progress callback of a table builder 256 times, for tables
+ *  that came out of the cache.
+ */
+static void color_cache_progress(void (*callback)(int pos))
+{
+   int i;
+
+   if (callback) {
+      for (i=0; i<256; i++)
+	 callback(i);
+   }
+}
+
+
+
 /* hsv_to_rgb:
  *  Converts from HSV colorspace to RGB values.
  */
@@ -554,8 +977,18 @@ void create_rgb_table(RGB_MAP *table, AL_CONST PALETTE pal, void (*callback)(int
    int count = 0;
    int cbcount = 0;
 
+   unsigned char key[COLOR_CACHE_KEY];
+   int key_size;
+
    #define AVERAGE_COUNT   18000
 
+   key_size = color_cache_key(key, pal, FALSE, 0, 0, 0);
+
+   if (load_color_cache('r', key, key_size, table->data, sizeof(table->data))) {
+      color_cache_progress(callback);
+      return;
+   }
+
    if (col_diff[1] == 0)
       bestfit_init();
 
@@ -658,6 +1091,8 @@ void create_rgb_table(RGB_MAP *table, AL_CONST PALETTE pal, void (*callback)(int
    if ((pal[0].r == 63) && (pal[0].g == 0) && (pal[0].b == 63))
       table->data[31][0][31] = 0;
 
+   save_color_cache('r', key, key_size, table->data, sizeof(table->data));
+
    if (callback)
       while (cbcount < 256)
 	 callback(cbcount++);
@@ -677,12 +1112,22 @@ void create_light_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 {
    int r1, g1, b1, r2, g2, b2, x, y;
    unsigned int t1, t2;
+   unsigned char key[COLOR_CACHE_KEY];
+   int key_size;
+   BESTFIT_SEARCH bs;
 
    ASSERT(table);
    ASSERT(r >= 0 && r <= 63);
    ASSERT(g >= 0 && g <= 63);
    ASSERT(b >= 0 && b <= 63);
 
+   key_size = color_cache_key(key, pal, TRUE, r, g, b);
+
+   if (load_color_cache('l', key, key_size, table->data, sizeof(table->data))) {
+      color_cache_progress(callback);
+      return;
+   }
+
    if (rgb_map) {
       for (x=0; x<PAL_SIZE-1; x++) {
 	 t1 = x * 0x010101;
@@ -699,11 +1144,14 @@ void create_light_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 
 	    table->data[x][y] = rgb_map->data[r2][g2][b2];
 	 }
+
+	 if (callback)
+	    (*callback)(x);
       }
-      if (callback)
-	 (*callback)(x);
    }
    else {
+      bestfit_begin(&bs, pal);
+
       for (x=0; x<PAL_SIZE-1; x++) {
 	 t1 = x * 0x010101;
 	 t2 = 0xFFFFFF - t1;
@@ -717,16 +1165,23 @@ void create_light_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 	    g2 = (g1 + pal[y].g * t1) >> 24;
 	    b2 = (b1 + pal[y].b * t1) >> 24;
 
-	    table->data[x][y] = bestfit_color(pal, r2, g2, b2);
+	    table->data[x][y] = bestfit_search(&bs, r2, g2, b2);
 	 }
+
+	 if (callback)
+	    (*callback)(x);
       }
 
-      if (callback)
-	 (*callback)(x);
+      bestfit_end(&bs);
    }
 
    for (y=0; y<PAL_SIZE; y++)
       table->data[255][y] = y;
+
+   save_color_cache('l', key, key_size, table->data, sizeof(table->data));
+
+   if (callback)
+      (*callback)(255);
 }
 
 
@@ -747,12 +1202,22 @@ void create_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
    unsigned char *p;
    int tr, tg, tb;
    int add;
+   unsigned char key[COLOR_CACHE_KEY];
+   int key_size;
+   BESTFIT_SEARCH bs;
 
    ASSERT(table);
    ASSERT(r >= 0 && r <= 255);
    ASSERT(g >= 0 && g <= 255);
    ASSERT(b >= 0 && b <= 255);
 
+   key_size = color_cache_key(key, pal, TRUE, r, g, b);
+
+   if (load_color_cache('t', key, key_size, table->data, sizeof(table->data))) {
+      color_cache_progress(callback);
+      return;
+   }
+
    /* This is a bit ugly, but accounts for the solidity parameters
       being in the range 0-255 rather than 0-256. Given that the
       precision of r,g,b components is only 6 bits it shouldn't do any
@@ -766,8 +1231,10 @@ void create_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 
    if (rgb_map)
       add = 255;
-   else
+   else {
       add = 127;
+      bestfit_begin(&bs, pal);
+   }
 
    for (x=0; x<256; x++) {
       tmp[x*3]   = pal[x].r * (256-r) + add;
@@ -796,7 +1263,7 @@ void create_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 	    tr = (i + *(q++)) >> 8;
 	    tg = (j + *(q++)) >> 8;
 	    tb = (k + *(q++)) >> 8;
-	    p[y] = bestfit_color(pal, tr, tg, tb);
+	    p[y] = bestfit_search(&bs, tr, tg, tb);
 	 }
       }
 
@@ -804,11 +1271,16 @@ void create_trans_table(COLOR_MAP *table, AL_CONST PALETTE pal, int r, int g, in
 	 (*callback)(x-1);
    }
 
+   if (!rgb_map)
+      bestfit_end(&bs);
+
    for (y=0; y<PAL_SIZE; y++) {
       table->data[0][y] = y;
       table->data[y][y] = y;
    }
 
+   save_color_cache('t', key, key_size, table->data, sizeof(table->data));
+
    if (callback)
       (*callback)(255);
 }
@@ -828,6 +1300,10 @@ void create_color_table(COLOR_MAP *table, AL_CONST PALETTE pal, void (*blend)(AL
 {
    int x, y;
    RGB c;
+   BESTFIT_SEARCH bs;
+
+   if (!rgb_map)
+      bestfit_begin(&bs, pal);
 
    for (x=0; x<PAL_SIZE; x++) {
       for (y=0; y<PAL_SIZE; y++) {
@@ -836,12 +1312,15 @@ void create_color_table(COLOR_MAP *table, AL_CONST PALETTE pal, void (*blend)(AL
 	 if (rgb_map)
 	    table->data[x][y] = rgb_map->data[c.r>>1][c.g>>1][c.b>>1];
 	 else
-	    table->data[x][y] = bestfit_color(pal, c.r, c.g, c.b);
+	    table->data[x][y] = bestfit_search(&bs, c.r, c.g, c.b);
       }
 
       if (callback)
 	 (*callback)(x);
    }
+
+   if (!rgb_map)
+      bestfit_end(&bs);
 }
 
 
@@ -857,9 +1336,13 @@ void create_blender_table(COLOR_MAP *table, AL_CONST PALETTE pal, void (*callbac
    int r, g, b;
    int r1, g1, b1;
    int r2, g2, b2;
+   BESTFIT_SEARCH bs;
 
    ASSERT(_blender_func24);
 
+   if (!rgb_map)
+      bestfit_begin(&bs, pal);
+
    for (x=0; x<PAL_SIZE; x++) {
       for (y=0; y<PAL_SIZE; y++) {
 	 r1 = (pal[x].r << 2) | ((pal[x].r & 0x30) >> 4);
@@ -879,11 +1362,14 @@ void create_blender_table(COLOR_MAP *table, AL_CONST PALETTE pal, void (*callbac
 	 if (rgb_map)
 	    table->data[x][y] = rgb_map->data[r>>3][g>>3][b>>3];
 	 else
-	    table->data[x][y] = bestfit_color(pal, r>>2, g>>2, b>>2);
+	    table->data[x][y] = bestfit_search(&bs, r>>2, g>>2, b>>2);
       }
 
       if (callback)
 	 (*callback)(x);
    }
+
+   if (!rgb_map)
+      bestfit_end(&bs);
 }
 
@@ -24,6 +24,14 @@
 #include "allegro.h"
 #include "allegro/internal/aintern.h"
 
+#ifdef ALLEGRO_UNIX
+   #include <sys/types.h>
+   #include <sys/stat.h>
+   #include <sys/mman.h>
+   #include <fcntl.h>
+   #include <unistd.h>
+#endif
+
 
 /* external interface to the Digmid driver */
 static int digmid_detect(int input);
@@ -85,6 +93,7 @@ typedef struct PATCH                /* Gravis PATCH structure */
    SAMPLE *sample[MAX_LAYERS];      /* the waveform data */
    PATCH_EXTRA *extra[MAX_LAYERS];  /* additional waveform information */
    int master_vol;                  /* overall volume level */
+   int cached;                      /* is the waveform data in the cache? */
 } PATCH;
 
 
@@ -109,6 +118,24 @@ typedef struct DIGMID_VOICE
 static DIGMID_VOICE digmid_voice[MIDI_VOICES];
 
 
+/* The patch cache is a single file holding a whole patch set the way
+ * load_patch() leaves it, so that it can be used without any parsing or
+ * conversion, straight from a shared memory mapping where possible. It
+ * is written in the byte order of the machine, and starts with a header
+ * giving the offset of each of the 256 instruments (zero if missing).
+ * Each instrument holds the volume and number of layers, followed by a
+ * PATCH_CACHE_LAYER block of 32 bit values for every layer.
+ */
+#define PATCH_CACHE_MAGIC     AL_ID('D','M','P','C')
+#define PATCH_CACHE_VERSION   1
+#define PATCH_CACHE_HEADER    (4 * (3 + 256))
+#define PATCH_CACHE_LAYER     16
+
+static unsigned char *patch_cache = NULL;
+static long patch_cache_size = 0;
+static int patch_cache_mapped = FALSE;
+
+
 
 /* destroy_patch:
  *  Frees a PATCH struct and all samples it contains.
@@ -119,7 +146,13 @@ static void destroy_patch(PATCH *pat)
 
    if (pat) {
       for (i=0; i < pat->samples; i++) {
-	 destroy_sample(pat->sample[i]);
+	 if (pat->cached) {
+	    /* the waveform belongs to the patch cache */
+	    UNLOCK_DATA(pat->sample[i], sizeof(SAMPLE));
+	    _AL_FREE(pat->sample[i]);
+	 }
+	 else
+	    destroy_sample(pat->sample[i]);
 
 	 UNLOCK_DATA(pat->extra[i], sizeof(PATCH_EXTRA));
 	 _AL_FREE(pat->extra[i]);
@@ -225,6 +258,8 @@ static PATCH *load_patch(PACKFILE *f, int drum)
       goto getout;
    }
 
+   p->cached = FALSE;
+
    pack_fread(buf, 65, f);                         /* description */
    p->master_vol = pack_igetw(f);                  /* volume */
 
@@ -513,6 +548,251 @@ static int parse_string(char *buf, char *argv[])
 
 
 
+/* get_patch_cache_name:
+ *  Returns the patch cache named in the config file, or NULL if none is.
+ */
+static AL_CONST char *get_patch_cache_name(void)
+{
+   char tmp1[64], tmp2[64];
+   AL_CONST char *name;
+
+   name = get_config_string(uconvert_ascii("sound", tmp1), uconvert_ascii("patch_cache", tmp2), NULL);
+   if ((!name) || (!ugetc(name)))
+      return NULL;
+
+   return name;
+}
+
+
+
+/* close_patch_cache:
+ *  Lets go of the patch cache, once no instrument is using it.
+ */
+static void close_patch_cache(void)
+{
+   if (patch_cache) {
+#ifdef ALLEGRO_UNIX
+      if (patch_cache_mapped)
+	 munmap(patch_cache, patch_cache_size);
+      else
+#endif
+      {
+	 UNLOCK_DATA(patch_cache, patch_cache_size);
+	 _AL_FREE(patch_cache);
+      }
+
+      patch_cache = NULL;
+      patch_cache_size = 0;
+      patch_cache_mapped = FALSE;
+   }
+}
+
+
+
+/* open_patch_cache:
+ *  Makes the patch cache named in the config file available. Where the
+ *  platform allows it is mapped into memory, so the waveforms are only
+ *  paged in as they are played and the pages are shared by every program
+ *  using the cache, otherwise it is read in one go. Returns FALSE if no
+ *  cache is set, or it isn't one we can use.
+ */
+static int open_patch_cache(void)
+{
+   char tmp[1024];
+   AL_CONST char *name;
+   PACKFILE *f;
+   uint32_t *header;
+   uint64_t size;
+
+   if (patch_cache)
+      return TRUE;
+
+   name = get_patch_cache_name();
+   if (!name)
+      return FALSE;
+
+#ifdef ALLEGRO_UNIX
+   {
+      struct stat st;
+      void *p;
+      int fd;
+
+      fd = open(uconvert_tofilename(name, tmp), O_RDONLY);
+      if (fd >= 0) {
+	 if ((fstat(fd, &st) == 0) && (st.st_size >= PATCH_CACHE_HEADER) && (st.st_size <= INT_MAX)) {
+	    p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	    if (p != MAP_FAILED) {
+	       patch_cache = p;
+	       patch_cache_size = st.st_size;
+	       patch_cache_mapped = TRUE;
+	    }
+	 }
+	 close(fd);
+      }
+   }
+#endif
+
+   if (!patch_cache) {
+      size = file_size_ex(name);
+      if ((size < PATCH_CACHE_HEADER) || (size > INT_MAX))
+	 return FALSE;
+
+      f = pack_fopen(name, F_READ);
+      if (!f)
+	 return FALSE;
+
+      patch_cache = _AL_MALLOC_ATOMIC(size);
+      if ((patch_cache) && (pack_fread(patch_cache, size, f) != (long)size)) {
+	 _AL_FREE(patch_cache);
+	 patch_cache = NULL;
+      }
+
+      pack_fclose(f);
+
+      if (!patch_cache)
+	 return FALSE;
+
+      patch_cache_size = size;
+      LOCK_DATA(patch_cache, patch_cache_size);
+   }
+
+   header = (uint32_t *)patch_cache;
+
+   if ((header[0] != PATCH_CACHE_MAGIC) || (header[1] != PATCH_CACHE_VERSION) ||
+       (header[2] != (uint32_t)patch_cache_size)) {
+      close_patch_cache();
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+
+/* load_cached_patch:
+ *  Sets up an instrument from the patch cache at the given offset, with
+ *  its samples playing the waveforms straight out of the cache. Returns
+ *  NULL if the entry is damaged or we run out of memory.
+ */
+static PATCH *load_cached_patch(uint32_t offset)
+{
+   unsigned long size = patch_cache_size;
+   uint32_t *rec, *layer;
+   PATCH *p;
+   int i;
+
+   if ((offset % 4) || (offset > size - 8))
+      return NULL;
+
+   rec = (uint32_t *)(patch_cache + offset);
+
+   if ((rec[1] > MAX_LAYERS) || (rec[1] * PATCH_CACHE_LAYER * 4 > size - offset - 8))
+      return NULL;
+
+   p = _AL_MALLOC(sizeof(PATCH));
+   if (!p) {
+      *allegro_errno = ENOMEM;
+      return NULL;
+   }
+
+   LOCK_DATA(p, sizeof(PATCH));
+
+   p->master_vol = rec[0];
+   p->samples = 0;
+   p->cached = TRUE;
+
+   for (i=0; i<(int)rec[1]; i++) {
+      layer = rec + 2 + i*PATCH_CACHE_LAYER;
+
+      /* bits, frequency, length, loop and waveform offset */
+      if (((layer[0] != 8) && (layer[0] != 16)) || (layer[2] > size) || (layer[5] > size) ||
+	  (layer[2] * (layer[0] / 8) > size - layer[5]) ||
+	  (layer[3] > layer[4]) || (layer[4] > layer[2]))
+	 break;
+
+      p->sample[i] = _AL_MALLOC(sizeof(SAMPLE));
+      if (!p->sample[i]) {
+	 *allegro_errno = ENOMEM;
+	 break;
+      }
+
+      p->extra[i] = _AL_MALLOC_ATOMIC(sizeof(PATCH_EXTRA));
+      if (!p->extra[i]) {
+	 _AL_FREE(p->sample[i]);
+	 *allegro_errno = ENOMEM;
+	 break;
+      }
+
+      p->sample[i]->bits = layer[0];
+      p->sample[i]->stereo = FALSE;
+      p->sample[i]->freq = layer[1];
+      p->sample[i]->priority = 128;
+      p->sample[i]->len = layer[2];
+      p->sample[i]->loop_start = layer[3];
+      p->sample[i]->loop_end = layer[4];
+      p->sample[i]->param = 0;
+      p->sample[i]->data = patch_cache + layer[5];
+
+      p->extra[i]->low_note = layer[6];
+      p->extra[i]->high_note = layer[7];
+      p->extra[i]->base_note = layer[8];
+      p->extra[i]->play_mode = layer[9];
+      p->extra[i]->decay_time = layer[10];
+      p->extra[i]->release_time = layer[11];
+      p->extra[i]->sustain_level = layer[12];
+      p->extra[i]->scale_freq = layer[13];
+      p->extra[i]->scale_factor = layer[14];
+      p->extra[i]->pan = layer[15];
+
+      LOCK_DATA(p->sample[i], sizeof(SAMPLE));
+      LOCK_DATA(p->extra[i], sizeof(PATCH_EXTRA));
+
+      p->samples++;
+   }
+
+   if (p->samples < (int)rec[1]) {
+      destroy_patch(p);
+      return NULL;
+   }
+
+   return p;
+}
+
+
+
+/* load_cached_patches:
+ *  Sets up the instruments that are required by a particular song from
+ *  the patch cache.
+ */
+static int load_cached_patches(AL_CONST char *patches, AL_CONST char *drums)
+{
+   uint32_t *index = (uint32_t *)patch_cache + 3;
+   int i, j;
+
+   for (i=0; i<256; i++) {
+      if ((patch[i]) || (!index[i]))
+	 continue;
+
+      if (!((i < 128) ? patches[i] : drums[i-128]))
+	 continue;
+
+      /* share multiple copies of the instrument */
+      for (j=0; j<256; j++) {
+	 if ((j != i) && (patch[j]) && (index[j] == index[i])) {
+	    patch[i] = patch[j];
+	    break;
+	 }
+      }
+
+      if (!patch[i])
+	 patch[i] = load_cached_patch(index[i]);
+   }
+
+   return 0;
+}
+
+
+
 /* digmid_load_patches:
  *  Reads the patches that are required by a particular song.
  */
@@ -531,6 +811,9 @@ static int digmid_load_patches(AL_CONST char *patches, AL_CONST char *drums)
    int type, size;
    int i, j, c;
 
+   if (open_patch_cache())
+      return load_cached_patches(patches, drums);
+
    if (!_digmid_find_patches(dir, sizeof(dir), file, sizeof(file)))
       return -1;
 
@@ -975,7 +1258,8 @@ static int digmid_detect(int input)
    if (input)
       return FALSE;
 
-   if (!_digmid_find_patches(NULL, 0, NULL, 0)) {
+   if (((!get_patch_cache_name()) || (!exists(get_patch_cache_name()))) &&
+       (!_digmid_find_patches(NULL, 0, NULL, 0))) {
       ustrzcpy(allegro_error, ALLEGRO_ERROR_SIZE, get_config_text("DIGMID patch set not found"));
       return FALSE;
    }
@@ -1044,6 +1328,170 @@ static void digmid_exit(int input)
 	 patch[i] = NULL;
       }
    }
+
+   close_patch_cache();
+}
+
+
+
+/* put_cache_value:
+ *  Writes a 32 bit value to the patch cache, in our own byte order.
+ */
+static void put_cache_value(PACKFILE *f, uint32_t val)
+{
+   pack_fwrite(&val, 4, f);
+}
+
+
+
+/* pad_cache:
+ *  Pads the patch cache with zeros up to the given position.
+ */
+static void pad_cache(PACKFILE *f, unsigned long *pos, unsigned long target)
+{
+   while (*pos < target) {
+      pack_putc(0, f);
+      (*pos)++;
+   }
+}
+
+
+
+/* save_midi_patch_cache:
+ *  Loads the whole patch set of the DIGMID driver, and writes it out as a
+ *  patch cache that can be named by the patch_cache config variable.
+ *  Returns zero on success.
+ */
+int save_midi_patch_cache(AL_CONST char *filename)
+{
+   PACKFILE *f;
+   uint32_t offset[256];
+   char first[256];
+   char tmp[1024];
+   unsigned long pos, data_pos, bytes;
+   PATCH *p;
+   int i, j;
+   ASSERT(filename);
+
+   if (midi_driver != &midi_digmid)
+      return -1;
+
+   if (load_midi_patches() != 0)
+      return -1;
+
+   /* lay out the instruments, then their waveforms */
+   pos = PATCH_CACHE_HEADER;
+
+   for (i=0; i<256; i++) {
+      offset[i] = 0;
+      first[i] = FALSE;
+
+      if (!patch[i])
+	 continue;
+
+      for (j=0; j<i; j++) {
+	 if (patch[j] == patch[i]) {
+	    offset[i] = offset[j];
+	    break;
+	 }
+      }
+
+      if (!offset[i]) {
+	 offset[i] = pos;
+	 first[i] = TRUE;
+	 pos += 4 * (2 + patch[i]->samples * PATCH_CACHE_LAYER);
+      }
+   }
+
+   data_pos = (pos + 15) & ~15;
+   pos = data_pos;
+
+   for (i=0; i<256; i++) {
+      if (first[i]) {
+	 for (j=0; j<patch[i]->samples; j++) {
+	    bytes = patch[i]->sample[j]->len * (patch[i]->sample[j]->bits / 8);
+	    pos += (bytes + 15) & ~15;
+	 }
+      }
+   }
+
+#ifdef ALLEGRO_UNIX
+   /* replace the file rather than writing over it, since programs that
+      have it mapped would crash when it shrinks under them */
+   unlink(uconvert_tofilename(filename, tmp));
+#endif
+
+   f = pack_fopen(filename, F_WRITE);
+   if (!f)
+      return -1;
+
+   put_cache_value(f, PATCH_CACHE_MAGIC);
+   put_cache_value(f, PATCH_CACHE_VERSION);
+   put_cache_value(f, pos);
+
+   for (i=0; i<256; i++)
+      put_cache_value(f, offset[i]);
+
+   pos = PATCH_CACHE_HEADER;
+
+   for (i=0; i<256; i++) {
+      if (!first[i])
+	 continue;
+
+      p = patch[i];
+
+      put_cache_value(f, p->master_vol);
+      put_cache_value(f, p->samples);
+
+      for (j=0; j<p->samples; j++) {
+	 put_cache_value(f, p->sample[j]->bits);
+	 put_cache_value(f, p->sample[j]->freq);
+	 put_cache_value(f, p->sample[j]->len);
+	 put_cache_value(f, p->sample[j]->loop_start);
+	 put_cache_value(f, p->sample[j]->loop_end);
+	 put_cache_value(f, data_pos);
+
+	 put_cache_value(f, p->extra[j]->low_note);
+	 put_cache_value(f, p->extra[j]->high_note);
+	 put_cache_value(f, p->extra[j]->base_note);
+	 put_cache_value(f, p->extra[j]->play_mode);
+	 put_cache_value(f, p->extra[j]->decay_time);
+	 put_cache_value(f, p->extra[j]->release_time);
+	 put_cache_value(f, p->extra[j]->sustain_level);
+	 put_cache_value(f, p->extra[j]->scale_freq);
+	 put_cache_value(f, p->extra[j]->scale_factor);
+	 put_cache_value(f, p->extra[j]->pan);
+
+	 bytes = p->sample[j]->len * (p->sample[j]->bits / 8);
+	 data_pos += (bytes + 15) & ~15;
+      }
+
+      pos += 4 * (2 + p->samples * PATCH_CACHE_LAYER);
+   }
+
+   /* the waveforms, ready to play */
+   pad_cache(f, &pos, (pos + 15) & ~15);
+
+   for (i=0; i<256; i++) {
+      if (!first[i])
+	 continue;
+
+      p = patch[i];
+
+      for (j=0; j<p->samples; j++) {
+	 bytes = p->sample[j]->len * (p->sample[j]->bits / 8);
+	 pack_fwrite(p->sample[j]->data, bytes, f);
+	 pos += bytes;
+	 pad_cache(f, &pos, (pos + 15) & ~15);
+      }
+   }
+
+   if (pack_ferror(f)) {
+      pack_fclose(f);
+      return -1;
+   }
+
+   return (pack_fclose(f) == 0) ? 0 : -1;
 }
 
 
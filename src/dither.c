@@ -17,6 +17,7 @@
 
 
 #include "allegro.h"
+#include "allegro/internal/aintern.h"
 
 
 
@@ -88,3 +89,71 @@ int makecol16_dither(int r, int g, int b, int x, int y)
 }
 
 
+
+
+
+/* Whole scanline versions of the above. For each of the eight positions
+ * in the dither pattern there is a table of what every red, green and blue
+ * value turns into, already shifted into place, so a pixel only needs three
+ * lookups. The tables are filled in by calling the functions above, so the
+ * results are always the same.
+ */
+static unsigned short dither_line_table[2][8*3*256];
+static int dither_line_shifts[2][3] = { { -1, -1, -1 }, { -1, -1, -1 } };
+
+
+
+/* _get_dither_row:
+ *  Sets row[x&7] to the tables for pixel x of line y of a 15 or 16 bit
+ *  dithered image: the pixel is row[x&7][r] | row[x&7][256+g] | row[x&7][512+b].
+ */
+void _get_dither_row(int depth, int y, AL_CONST unsigned short *row[8])
+{
+   unsigned short *table;
+   int *shifts;
+   int i, p, v;
+
+   ASSERT((depth == 15) || (depth == 16));
+
+   i = (depth == 15) ? 0 : 1;
+   table = dither_line_table[i];
+   shifts = dither_line_shifts[i];
+
+   /* the pixel format can change when a graphics mode is set */
+   if (depth == 15) {
+      if ((shifts[0] != _rgb_r_shift_15) || (shifts[1] != _rgb_g_shift_15) || (shifts[2] != _rgb_b_shift_15)) {
+	 for (p=0; p<8; p++) {
+	    /* line 5 has no offset in the pattern */
+	    for (v=0; v<256; v++) {
+	       table[(p*3+0)*256+v] = makecol15_dither(v, 0, 0, p, 5);
+	       table[(p*3+1)*256+v] = makecol15_dither(0, v, 0, p, 5);
+	       table[(p*3+2)*256+v] = makecol15_dither(0, 0, v, p, 5);
+	    }
+	 }
+
+	 shifts[0] = _rgb_r_shift_15;
+	 shifts[1] = _rgb_g_shift_15;
+	 shifts[2] = _rgb_b_shift_15;
+      }
+   }
+   else {
+      if ((shifts[0] != _rgb_r_shift_16) || (shifts[1] != _rgb_g_shift_16) || (shifts[2] != _rgb_b_shift_16)) {
+	 for (p=0; p<8; p++) {
+	    for (v=0; v<256; v++) {
+	       table[(p*3+0)*256+v] = makecol16_dither(v, 0, 0, p, 5);
+	       table[(p*3+1)*256+v] = makecol16_dither(0, v, 0, p, 5);
+	       table[(p*3+2)*256+v] = makecol16_dither(0, 0, v, p, 5);
+	    }
+	 }
+
+	 shifts[0] = _rgb_r_shift_16;
+	 shifts[1] = _rgb_g_shift_16;
+	 shifts[2] = _rgb_b_shift_16;
+      }
+   }
+
+   v = dither_ytable[y&7];
+
+   for (i=0; i<8; i++)
+      row[i] = table + ((i + v) & 7) * 3 * 256;
+}
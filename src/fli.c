@@ -73,7 +73,35 @@ typedef struct FLI_CHUNK
 
 
 
-static int fli_status = FLI_NOT_OPEN;  /* current state of the FLI player */
+typedef struct FLI_KEYFRAME
+{
+   int               frame;            /* frame number */
+   long              pos;              /* offset of its frame header */
+   int               palette;          /* palette before the frame */
+} FLI_KEYFRAME;
+
+
+
+typedef struct FLI_DECODER
+{
+   int               status;           /* current state of the player */
+   PACKFILE          *file;            /* the file we are reading */
+   char              *filename;        /* name of the file */
+   void              *mem_data;        /* the memory FLI we are playing */
+   long              pos;              /* position in the FLI data */
+   FLI_HEADER        header;           /* header structure */
+   FLI_FRAME         frame_header;     /* frame header structure */
+   FLI_KEYFRAME      *keyframe;        /* frames which redraw the whole image */
+   int               keyframes;
+   PALETTE           *palette;         /* palettes before the keyframes */
+   int               palettes;
+   int               *dirty_l;         /* changed span of each line */
+   int               *dirty_r;
+} FLI_DECODER;
+
+
+
+static FLI_PLAYER *fli_player = NULL;  /* the player behind open_fli() */
 
 BITMAP *fli_bitmap = NULL;             /* current frame of the FLI */
 PALETTE fli_palette;                   /* current palette the FLI is using */
@@ -87,14 +115,7 @@ int fli_frame = 0;                     /* current frame number in the FLI */
 
 volatile int fli_timer = 0;            /* for timing FLI playback */
 
-static PACKFILE *fli_file = NULL;      /* the file we are reading */
-static char *fli_filename = NULL;      /* name of the file */
-
-static void *fli_mem_data = NULL;      /* the memory FLI we are playing */
-static int fli_mem_pos = 0;            /* position in the memory FLI */
-
-static FLI_HEADER fli_header;          /* header structure */
-static FLI_FRAME frame_header;         /* frame header structure */
+static volatile int fli_player_timer = 0; /* for timing play_fli_player() */
 
 static unsigned char _fli_broken_data[3 * 256]; /* data substituted for broken chunks */
 
@@ -112,23 +133,34 @@ END_OF_STATIC_FUNCTION(fli_timer_callback);
 
 
 
+/* fli_player_timer_callback:
+ *  Timer interrupt handler for syncing play_fli_player().
+ */
+static void fli_player_timer_callback(void)
+{
+   fli_player_timer++;
+}
+
+END_OF_STATIC_FUNCTION(fli_player_timer_callback);
+
+
+
 /* fli_read:
  *  Helper function to get a block of data from the FLI, which can read 
  *  from disk or a copy of the FLI held in memory. If buf is set, that is 
  *  where it stores the data, otherwise it uses the scratch buffer. Returns 
  *  a pointer to the data, or NULL on error.
  */
-static void *fli_read(void *buf, int size)
+static void *fli_read(FLI_PLAYER *fli, void *buf, int size)
 {
+   FLI_DECODER *d = fli->extra;
    int result;
 
-   if (fli_mem_data) {
+   if (d->mem_data) {
       if (buf)
-	 memcpy(buf, (char *)fli_mem_data+fli_mem_pos, size);
+	 memcpy(buf, (char *)d->mem_data+d->pos, size);
       else
-	 buf = (char *)fli_mem_data+fli_mem_pos;
-
-      fli_mem_pos += size;
+	 buf = (char *)d->mem_data+d->pos;
    }
    else {
       if (!buf) {
@@ -136,33 +168,53 @@ static void *fli_read(void *buf, int size)
 	 buf = _scratch_mem;
       }
 
-      result = pack_fread(buf, size, fli_file);
+      result = pack_fread(buf, size, d->file);
       if (result != size)
 	 return NULL;
    }
 
+   d->pos += size;
+
    return buf;
 }
 
 
 
-/* fli_rewind:
- *  Helper function to rewind to the beginning of the FLI file data.
- *  Pass offset from the beginning of the data in bytes.
+/* fli_seek:
+ *  Helper function to move to another place in the FLI file data. Pass
+ *  offset from the beginning of the data in bytes. Going backwards in a
+ *  file means reopening it, which we can't do with a packfile we have
+ *  been given; that fails without touching the player, which can still
+ *  read on from where it is. Returns zero on success.
  */
-static void fli_rewind(int offset)
+static int fli_seek(FLI_PLAYER *fli, long offset)
 {
-   if (fli_mem_data) {
-      fli_mem_pos = offset;
-   }
-   else {
-      pack_fclose(fli_file);
-      fli_file = pack_fopen(fli_filename, F_READ);
-      if (fli_file)
-	 pack_fseek(fli_file, offset);
-      else
-	 fli_status = FLI_ERROR;
+   FLI_DECODER *d = fli->extra;
+
+   if ((!d->mem_data) && (offset != d->pos)) {
+      if (offset < d->pos) {
+	 if (!d->filename)
+	    return -1;
+
+	 pack_fclose(d->file);
+	 d->file = pack_fopen(d->filename, F_READ);
+	 if (!d->file) {
+	    d->status = FLI_ERROR;
+	    return -1;
+	 }
+
+	 d->pos = 0;
+      }
+
+      if (pack_fseek(d->file, offset - d->pos) != 0) {
+	 d->status = FLI_ERROR;
+	 return -1;
+      }
    }
+
+   d->pos = offset;
+
+   return 0;
 }
 
 
@@ -171,14 +223,11 @@ static void fli_rewind(int offset)
  *  Helper function to skip some bytes of the FLI file data.
  *  Pass number of bytes to skip.
  */
-static void fli_skip(int bytes)
+static int fli_skip(FLI_PLAYER *fli, int bytes)
 {
-   if (fli_mem_data) {
-      fli_mem_pos += bytes;
-   }
-   else {
-      pack_fseek(fli_file, bytes);
-   }
+   FLI_DECODER *d = fli->extra;
+
+   return fli_seek(fli, d->pos + bytes);
 }
 
 
@@ -265,35 +314,21 @@ static signed long _fli_read_long_nc(unsigned char **p)
 #define READ_RLE_BYTE_NC(p,pos,size)                            \
    memset((pos), READ_BYTE_NC(p), (size))
 
-#if (defined ALLEGRO_GCC) && (defined ALLEGRO_I386)
-
-#define READ_RLE_WORD_NC(p,pos,size)                            \
-{                                                               \
-   int c;                                                       \
-   uint16_t *ptr = (uint16_t*) (pos);                           \
-   unsigned short v = READ_WORD_NC(p);                          \
-								\
-   for (c = 0; c < (size); c++)                                 \
-      *ptr++ = v;                                               \
-}
-
-#else
-
+/* writes the word once and then keeps doubling it up, so that long runs
+ * are filled by a few wide copies rather than one word at a time
+ */
 #define READ_RLE_WORD_NC(p,pos,size)                            \
 {                                                               \
    int c;                                                       \
    unsigned char *ptr = (pos);                                  \
-   unsigned char v1 = READ_BYTE_NC(p);                          \
-   unsigned char v2 = READ_BYTE_NC(p);                          \
 								\
-   for (c = 0; c < (size); c++) {                               \
-      *ptr++ = v1;                                              \
-      *ptr++ = v2;                                              \
-   }                                                            \
+   ptr[0] = READ_BYTE_NC(p);                                    \
+   ptr[1] = READ_BYTE_NC(p);                                    \
+								\
+   for (c = 2; c < (size) * 2; c *= 2)                          \
+      memcpy(ptr + c, ptr, MIN(c, (size) * 2 - c));             \
 }
 
-#endif
-
 
 
 /* support for broken chunks (copy reminder of chunk and add zeros)
@@ -316,10 +351,56 @@ static signed long _fli_read_long_nc(unsigned char **p)
 
 
 
+/* mark_dirty:
+ *  Records that the bytes of the frame bitmap from start up to end have
+ *  changed, given as offsets from the start of its first line. The lines
+ *  of a memory bitmap follow each other, so the range can cover several.
+ */
+static void mark_dirty(FLI_PLAYER *fli, int start, int end)
+{
+   FLI_DECODER *d = fli->extra;
+   int w = fli->bitmap->w;
+   int y, x;
+
+   while (start < end) {
+      y = start / w;
+      x = start - y * w;
+
+      d->dirty_l[y] = MIN(d->dirty_l[y], x);
+      d->dirty_r[y] = MAX(d->dirty_r[y], MIN(end - y * w, w) - 1);
+
+      fli->bmp_dirty_from = MIN(fli->bmp_dirty_from, y);
+      fli->bmp_dirty_to = MAX(fli->bmp_dirty_to, y);
+
+      start = (y + 1) * w;
+   }
+}
+
+
+
+/* mark_all_dirty:
+ *  Records that the whole frame bitmap has changed.
+ */
+static void mark_all_dirty(FLI_PLAYER *fli)
+{
+   FLI_DECODER *d = fli->extra;
+   int y;
+
+   for (y=0; y<fli->bitmap->h; y++) {
+      d->dirty_l[y] = 0;
+      d->dirty_r[y] = fli->bitmap->w-1;
+   }
+
+   fli->bmp_dirty_from = 0;
+   fli->bmp_dirty_to = fli->bitmap->h-1;
+}
+
+
+
 /* do_fli_256_color:
  *  Processes an FLI 256_COLOR chunk
  */
-static void do_fli_256_color(unsigned char *p, int sz)
+static void do_fli_256_color(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int packets;
    int end;
@@ -346,13 +427,13 @@ static void do_fli_256_color(unsigned char *p, int sz)
 	 FLI_KLUDGE(p, sz, length * 3);
       }
 
-      fli_pal_dirty_from = MIN(fli_pal_dirty_from, offset);
-      fli_pal_dirty_to = MAX(fli_pal_dirty_to, end-1);
+      fli->pal_dirty_from = MIN(fli->pal_dirty_from, offset);
+      fli->pal_dirty_to = MAX(fli->pal_dirty_to, end-1);
 
       for(; offset < end; offset++) {
-	 fli_palette[offset].r = READ_BYTE_NC(p) / 4;
-	 fli_palette[offset].g = READ_BYTE_NC(p) / 4;
-	 fli_palette[offset].b = READ_BYTE_NC(p) / 4;
+	 fli->palette[offset].r = READ_BYTE_NC(p) / 4;
+	 fli->palette[offset].g = READ_BYTE_NC(p) / 4;
+	 fli->palette[offset].b = READ_BYTE_NC(p) / 4;
       }
    }
 }
@@ -362,14 +443,15 @@ static void do_fli_256_color(unsigned char *p, int sz)
 /* do_fli_delta:
  *  Processes an FLI DELTA chunk
  */
-static void do_fli_delta(unsigned char *p, int sz)
+static void do_fli_delta(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int lines;
    int packets;
    int size;
    int y;
    unsigned char *curr;
-   unsigned char *bitmap_end = fli_bitmap->line[fli_bitmap->h-1] + fli_bitmap->w;
+   unsigned char *bitmap_start = fli->bitmap->line[0];
+   unsigned char *bitmap_end = fli->bitmap->line[fli->bitmap->h-1] + fli->bitmap->w;
 
    y = 0;
    if ((sz -= 2) < 0)
@@ -384,20 +466,22 @@ static void do_fli_delta(unsigned char *p, int sz)
       while (packets < 0) {
 	 if (packets & 0x4000)
 	    y -= packets;
-	 else if (y < fli_bitmap->h)
-	    fli_bitmap->line[y][fli_bitmap->w-1] = packets & 0xFF;
+	 else if (y < fli->bitmap->h) {
+	    fli->bitmap->line[y][fli->bitmap->w-1] = packets & 0xFF;
+	    mark_dirty(fli, (y+1) * fli->bitmap->w - 1, (y+1) * fli->bitmap->w);
+	 }
 
 	 if ((sz -= 2) < 0)
 	    return;
 	 packets = READ_SHORT_NC(p);
       }
-      if (y >= fli_bitmap->h)
+      if (y >= fli->bitmap->h)
 	 return;
 
-      curr = fli_bitmap->line[y];
+      curr = fli->bitmap->line[y];
 
-      fli_bmp_dirty_from = MIN(fli_bmp_dirty_from, y);
-      fli_bmp_dirty_to = MAX(fli_bmp_dirty_to, y);
+      fli->bmp_dirty_from = MIN(fli->bmp_dirty_from, y);
+      fli->bmp_dirty_to = MAX(fli->bmp_dirty_to, y);
 
       while (packets-- > 0) {
 	 if ((sz -= 2) < 0)
@@ -412,6 +496,7 @@ static void do_fli_delta(unsigned char *p, int sz)
 	       FLI_KLUDGE(p, sz, size * 2);
 	    }
 	    READ_BLOCK_NC(p, curr, size*2);
+	    mark_dirty(fli, curr - bitmap_start, curr + size*2 - bitmap_start);
 	    curr += size*2;
 	 }
 	 else if (size < 0) {             /* repeat word -size times */
@@ -422,6 +507,7 @@ static void do_fli_delta(unsigned char *p, int sz)
 	       FLI_KLUDGE(p, sz, 2);
 	    }
 	    READ_RLE_WORD_NC(p, curr, size);
+	    mark_dirty(fli, curr - bitmap_start, curr + size*2 - bitmap_start);
 	    curr += size*2;
 	 }
       }
@@ -435,7 +521,7 @@ static void do_fli_delta(unsigned char *p, int sz)
 /* do_fli_color:
  *  Processes an FLI COLOR chunk
  */
-static void do_fli_color(unsigned char *p, int sz)
+static void do_fli_color(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int packets;
    int end;
@@ -462,13 +548,13 @@ static void do_fli_color(unsigned char *p, int sz)
 	 FLI_KLUDGE(p, sz, length * 3);
       }
 
-      fli_pal_dirty_from = MIN(fli_pal_dirty_from, offset);
-      fli_pal_dirty_to = MAX(fli_pal_dirty_to, end-1);
+      fli->pal_dirty_from = MIN(fli->pal_dirty_from, offset);
+      fli->pal_dirty_to = MAX(fli->pal_dirty_to, end-1);
 
       for(; offset < end; offset++) {
-	 fli_palette[offset].r = READ_BYTE_NC(p);
-	 fli_palette[offset].g = READ_BYTE_NC(p);
-	 fli_palette[offset].b = READ_BYTE_NC(p);
+	 fli->palette[offset].r = READ_BYTE_NC(p);
+	 fli->palette[offset].g = READ_BYTE_NC(p);
+	 fli->palette[offset].b = READ_BYTE_NC(p);
       }
    }
 }
@@ -478,33 +564,34 @@ static void do_fli_color(unsigned char *p, int sz)
 /* do_fli_lc:
  *  Processes an FLI LC chunk
  */
-static void do_fli_lc(unsigned char *p, int sz)
+static void do_fli_lc(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int lines;
    int packets;
    int size;
    int y;
    unsigned char *curr;
-   unsigned char *bitmap_end = fli_bitmap->line[fli_bitmap->h-1] + fli_bitmap->w;
+   unsigned char *bitmap_start = fli->bitmap->line[0];
+   unsigned char *bitmap_end = fli->bitmap->line[fli->bitmap->h-1] + fli->bitmap->w;
 
    if ((sz -= 4) < 0)
       return;
    y = READ_WORD_NC(p);
    lines = READ_SHORT_NC(p);
 
-   if (y >= fli_bitmap->h)
+   if (y >= fli->bitmap->h)
       return;
-   else if ((y + lines) > fli_bitmap->h)
-      lines = fli_bitmap->h - y;
+   else if ((y + lines) > fli->bitmap->h)
+      lines = fli->bitmap->h - y;
 
-   fli_bmp_dirty_from = MIN(fli_bmp_dirty_from, y);
-   fli_bmp_dirty_to = MAX(fli_bmp_dirty_to, y+lines-1);
+   fli->bmp_dirty_from = MIN(fli->bmp_dirty_from, y);
+   fli->bmp_dirty_to = MAX(fli->bmp_dirty_to, y+lines-1);
 
    while (lines-- > 0) {                     /* for each line... */
       if ((sz -= 1) < 0)
 	 return;
       packets = READ_BYTE_NC(p);
-      curr = fli_bitmap->line[y];
+      curr = fli->bitmap->line[y];
 
       while (packets-- > 0) {
 	 if ((sz -= 2) < 0)
@@ -519,6 +606,7 @@ static void do_fli_lc(unsigned char *p, int sz)
 	       FLI_KLUDGE(p, sz, size);
 	    }
 	    READ_BLOCK_NC(p, curr, size);
+	    mark_dirty(fli, curr - bitmap_start, curr + size - bitmap_start);
 	    curr += size;
 	 }
 	 else if (size < 0) {                /* repeat byte -size times */
@@ -529,6 +617,7 @@ static void do_fli_lc(unsigned char *p, int sz)
 	       FLI_KLUDGE(p, sz, 1);
 	    }
 	    READ_RLE_BYTE_NC(p, curr, size);
+	    mark_dirty(fli, curr - bitmap_start, curr + size - bitmap_start);
 	    curr += size;
 	 }
       }
@@ -542,12 +631,11 @@ static void do_fli_lc(unsigned char *p, int sz)
 /* do_fli_black:
  *  Processes an FLI BLACK chunk
  */
-static void do_fli_black(void)
+static void do_fli_black(FLI_PLAYER *fli)
 {
-   clear_bitmap(fli_bitmap);
+   clear_bitmap(fli->bitmap);
 
-   fli_bmp_dirty_from = 0;
-   fli_bmp_dirty_to = fli_bitmap->h-1;
+   mark_all_dirty(fli);
 }
 
 
@@ -555,25 +643,24 @@ static void do_fli_black(void)
 /* do_fli_brun:
  *  Processes an FLI BRUN chunk
  */
-static void do_fli_brun(unsigned char *p, int sz)
+static void do_fli_brun(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int packets;
    int size;
    int y;
    unsigned char *curr;
-   unsigned char *bitmap_end = fli_bitmap->line[fli_bitmap->h-1] + fli_bitmap->w;
+   unsigned char *bitmap_end = fli->bitmap->line[fli->bitmap->h-1] + fli->bitmap->w;
 
-   fli_bmp_dirty_from = 0;
-   fli_bmp_dirty_to = fli_bitmap->h-1;
+   mark_all_dirty(fli);
 
-   for (y=0; y<fli_bitmap->h; y++) {         /* for each line... */
+   for (y=0; y<fli->bitmap->h; y++) {        /* for each line... */
       if ((sz -= 1) < 0)
 	 return;
       packets = READ_BYTE_NC(p);
-      curr = fli_bitmap->line[y];
+      curr = fli->bitmap->line[y];
 
       if (packets == 0) {                    /* FLC chunk (fills the whole line) */
-	 unsigned char *line_end = curr + fli_bitmap->w;
+	 unsigned char *line_end = curr + fli->bitmap->w;
 
 	 while (curr < line_end) {
 	    if ((sz -= 1) < 0)
@@ -637,18 +724,17 @@ static void do_fli_brun(unsigned char *p, int sz)
 /* do_fli_copy:
  *  Processes an FLI COPY chunk
  */
-static void do_fli_copy(unsigned char *p, int sz)
+static void do_fli_copy(FLI_PLAYER *fli, unsigned char *p, int sz)
 {
    int y;
 
-   if ((sz -= (fli_bitmap->w * fli_bitmap->h)) < 0)
+   if ((sz -= (fli->bitmap->w * fli->bitmap->h)) < 0)
       return;
 
-   for (y=0; y<fli_bitmap->h; y++)
-      READ_BLOCK_NC(p, fli_bitmap->line[y], fli_bitmap->w);
+   for (y=0; y<fli->bitmap->h; y++)
+      READ_BLOCK_NC(p, fli->bitmap->line[y], fli->bitmap->w);
 
-   fli_bmp_dirty_from = 0;
-   fli_bmp_dirty_to = fli_bitmap->h-1;
+   mark_all_dirty(fli);
 }
 
 
@@ -656,9 +742,9 @@ static void do_fli_copy(unsigned char *p, int sz)
 /* _fli_read_header:
  *  Reads FLI file header (0 -- OK).
  */
-static int _fli_read_header(FLI_HEADER *header)
+static int _fli_read_header(FLI_PLAYER *fli, FLI_HEADER *header)
 {
-   unsigned char *p = fli_read(NULL, sizeof_FLI_HEADER);
+   unsigned char *p = fli_read(fli, NULL, sizeof_FLI_HEADER);
 
    if (!p)
       return -1;
@@ -682,9 +768,9 @@ static int _fli_read_header(FLI_HEADER *header)
 /* _fli_read_frame:
  *  Reads FLI frame header (0 -- OK).
  */
-static int _fli_read_frame(FLI_FRAME *frame)
+static int _fli_read_frame(FLI_PLAYER *fli, FLI_FRAME *frame)
 {
-   unsigned char *p = fli_read(NULL, sizeof_FLI_FRAME);
+   unsigned char *p = fli_read(fli, NULL, sizeof_FLI_FRAME);
 
    if (!p)
       return -1;
@@ -714,124 +800,684 @@ static int _fli_parse_chunk(FLI_CHUNK *chunk, unsigned char *p, unsigned long fr
 
 
 
+/* decode_chunks:
+ *  Processes the chunks of a frame. If pixels is zero, only the palette
+ *  chunks are decoded. Returns non-zero if the frame redraws the whole
+ *  image, so that it doesn't depend on the frames before it.
+ */
+static int decode_chunks(FLI_PLAYER *fli, unsigned char *p, int frame_size, int chunks, int pixels)
+{
+   FLI_CHUNK chunk;
+   int c, sz;
+   int full = FALSE;
+
+   for (c=0; c<chunks; c++) {
+      if (_fli_parse_chunk(&chunk, p, frame_size) != 0) {
+	 /* chunk is broken, but don't return an error */
+	 break;
+      }
+
+      p += sizeof_FLI_CHUNK;
+      sz = chunk.size - sizeof_FLI_CHUNK;
+      frame_size -= chunk.size;
+
+      if (c == chunks-1)
+	 sz += frame_size;
+
+      switch (chunk.type) {
+
+	 case 4:
+	    do_fli_256_color(fli, p, sz);
+	    break;
+
+	 case 7:
+	    if (pixels)
+	       do_fli_delta(fli, p, sz);
+	    break;
+
+	 case 11:
+	    do_fli_color(fli, p, sz);
+	    break;
+
+	 case 12:
+	    if (pixels)
+	       do_fli_lc(fli, p, sz);
+	    break;
+
+	 case 13:
+	    if (pixels)
+	       do_fli_black(fli);
+	    full = TRUE;
+	    break;
+
+	 case 15:
+	    if (pixels)
+	       do_fli_brun(fli, p, sz);
+	    full = TRUE;
+	    break;
+
+	 case 16:
+	    if (pixels)
+	       do_fli_copy(fli, p, sz);
+	    full = TRUE;
+	    break;
+
+	 default:
+	    /* should we return an error? nah... */
+	    break;
+      }
+
+      p += sz;
+
+      /* alignment */
+      if (sz & 1) {
+	 p++;
+	 frame_size--;
+      }
+   }
+
+   return full;
+}
+
+
+
 /* read_frame:
  *  Advances to the next frame in the FLI.
  */
-static void read_frame(void)
+static void read_frame(FLI_PLAYER *fli)
 {
+   FLI_DECODER *d = fli->extra;
    unsigned char *p;
-   FLI_CHUNK chunk;
-   int c, sz, frame_size;
+   int frame_size;
 
-   if (fli_status != FLI_OK)
+   if (d->status != FLI_OK)
       return;
 
    /* clear the first frame (we need it for looping, because we don't support ring frame) */
-   if (fli_frame == 0) {
-      clear_bitmap(fli_bitmap);
-      fli_bmp_dirty_from = 0;
-      fli_bmp_dirty_to = fli_bitmap->h-1;
+   if (fli->frame == 0) {
+      clear_bitmap(fli->bitmap);
+      mark_all_dirty(fli);
    }
 
    get_another_frame:
 
-   /* read the frame header */ 
-   if (_fli_read_frame(&frame_header) != 0) {
-      fli_status = FLI_ERROR;
+   /* read the frame header */
+   if (_fli_read_frame(fli, &d->frame_header) != 0) {
+      d->status = FLI_ERROR;
       return;
    }
 
    /* skip FLC's useless frame */
-   if ((frame_header.type == FLI_FRAME_PREFIX) || (frame_header.type == FLI_FRAME_USELESS)) {
-      fli_skip(frame_header.size-sizeof_FLI_FRAME);
+   if ((d->frame_header.type == FLI_FRAME_PREFIX) || (d->frame_header.type == FLI_FRAME_USELESS)) {
+      fli_skip(fli, d->frame_header.size-sizeof_FLI_FRAME);
 
-      if (++fli_frame >= fli_header.frame_count)
+      if (++fli->frame >= d->header.frame_count)
 	 return;
 
       goto get_another_frame;
    }
 
-   if (frame_header.type != FLI_FRAME_MAGIC) {
-      fli_status = FLI_ERROR;
+   if (d->frame_header.type != FLI_FRAME_MAGIC) {
+      d->status = FLI_ERROR;
       return;
    }
 
    /* bytes left in this frame */
-   frame_size = frame_header.size - sizeof_FLI_FRAME;
+   frame_size = d->frame_header.size - sizeof_FLI_FRAME;
 
    /* return if there is no data in the frame */
    if (frame_size == 0) {
-      fli_frame++;
+      fli->frame++;
       return;
    }
 
    /* read the frame data */
-   p = fli_read(NULL, frame_size);
+   p = fli_read(fli, NULL, frame_size);
    if (!p) {
-      fli_status = FLI_ERROR;
+      d->status = FLI_ERROR;
       return;
    }
 
    /* now to decode it */
-   for (c=0; c<frame_header.chunks; c++) {
-      if (_fli_parse_chunk(&chunk, p, frame_size) != 0) {
-	 /* chunk is broken, but don't return an error */
+   decode_chunks(fli, p, frame_size, d->frame_header.chunks, TRUE);
+
+   /* move on to the next frame */
+   fli->frame++;
+}
+
+
+
+/* add_keyframe:
+ *  Helper for build_index(), which adds a frame to the index along with
+ *  the palette before it. Returns zero if we are out of memory.
+ */
+static int add_keyframe(FLI_PLAYER *fli, int frame, long pos, AL_CONST RGB *pal)
+{
+   FLI_DECODER *d = fli->extra;
+   void *tmp;
+
+   /* most FLIs never change the palette after the first frame */
+   if ((d->palettes == 0) || (memcmp(d->palette[d->palettes-1], pal, sizeof(PALETTE)) != 0)) {
+      tmp = _AL_REALLOC(d->palette, sizeof(PALETTE) * (d->palettes+1));
+      if (!tmp)
+	 return FALSE;
+
+      d->palette = tmp;
+      memcpy(d->palette[d->palettes], pal, sizeof(PALETTE));
+      d->palettes++;
+   }
+
+   tmp = _AL_REALLOC(d->keyframe, sizeof(FLI_KEYFRAME) * (d->keyframes+1));
+   if (!tmp)
+      return FALSE;
+
+   d->keyframe = tmp;
+   d->keyframe[d->keyframes].frame = frame;
+   d->keyframe[d->keyframes].pos = pos;
+   d->keyframe[d->keyframes].palette = d->palettes-1;
+   d->keyframes++;
+
+   return TRUE;
+}
+
+
+
+/* build_index:
+ *  Scans through the whole FLI for frames which redraw the whole image,
+ *  remembering where they are and what the palette is before them, so
+ *  that seeking can start decoding from there. Returns zero on success.
+ */
+static int build_index(FLI_PLAYER *fli)
+{
+   FLI_DECODER *d = fli->extra;
+   PALETTE pal;
+   unsigned char *p;
+   int frame, frame_size;
+   long pos;
+
+   for (frame=0; frame<d->header.frame_count; frame++) {
+      pos = d->pos;
+
+      if (_fli_read_frame(fli, &d->frame_header) != 0)
 	 break;
+
+      frame_size = d->frame_header.size - sizeof_FLI_FRAME;
+
+      if ((d->frame_header.type != FLI_FRAME_MAGIC) || (frame_size == 0)) {
+	 if (fli_skip(fli, frame_size) != 0)
+	    break;
+	 continue;
       }
 
-      p += sizeof_FLI_CHUNK;
-      sz = chunk.size - sizeof_FLI_CHUNK;
-      frame_size -= chunk.size;
+      p = fli_read(fli, NULL, frame_size);
+      if (!p)
+	 break;
 
-      if (c == frame_header.chunks-1)
-	 sz += frame_size;
+      memcpy(pal, fli->palette, sizeof(PALETTE));
 
-      switch (chunk.type) {
+      if (decode_chunks(fli, p, frame_size, d->frame_header.chunks, FALSE)) {
+	 if (!add_keyframe(fli, frame, pos, pal))
+	    return -1;
+      }
+   }
 
-	 case 4: 
-	    do_fli_256_color(p, sz);
-	    break;
+   /* the player starts with a clean slate */
+   memset(fli->palette, 0, sizeof(PALETTE));
+   reset_fli_player_variables(fli);
+   d->status = FLI_OK;
 
-	 case 7:
-	    do_fli_delta(p, sz);
-	    break;
+   return fli_seek(fli, sizeof_FLI_HEADER);
+}
 
-	 case 11: 
-	    do_fli_color(p, sz);
-	    break;
 
-	 case 12:
-	    do_fli_lc(p, sz);
-	    break;
 
-	 case 13:
-	    do_fli_black();
-	    break;
+/* create_fli_player:
+ *  Helper for the open_*fli_player() functions, which allocates an empty
+ *  player.
+ */
+static FLI_PLAYER *create_fli_player(void)
+{
+   FLI_PLAYER *fli;
 
-	 case 15:
-	    do_fli_brun(p, sz);
-	    break;
+   fli = _AL_MALLOC(sizeof(FLI_PLAYER));
+   if (!fli)
+      return NULL;
 
-	 case 16:
-	    do_fli_copy(p, sz);
-	    break;
+   memset(fli, 0, sizeof(FLI_PLAYER));
 
-	 default:
-	    /* should we return an error? nah... */
+   fli->extra = _AL_MALLOC(sizeof(FLI_DECODER));
+   if (!fli->extra) {
+      _AL_FREE(fli);
+      return NULL;
+   }
+
+   memset(fli->extra, 0, sizeof(FLI_DECODER));
+   ((FLI_DECODER *)fli->extra)->status = FLI_NOT_OPEN;
+
+   reset_fli_player_variables(fli);
+
+   return fli;
+}
+
+
+
+/* do_open_fli_player:
+ *  Worker function used by the open_*fli_player() functions, once the
+ *  source of the data is set up.
+ */
+static FLI_PLAYER *do_open_fli_player(FLI_PLAYER *fli, int flags)
+{
+   FLI_DECODER *d = fli->extra;
+   int y;
+
+   /* read the header */
+   if (_fli_read_header(fli, &d->header) != 0) {
+      close_fli_player(fli);
+      return NULL;
+   }
+
+   /* check magic numbers */
+   if (((d->header.bits_a_pixel != 8) && (d->header.bits_a_pixel != 0)) ||
+       ((d->header.type != FLI_MAGIC1) && (d->header.type != FLI_MAGIC2))) {
+      close_fli_player(fli);
+      return NULL;
+   }
+
+   if (d->header.width == 0)
+      d->header.width = 320;
+
+   if (d->header.height == 0)
+      d->header.height = 200;
+
+   /* create the frame bitmap */
+   fli->bitmap = create_bitmap_ex(8, d->header.width, d->header.height);
+   d->dirty_l = _AL_MALLOC(sizeof(int) * d->header.height);
+   d->dirty_r = _AL_MALLOC(sizeof(int) * d->header.height);
+   if ((!fli->bitmap) || (!d->dirty_l) || (!d->dirty_r)) {
+      close_fli_player(fli);
+      return NULL;
+   }
+
+   for (y=0; y<d->header.height; y++) {
+      d->dirty_l[y] = INT_MAX;
+      d->dirty_r[y] = INT_MIN;
+   }
+
+   fli->frame = 0;
+   fli->frame_count = d->header.frame_count;
+
+   if (d->header.type == FLI_MAGIC1)
+      fli->speed = (long)d->header.speed * 1000 / 70;
+   else
+      fli->speed = d->header.speed;
+
+   if (fli->speed == 0)
+      fli->speed = 1000 / 70;
+
+   d->status = FLI_OK;
+
+   /* a packfile we have been given can't be rewound after the scan */
+   if ((flags & FLI_INDEX) && ((d->mem_data) || (d->filename))) {
+      if (build_index(fli) != 0) {
+	 close_fli_player(fli);
+	 return NULL;
+      }
+   }
+
+   return fli;
+}
+
+
+
+/* open_fli_player:
+ *  Opens an FLI file for playing with its own player, independent of
+ *  open_fli() and of any other players. If flags contains FLI_INDEX,
+ *  the whole file is scanned first to make seeking faster. Returns NULL
+ *  on error.
+ */
+FLI_PLAYER *open_fli_player(AL_CONST char *filename, int flags)
+{
+   FLI_PLAYER *fli;
+   FLI_DECODER *d;
+   ASSERT(filename);
+
+   fli = create_fli_player();
+   if (!fli)
+      return NULL;
+
+   d = fli->extra;
+
+   d->filename = _al_ustrdup(filename);
+   if (!d->filename) {
+      close_fli_player(fli);
+      return NULL;
+   }
+
+   d->file = pack_fopen(d->filename, F_READ);
+   if (!d->file) {
+      close_fli_player(fli);
+      return NULL;
+   }
+
+   return do_open_fli_player(fli, flags);
+}
+
+
+
+/* open_fli_player_pf:
+ *  Like open_fli_player(), but reads the FLI from the given packfile.
+ *  The packfile can't be rewound, so looping, seeking backwards and the
+ *  index are not supported.
+ */
+FLI_PLAYER *open_fli_player_pf(PACKFILE *fp)
+{
+   FLI_PLAYER *fli;
+   ASSERT(fp);
+
+   fli = create_fli_player();
+   if (!fli)
+      return NULL;
+
+   ((FLI_DECODER *)fli->extra)->file = fp;
+
+   return do_open_fli_player(fli, 0);
+}
+
+
+
+/* open_memory_fli_player:
+ *  Like open_fli_player(), but for files which have already been loaded
+ *  into memory. Pass a pointer to the memory containing the FLI data.
+ */
+FLI_PLAYER *open_memory_fli_player(void *fli_data, int flags)
+{
+   FLI_PLAYER *fli;
+   ASSERT(fli_data);
+
+   fli = create_fli_player();
+   if (!fli)
+      return NULL;
+
+   ((FLI_DECODER *)fli->extra)->mem_data = fli_data;
+
+   return do_open_fli_player(fli, flags);
+}
+
+
+
+/* close_fli_player:
+ *  Closes an FLI player and frees everything that belongs to it.
+ */
+void close_fli_player(FLI_PLAYER *fli)
+{
+   FLI_DECODER *d;
+
+   if (!fli)
+      return;
+
+   d = fli->extra;
+
+   if (d->file) {
+      /* if filename is NULL this means that the packfile was
+       * provided by external program.
+       */
+      if (d->filename)
+         pack_fclose(d->file);
+   }
+
+   if (d->filename)
+      _AL_FREE(d->filename);
+
+   if (d->keyframe)
+      _AL_FREE(d->keyframe);
+
+   if (d->palette)
+      _AL_FREE(d->palette);
+
+   if (d->dirty_l)
+      _AL_FREE(d->dirty_l);
+
+   if (d->dirty_r)
+      _AL_FREE(d->dirty_r);
+
+   if (fli->bitmap)
+      destroy_bitmap(fli->bitmap);
+
+   _AL_FREE(d);
+   _AL_FREE(fli);
+}
+
+
+
+/* next_fli_player_frame:
+ *  Advances to the next frame of the FLI, leaving the changes in the
+ *  bitmap and palette of the player. If loop is non-zero, it will cycle
+ *  if it reaches the end of the animation. Returns one of the FLI status
+ *  constants.
+ */
+int next_fli_player_frame(FLI_PLAYER *fli, int loop)
+{
+   FLI_DECODER *d;
+   ASSERT(fli);
+
+   d = fli->extra;
+
+   /* looping is not supported if fli is read from custom packfile,
+    * because it cannot be rewinded.
+    */
+   if (d->file && d->filename == NULL)
+      loop = 0;
+
+   if (d->status != FLI_OK)
+      return d->status;
+
+   /* end of file? should we loop? */
+   if (fli->frame >= d->header.frame_count) {
+      if (loop) {
+	 if (fli_seek(fli, sizeof_FLI_HEADER) != 0)
+	    return FLI_ERROR;
+	 fli->frame = 0;
+      }
+      else {
+	 d->status = FLI_EOF;
+	 return d->status;
+      }
+   }
+
+   /* read the next frame */
+   read_frame(fli);
+
+   return d->status;
+}
+
+
+
+/* seek_fli_player:
+ *  Decodes the specified frame into the bitmap and palette of the player,
+ *  so that the next call to next_fli_player_frame() reads the one after
+ *  it. If the player was opened with FLI_INDEX, decoding starts from the
+ *  closest frame which redraws the whole image, otherwise from where the
+ *  player is now or, if it has already gone past that frame, from the
+ *  start of the file. Returns one of the FLI status constants.
+ */
+int seek_fli_player(FLI_PLAYER *fli, int frame)
+{
+   FLI_DECODER *d;
+   FLI_KEYFRAME *key = NULL;
+   int lo, hi, mid;
+   ASSERT(fli);
+
+   d = fli->extra;
+
+   if ((frame < 0) || (frame >= d->header.frame_count))
+      return FLI_ERROR;
+
+   if (d->status == FLI_EOF)
+      d->status = FLI_OK;
+
+   if (d->status != FLI_OK)
+      return d->status;
+
+   /* find the last keyframe at or before the frame */
+   lo = 0;
+   hi = d->keyframes;
+
+   while (lo < hi) {
+      mid = (lo + hi) / 2;
+      if (d->keyframe[mid].frame <= frame)
+	 lo = mid + 1;
+      else
+	 hi = mid;
+   }
+
+   if (lo > 0)
+      key = &d->keyframe[lo-1];
+
+   if ((key) && ((key->frame >= fli->frame) || (fli->frame > frame + 1))) {
+      /* the keyframe is closer than where we are */
+      if (fli_seek(fli, key->pos) != 0)
+	 return FLI_ERROR;
+
+      fli->frame = key->frame;
+      memcpy(fli->palette, d->palette[key->palette], sizeof(PALETTE));
+   }
+   else if (fli->frame > frame + 1) {
+      /* start all over again */
+      if (fli_seek(fli, sizeof_FLI_HEADER) != 0)
+	 return FLI_ERROR;
+
+      fli->frame = 0;
+      memset(fli->palette, 0, sizeof(PALETTE));
+   }
+   else {
+      /* just read on */
+      while ((fli->frame <= frame) && (d->status == FLI_OK))
+	 read_frame(fli);
+
+      return d->status;
+   }
+
+   mark_all_dirty(fli);
+   fli->pal_dirty_from = 0;
+   fli->pal_dirty_to = PAL_SIZE-1;
+
+   while ((fli->frame <= frame) && (d->status == FLI_OK))
+      read_frame(fli);
+
+   return d->status;
+}
+
+
+
+/* reset_fli_player_variables:
+ *  Clears the information about which parts of the bitmap and palette of
+ *  the player are dirty, after the screen hardware has been updated.
+ */
+void reset_fli_player_variables(FLI_PLAYER *fli)
+{
+   FLI_DECODER *d;
+   int y;
+   ASSERT(fli);
+
+   d = fli->extra;
+
+   if (d->dirty_l) {
+      for (y=MAX(fli->bmp_dirty_from, 0); y<=MIN(fli->bmp_dirty_to, fli->bitmap->h-1); y++) {
+	 d->dirty_l[y] = INT_MAX;
+	 d->dirty_r[y] = INT_MIN;
+      }
+   }
+
+   fli->bmp_dirty_from = INT_MAX;
+   fli->bmp_dirty_to = INT_MIN;
+   fli->pal_dirty_from = INT_MAX;
+   fli->pal_dirty_to = INT_MIN;
+}
+
+
+
+/* blit_fli_player_dirty:
+ *  Copies the parts of the frame bitmap which have changed since the last
+ *  call to reset_fli_player_variables() onto dest, placing the top left
+ *  corner of the frame at (dest_x, dest_y). Lines with the same changed
+ *  span are copied together.
+ */
+void blit_fli_player_dirty(FLI_PLAYER *fli, BITMAP *dest, int dest_x, int dest_y)
+{
+   FLI_DECODER *d;
+   int y, top;
+   ASSERT(fli);
+   ASSERT(dest);
+
+   d = fli->extra;
+
+   for (y=fli->bmp_dirty_from; y<=fli->bmp_dirty_to; y++) {
+      if (d->dirty_l[y] > d->dirty_r[y])
+	 continue;
+
+      top = y;
+      while ((y < fli->bmp_dirty_to) &&
+	     (d->dirty_l[y+1] == d->dirty_l[top]) && (d->dirty_r[y+1] == d->dirty_r[top]))
+	 y++;
+
+      blit(fli->bitmap, dest, d->dirty_l[top], top, dest_x + d->dirty_l[top], dest_y + top,
+	   d->dirty_r[top] - d->dirty_l[top] + 1, y - top + 1);
+   }
+}
+
+
+
+/* play_fli_player:
+ *  Like play_fli(), but plays an FLI which is already open in a player,
+ *  and only copies the parts of each frame which have changed onto the
+ *  bitmap. Anything else drawn there is left alone. The player is not
+ *  closed afterwards.
+ */
+int play_fli_player(FLI_PLAYER *fli, BITMAP *bmp, int loop, int (*callback)(void))
+{
+   int ret;
+   ASSERT(fli);
+   ASSERT(bmp);
+
+   LOCK_VARIABLE(fli_player_timer);
+   LOCK_FUNCTION(fli_player_timer_callback);
+
+   fli_player_timer = 1;
+   install_int(fli_player_timer_callback, fli->speed);
+
+   ret = next_fli_player_frame(fli, loop);
+
+   while (ret == FLI_OK) {
+      /* update the palette */
+      if (fli->pal_dirty_from <= fli->pal_dirty_to)
+	 set_palette_range(fli->palette, fli->pal_dirty_from, fli->pal_dirty_to, TRUE);
+
+      /* update the screen */
+      if (fli->bmp_dirty_from <= fli->bmp_dirty_to) {
+	 vsync();
+	 blit_fli_player_dirty(fli, bmp, 0, 0);
+      }
+
+      reset_fli_player_variables(fli);
+
+      if (callback) {
+	 ret = (*callback)();
+	 if (ret != FLI_OK)
 	    break;
       }
 
-      p += sz;
+      ret = next_fli_player_frame(fli, loop);
+      fli_player_timer--;
 
-      /* alignment */
-      if (sz & 1) {
-	 p++;
-	 frame_size--;
+      while (fli_player_timer <= 0) {
+	 /* wait a bit */
+	 rest(0);
       }
    }
 
-   /* move on to the next frame */
-   fli_frame++;
+   remove_int(fli_player_timer_callback);
+
+   return (ret == FLI_EOF) ? FLI_OK : ret;
 }
 
 
@@ -944,58 +1590,41 @@ int play_memory_fli(void *fli_data, BITMAP *bmp, int loop, int (*callback)(void)
 
 
 /* do_open_fli:
- *  Worker function used by open_fli() and open_memory_fli().
+ *  Worker function used by open_fli() and open_memory_fli(), which makes
+ *  the given player the one behind the global variables.
  */
-static int do_open_fli(void)
+static int do_open_fli(FLI_PLAYER *fli)
 {
+   FLI_DECODER *d;
    long speed;
 
-   /* read the header */
-   if (_fli_read_header(&fli_header) != 0) {
-      close_fli();
+   if (!fli)
       return FLI_ERROR;
-   }
 
-   /* check magic numbers */
-   if (((fli_header.bits_a_pixel != 8) && (fli_header.bits_a_pixel != 0)) ||
-       ((fli_header.type != FLI_MAGIC1) && (fli_header.type != FLI_MAGIC2))) {
-      close_fli();
-      return FLI_ERROR;
-   }
+   d = fli->extra;
 
-   if (fli_header.width == 0)
-      fli_header.width = 320;
-
-   if (fli_header.height == 0)
-      fli_header.height = 200;
-
-   /* create the frame bitmap */
-   fli_bitmap = create_bitmap_ex(8, fli_header.width, fli_header.height);
-   if (!fli_bitmap) {
-      close_fli();
-      return FLI_ERROR;
-   }
+   fli_player = fli;
+   fli_bitmap = fli->bitmap;
 
    reset_fli_variables();
    fli_frame = 0;
    fli_timer = 2;
-   fli_status = FLI_OK;
 
    /* install the timer handler */
    LOCK_VARIABLE(fli_timer);
    LOCK_FUNCTION(fli_timer_callback);
 
-   if (fli_header.type == FLI_MAGIC1)
-      speed = BPS_TO_TIMER(70) * (long)fli_header.speed;
+   if (d->header.type == FLI_MAGIC1)
+      speed = BPS_TO_TIMER(70) * (long)d->header.speed;
    else
-      speed = MSEC_TO_TIMER((long)fli_header.speed);
+      speed = MSEC_TO_TIMER((long)d->header.speed);
 
    if (speed == 0)
       speed = BPS_TO_TIMER(70);
 
    install_int_ex(fli_timer_callback, speed);
 
-   return fli_status;
+   return d->status;
 }
 
 
@@ -1006,24 +1635,11 @@ static int do_open_fli(void)
 int open_fli(AL_CONST char *filename)
 {
    ASSERT(filename);
-   
-   if (fli_status != FLI_NOT_OPEN)
-      return FLI_ERROR;
 
-   if (fli_filename) {
-      _AL_FREE(fli_filename);
-      fli_filename = NULL;
-   }
-
-   fli_filename = _al_ustrdup(filename);
-   if (!fli_filename)
+   if (fli_player)
       return FLI_ERROR;
 
-   fli_file = pack_fopen(fli_filename, F_READ);
-   if (!fli_file)
-      return FLI_ERROR;
-
-   return do_open_fli();
+   return do_open_fli(open_fli_player(filename, 0));
 }
 
 
@@ -1034,39 +1650,27 @@ int open_fli(AL_CONST char *filename)
 int open_fli_pf(PACKFILE *fp)
 {
    ASSERT(fp);
-   
-   if (fli_status != FLI_NOT_OPEN)
-      return FLI_ERROR;
 
-   if (fli_filename) {
-      _AL_FREE(fli_filename);
-      fli_filename = NULL;
-   }
-
-   fli_file = fp;
-   if (!fli_file)
+   if (fli_player)
       return FLI_ERROR;
 
-   return do_open_fli();
+   return do_open_fli(open_fli_player_pf(fp));
 }
 
 
 
 /* open_memory_fli:
- *  Like open_fli(), but for files which have already been loaded into 
+ *  Like open_fli(), but for files which have already been loaded into
  *  memory. Pass a pointer to the memory containing the FLI data.
  */
 int open_memory_fli(void *fli_data)
 {
    ASSERT(fli_data);
-   
-   if (fli_status != FLI_NOT_OPEN)
-      return FLI_ERROR;
 
-   fli_mem_data = fli_data;
-   fli_mem_pos = 0;
+   if (fli_player)
+      return FLI_ERROR;
 
-   return do_open_fli();
+   return do_open_fli(open_memory_fli_player(fli_data, 0));
 }
 
 
@@ -1078,70 +1682,54 @@ void close_fli(void)
 {
    remove_int(fli_timer_callback);
 
-   if (fli_file) {
-      /* if fli_filename is NULL this means that the packfile was 
-       * provided by external program.
-       */
-      if (fli_filename)
-         pack_fclose(fli_file);
-      fli_file = NULL;
-   }
-
-   if (fli_filename) {
-      _AL_FREE(fli_filename);
-      fli_filename = NULL;
-   }
-
-   if (fli_bitmap) {
-      destroy_bitmap(fli_bitmap);
-      fli_bitmap = NULL;
-   }
-
-   fli_mem_data = NULL;
-   fli_mem_pos = 0;
+   close_fli_player(fli_player);
+   fli_player = NULL;
+   fli_bitmap = NULL;
 
    reset_fli_variables();
-
-   fli_status = FLI_NOT_OPEN;
 }
 
 
 
 /* next_fli_frame:
- *  Advances to the next frame of the FLI, leaving the changes in the 
- *  fli_bitmap and fli_palette. If loop is non-zero, it will cycle if 
- *  it reaches the end of the animation. Returns one of the FLI status 
+ *  Advances to the next frame of the FLI, leaving the changes in the
+ *  fli_bitmap and fli_palette. If loop is non-zero, it will cycle if
+ *  it reaches the end of the animation. Returns one of the FLI status
  *  constants.
  */
 int next_fli_frame(int loop)
 {
-   /* looping is not supported if fli is read from custom packfile, 
-    * because it cannot be rewinded.
-    */
-   if (fli_file && fli_filename == NULL)
-      loop = 0;
+   FLI_DECODER *d;
+   int ret;
 
-   if (fli_status != FLI_OK)
-      return fli_status;
+   if (!fli_player)
+      return FLI_NOT_OPEN;
+
+   d = fli_player->extra;
+   if (d->status != FLI_OK)
+      return d->status;
 
    fli_timer--;
 
-   /* end of file? should we loop? */
-   if (fli_frame >= fli_header.frame_count) {
-      if (loop) {
-	 fli_rewind(sizeof_FLI_HEADER);
-	 fli_frame = 0;
-      }
-      else {
-	 fli_status = FLI_EOF;
-	 return fli_status;
-      }
+   reset_fli_player_variables(fli_player);
+   ret = next_fli_player_frame(fli_player, loop);
+
+   /* add the changes to what the global variables have collected so far */
+   fli_bmp_dirty_from = MIN(fli_bmp_dirty_from, fli_player->bmp_dirty_from);
+   fli_bmp_dirty_to = MAX(fli_bmp_dirty_to, fli_player->bmp_dirty_to);
+
+   if (fli_player->pal_dirty_from <= fli_player->pal_dirty_to) {
+      memcpy(fli_palette + fli_player->pal_dirty_from,
+	     fli_player->palette + fli_player->pal_dirty_from,
+	     sizeof(RGB) * (fli_player->pal_dirty_to - fli_player->pal_dirty_from + 1));
+
+      fli_pal_dirty_from = MIN(fli_pal_dirty_from, fli_player->pal_dirty_from);
+      fli_pal_dirty_to = MAX(fli_pal_dirty_to, fli_player->pal_dirty_to);
    }
 
-   /* read the next frame */
-   read_frame();
+   fli_frame = fli_player->frame;
 
-   return fli_status;
+   return ret;
 }
 
 
@@ -1157,4 +1745,3 @@ void reset_fli_variables(void)
    fli_pal_dirty_from = INT_MAX;
    fli_pal_dirty_to = INT_MIN;
 }
-
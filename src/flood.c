@@ -203,28 +203,15 @@ static int check_flood_line(BITMAP *bmp, int y, int left, int right, int src_col
 
 
 
-/* floodfill:
- *  Fills an enclosed area (starting at point x, y) with the specified color.
+/* segment_floodfill:
+ *  Fills an enclosed area by keeping a list of every segment drawn so far,
+ *  which is how we avoid going round in circles when the drawing mode
+ *  doesn't replace the source color with something else.
  */
-void _soft_floodfill(BITMAP *bmp, int x, int y, int color)
+static void segment_floodfill(BITMAP *bmp, int x, int y, int src_color, int color)
 {
-   int src_color;
    int c, done;
    FLOODED_LINE *p;
-   ASSERT(bmp);
-
-   /* make sure we have a valid starting point */ 
-   if ((x < bmp->cl) || (x >= bmp->cr) || (y < bmp->ct) || (y >= bmp->cb))
-      return;
-
-   acquire_bitmap(bmp);
-
-   /* what color to replace? */
-   src_color = getpixel(bmp, x, y);
-   if (src_color == color) {
-      release_bitmap(bmp);
-      return;
-   }
 
    /* set up the list of flooded segments */
    _grow_scratch_mem(sizeof(FLOODED_LINE) * bmp->cb);
@@ -272,7 +259,233 @@ void _soft_floodfill(BITMAP *bmp, int x, int y, int color)
       }
 
    } while (!done);
+}
 
-   release_bitmap(bmp);
+
+
+
+/* flood_scan:
+ *  Steps along line y from x towards end (inclusive) for as long as the
+ *  pixels are (match != 0) or aren't (match == 0) src_color. Returns the
+ *  first x where that stops being true, or end+dir if it never does.
+ */
+static int flood_scan(BITMAP *bmp, int y, int x, int end, int dir, int match, int src_color)
+{
+   uintptr_t addr;
+
+   /* helper for doing the scan in each color depth */
+   #define FLOOD_SCAN(bits, size)                                            \
+   {                                                                         \
+      if (match) {                                                           \
+	 while ((x != end + dir) &&                                          \
+		((int)bmp_read##bits(addr+x*size) == src_color))             \
+	    x += dir;                                                        \
+      }                                                                      \
+      else {                                                                 \
+	 while ((x != end + dir) &&                                          \
+		((int)bmp_read##bits(addr+x*size) != src_color))             \
+	    x += dir;                                                        \
+      }                                                                      \
+   }
+
+   if (is_linear_bitmap(bmp)) {     /* use direct access for linear bitmaps */
+      addr = bmp_read_line(bmp, y);
+      bmp_select(bmp);
+
+      switch (bitmap_color_depth(bmp)) {
+
+	 #ifdef ALLEGRO_COLOR8
+	    case 8:
+	       FLOOD_SCAN(8, 1);
+	       break;
+	 #endif
+
+	 #ifdef ALLEGRO_COLOR16
+	    case 15:
+	    case 16:
+	       FLOOD_SCAN(16, sizeof(short));
+	       break;
+	 #endif
+
+	 #ifdef ALLEGRO_COLOR24
+	    case 24:
+	       FLOOD_SCAN(24, 3);
+	       break;
+	 #endif
+
+	 #ifdef ALLEGRO_COLOR32
+	    case 32:
+	       FLOOD_SCAN(32, sizeof(int32_t));
+	       break;
+	 #endif
+      }
+
+      bmp_unwrite_line(bmp);
+   }
+   else {                           /* have to use getpixel() for mode-X */
+      while ((x != end + dir) && ((getpixel(bmp, x, y) == src_color) == (match != 0)))
+	 x += dir;
+   }
+
+   #undef FLOOD_SCAN
+
+   return x;
 }
 
+
+
+typedef struct FLOOD_SPAN        /* a filled span whose neighbours are due */
+{
+   int y;                        /* line of the filled span */
+   int x1, x2;                   /* left and right ends */
+   int dy;                       /* which neighbouring line to look at */
+} FLOOD_SPAN;
+
+
+/* Pending spans live in a fixed pool, which is enough for all but the most
+ * convoluted shapes. Beyond that the scratch memory takes over, and since
+ * only the frontier of the fill is stored, it stays small even on huge
+ * bitmaps.
+ */
+#define FLOOD_POOL_SIZE          1024
+
+static FLOOD_SPAN flood_pool[FLOOD_POOL_SIZE];
+
+static FLOOD_SPAN *flood_stack;  /* flood_pool or _scratch_mem */
+static int flood_stack_size;     /* capacity of flood_stack */
+static int flood_sp;             /* number of pending spans */
+
+
+
+/* push_span:
+ *  Adds a filled span to the stack, if the line next to it is on the
+ *  bitmap.
+ */
+static void push_span(BITMAP *bmp, int y, int x1, int x2, int dy)
+{
+   FLOOD_SPAN *s;
+
+   if ((y+dy < bmp->ct) || (y+dy >= bmp->cb))
+      return;
+
+   if (flood_sp >= flood_stack_size) {
+      flood_stack_size *= 2;
+      _grow_scratch_mem(sizeof(FLOOD_SPAN) * flood_stack_size);
+
+      if (flood_stack == flood_pool)
+	 memcpy(_scratch_mem, flood_pool, sizeof(flood_pool));
+
+      flood_stack = _scratch_mem;
+   }
+
+   s = flood_stack + flood_sp++;
+   s->y = y;
+   s->x1 = x1;
+   s->x2 = x2;
+   s->dy = dy;
+}
+
+
+
+/* span_floodfill:
+ *  Fills an enclosed area with a stack of spans (Heckbert's seed fill).
+ *  Each span is filled with a single hfill() as soon as it is found, and
+ *  the pixels that change color are what stop it being found again, so
+ *  this only works if the drawing mode replaces src_color with something
+ *  else.
+ */
+static void span_floodfill(BITMAP *bmp, int x, int y, int src_color, int color)
+{
+   FLOOD_SPAN *s;
+   int x1, x2, dy, l, r;
+
+   flood_stack = flood_pool;
+   flood_stack_size = FLOOD_POOL_SIZE;
+   flood_sp = 0;
+
+   /* fill the seed span and look both ways from it */
+   l = flood_scan(bmp, y, x, bmp->cl, -1, TRUE, src_color) + 1;
+   r = flood_scan(bmp, y, x, bmp->cr-1, 1, TRUE, src_color) - 1;
+   bmp->vtable->hfill(bmp, l, y, r, color);
+
+   push_span(bmp, y, l, r, 1);
+   push_span(bmp, y, l, r, -1);
+
+   while (flood_sp > 0) {
+      s = flood_stack + --flood_sp;
+      y = s->y + s->dy;
+      x1 = s->x1;
+      x2 = s->x2;
+      dy = s->dy;
+
+      /* find the first span on this line which touches the parent */
+      x = flood_scan(bmp, y, x1, x2, 1, FALSE, src_color);
+
+      if (x == x1)
+	 l = flood_scan(bmp, y, x1, bmp->cl, -1, TRUE, src_color) + 1;
+      else
+	 l = x;
+
+      while (x <= x2) {
+	 r = flood_scan(bmp, y, x, bmp->cr-1, 1, TRUE, src_color) - 1;
+	 bmp->vtable->hfill(bmp, l, y, r, color);
+
+	 /* carry on in the same direction */
+	 push_span(bmp, y, l, r, dy);
+
+	 /* and turn back round if we went past the ends of the parent */
+	 if (l < x1)
+	    push_span(bmp, y, l, x1-1, -dy);
+
+	 if (r > x2)
+	    push_span(bmp, y, x2+1, r, -dy);
+
+	 /* look for the next span along the parent */
+	 x = r + 2;
+	 if (x <= x2)
+	    x = flood_scan(bmp, y, x, x2, 1, FALSE, src_color);
+
+	 l = x;
+      }
+   }
+}
+
+
+
+/* floodfill:
+ *  Fills an enclosed area (starting at point x, y) with the specified color.
+ */
+void _soft_floodfill(BITMAP *bmp, int x, int y, int color)
+{
+   int src_color, written_color;
+   ASSERT(bmp);
+
+   /* make sure we have a valid starting point */ 
+   if ((x < bmp->cl) || (x >= bmp->cr) || (y < bmp->ct) || (y >= bmp->cb))
+      return;
+
+   acquire_bitmap(bmp);
+
+   /* what color to replace? */
+   src_color = getpixel(bmp, x, y);
+   if (src_color == color) {
+      release_bitmap(bmp);
+      return;
+   }
+
+   /* what will actually end up in the bitmap */
+   switch (bitmap_color_depth(bmp)) {
+      case 8:  written_color = color & 0xFF;     break;
+      case 15:
+      case 16: written_color = color & 0xFFFF;   break;
+      case 24: written_color = color & 0xFFFFFF; break;
+      default: written_color = color;            break;
+   }
+
+   if (_drawing_mode != DRAW_MODE_SOLID)
+      segment_floodfill(bmp, x, y, src_color, color);
+   else if (written_color != src_color)
+      span_floodfill(bmp, x, y, src_color, color);
+
+   release_bitmap(bmp);
+}
@@ -8,7 +8,8 @@
  *                                           /\____/
  *                                           \_/__/
  *
- *      The default 8x8 font, and mono and color font vtables.
+ *      The default 8x8 font, and mono and color font vtables, along with
+ *      the glyph caches they use to speed up text output.
  *
  *      Contains characters:
  *
@@ -440,6 +441,580 @@ int allegro_404_char = '^';
 
 
 
+/* Glyph caches. The first time a font is used its range list is turned
+ * into a paged lookup table, so finding a glyph no longer walks the ranges.
+ * Strings drawn onto memory bitmaps also keep the glyphs pre-rendered in
+ * the colors they were last drawn in, as RLE sprites (or plain bitmaps
+ * when the background is opaque), so text output becomes a series of
+ * sprite draws instead of pixel by pixel glyph plotting.
+ */
+#define GLYPH_PAGE_SHIFT   8
+#define GLYPH_PAGE_SIZE    (1 << GLYPH_PAGE_SHIFT)
+#define GLYPH_PAGE_MASK    (GLYPH_PAGE_SIZE - 1)
+
+#define MAX_GLYPH_COLORS   8
+
+
+typedef struct GLYPH_IMAGE
+{
+   int state;                       /* 0 = not rendered, -1 = can't cache */
+   RLE_SPRITE *rle;                 /* masked image */
+   BITMAP *bmp;                     /* opaque image */
+} GLYPH_IMAGE;
+
+
+typedef struct GLYPH_COLOR
+{
+   int depth, fg, bg;               /* what the images were rendered for */
+   int mask;                        /* mask color at that depth */
+   GLYPH_IMAGE **page;              /* pages of glyph images, by index */
+   struct GLYPH_CACHE *cache;       /* the cache we belong to */
+   struct GLYPH_COLOR *next;        /* most recently used first */
+} GLYPH_COLOR;
+
+
+typedef struct GLYPH_CACHE
+{
+   AL_CONST FONT *font;             /* font this table was built for */
+   void *data;                      /* its glyph data at the time */
+   int color;                       /* color or mono glyphs? */
+   int count;                       /* number of glyphs */
+   void **glyph;                    /* glyphs, by index */
+   int pages;                       /* size of the page table */
+   int **page;                      /* codepoint -> glyph index, -1 if none */
+   GLYPH_COLOR *colors;             /* pre-rendered glyph images */
+   struct GLYPH_CACHE *next;        /* most recently used first */
+} GLYPH_CACHE;
+
+
+static GLYPH_CACHE *glyph_caches = NULL;
+
+
+
+/* destroy_glyph_color:
+ *  Frees a set of pre-rendered glyph images.
+ */
+static void destroy_glyph_color(GLYPH_COLOR *gcol)
+{
+   GLYPH_IMAGE *img;
+   int pages = (gcol->cache->count + GLYPH_PAGE_MASK) >> GLYPH_PAGE_SHIFT;
+   int i, j;
+
+   for (i=0; i<pages; i++) {
+      img = gcol->page[i];
+      if (!img)
+	 continue;
+
+      for (j=0; j<GLYPH_PAGE_SIZE; j++) {
+	 if (img[j].rle)
+	    destroy_rle_sprite(img[j].rle);
+	 if (img[j].bmp)
+	    destroy_bitmap(img[j].bmp);
+      }
+
+      _AL_FREE(img);
+   }
+
+   _AL_FREE(gcol->page);
+   _AL_FREE(gcol);
+}
+
+
+
+/* free_glyph_cache:
+ *  Frees a glyph cache and everything it holds.
+ */
+static void free_glyph_cache(GLYPH_CACHE *gc)
+{
+   GLYPH_COLOR *gcol;
+   int i;
+
+   while (gc->colors) {
+      gcol = gc->colors;
+      gc->colors = gcol->next;
+      destroy_glyph_color(gcol);
+   }
+
+   if (gc->page) {
+      for (i=0; i<gc->pages; i++) {
+	 if (gc->page[i])
+	    _AL_FREE(gc->page[i]);
+      }
+      _AL_FREE(gc->page);
+   }
+
+   if (gc->glyph)
+      _AL_FREE(gc->glyph);
+
+   _AL_FREE(gc);
+}
+
+
+
+/* glyph_cache_exit:
+ *  Frees all the glyph caches at shutdown time.
+ */
+static void glyph_cache_exit(void)
+{
+   GLYPH_CACHE *gc;
+
+   while (glyph_caches) {
+      gc = glyph_caches;
+      glyph_caches = gc->next;
+      free_glyph_cache(gc);
+   }
+
+   _remove_exit_func(glyph_cache_exit);
+}
+
+
+
+/* destroy_glyph_cache:
+ *  Throws away the cache of a font that is being destroyed or modified.
+ */
+static void destroy_glyph_cache(AL_CONST FONT *f)
+{
+   GLYPH_CACHE **prev = &glyph_caches;
+   GLYPH_CACHE *gc;
+
+   for (gc = glyph_caches; gc; gc = gc->next) {
+      if (gc->font == f) {
+	 *prev = gc->next;
+	 free_glyph_cache(gc);
+	 return;
+      }
+      prev = &gc->next;
+   }
+}
+
+
+
+/* build_glyph_cache:
+ *  Fills in the lookup table of a glyph cache from the font's ranges.
+ *  Earlier ranges take precedence over later ones, like in a linear search.
+ */
+static int build_glyph_cache(GLYPH_CACHE *gc)
+{
+   FONT_MONO_DATA *mf = NULL;
+   FONT_COLOR_DATA *cf = NULL;
+   int begin, end, max, c, i;
+   void **glyphs;
+   int *p;
+
+   if (gc->color)
+      cf = (FONT_COLOR_DATA *)gc->data;
+   else
+      mf = (FONT_MONO_DATA *)gc->data;
+
+   /* size the tables */
+   max = 0;
+   i = 0;
+
+   for (;;) {
+      if (cf) {
+	 begin = cf->begin;
+	 end = cf->end;
+	 cf = cf->next;
+      }
+      else if (mf) {
+	 begin = mf->begin;
+	 end = mf->end;
+	 mf = mf->next;
+      }
+      else
+	 break;
+
+      if (end > max)
+	 max = end;
+      if (end > begin)
+	 i += end - begin;
+   }
+
+   gc->pages = (max + GLYPH_PAGE_MASK) >> GLYPH_PAGE_SHIFT;
+
+   if (gc->pages > 0) {
+      gc->page = _AL_MALLOC(sizeof(int *) * gc->pages);
+      if (!gc->page)
+	 return FALSE;
+      memset(gc->page, 0, sizeof(int *) * gc->pages);
+   }
+
+   if (i > 0) {
+      gc->glyph = _AL_MALLOC(sizeof(void *) * i);
+      if (!gc->glyph)
+	 return FALSE;
+   }
+
+   /* and fill them */
+   if (gc->color)
+      cf = (FONT_COLOR_DATA *)gc->data;
+   else
+      mf = (FONT_MONO_DATA *)gc->data;
+
+   for (;;) {
+      if (cf) {
+	 begin = cf->begin;
+	 end = cf->end;
+	 glyphs = (void **)cf->bitmaps;
+	 cf = cf->next;
+      }
+      else if (mf) {
+	 begin = mf->begin;
+	 end = mf->end;
+	 glyphs = (void **)mf->glyphs;
+	 mf = mf->next;
+      }
+      else
+	 break;
+
+      for (c = MAX(begin, 0); c < end; c++) {
+	 p = gc->page[c >> GLYPH_PAGE_SHIFT];
+
+	 if (!p) {
+	    p = _AL_MALLOC(sizeof(int) * GLYPH_PAGE_SIZE);
+	    if (!p)
+	       return FALSE;
+
+	    for (i=0; i<GLYPH_PAGE_SIZE; i++)
+	       p[i] = -1;
+
+	    gc->page[c >> GLYPH_PAGE_SHIFT] = p;
+	 }
+
+	 if (p[c & GLYPH_PAGE_MASK] < 0) {
+	    p[c & GLYPH_PAGE_MASK] = gc->count;
+	    gc->glyph[gc->count++] = glyphs[c - begin];
+	 }
+      }
+   }
+
+   return TRUE;
+}
+
+
+
+/* get_glyph_cache:
+ *  Returns the glyph cache of a font, building it if need be, or NULL if
+ *  we are out of memory.
+ */
+static GLYPH_CACHE *get_glyph_cache(AL_CONST FONT *f, int color)
+{
+   GLYPH_CACHE **prev = &glyph_caches;
+   GLYPH_CACHE *gc;
+
+   for (gc = glyph_caches; gc; gc = gc->next) {
+      if (gc->font == f) {
+	 if ((gc->data == f->data) && (gc->color == color)) {
+	    if (gc != glyph_caches) {
+	       *prev = gc->next;
+	       gc->next = glyph_caches;
+	       glyph_caches = gc;
+	    }
+	    return gc;
+	 }
+
+	 /* the font has been changed behind our back */
+	 *prev = gc->next;
+	 free_glyph_cache(gc);
+	 break;
+      }
+      prev = &gc->next;
+   }
+
+   gc = _AL_MALLOC(sizeof(GLYPH_CACHE));
+   if (!gc)
+      return NULL;
+
+   memset(gc, 0, sizeof(GLYPH_CACHE));
+   gc->font = f;
+   gc->data = f->data;
+   gc->color = color;
+
+   if (!build_glyph_cache(gc)) {
+      free_glyph_cache(gc);
+      return NULL;
+   }
+
+   if (!glyph_caches)
+      _add_exit_func(glyph_cache_exit, "glyph_cache_exit");
+
+   gc->next = glyph_caches;
+   glyph_caches = gc;
+
+   return gc;
+}
+
+
+
+/* glyph_index:
+ *  Looks up the index of a glyph in a glyph cache, also trying the missing
+ *  glyph character. Returns -1 if neither of them exists.
+ */
+static int glyph_index(GLYPH_CACHE *gc, int ch)
+{
+   int *p;
+
+   if ((ch >= 0) && ((ch >> GLYPH_PAGE_SHIFT) < gc->pages)) {
+      p = gc->page[ch >> GLYPH_PAGE_SHIFT];
+      if ((p) && (p[ch & GLYPH_PAGE_MASK] >= 0))
+	 return p[ch & GLYPH_PAGE_MASK];
+   }
+
+   if (ch != allegro_404_char)
+      return glyph_index(gc, allegro_404_char);
+
+   return -1;
+}
+
+
+
+/* get_glyph_color:
+ *  Returns the set of pre-rendered glyph images matching the given colors
+ *  and bitmap depth, recycling the least recently used one when there are
+ *  too many of them. Returns NULL if the glyphs can't be cached.
+ */
+static GLYPH_COLOR *get_glyph_color(AL_CONST FONT *f, int color, BITMAP *bmp, int fg, int bg)
+{
+   GLYPH_CACHE *gc;
+   GLYPH_COLOR *gcol, **prev;
+   int depth = bitmap_color_depth(bmp);
+   int pages, n;
+
+   if (!is_memory_bitmap(bmp))
+      return NULL;
+
+   gc = get_glyph_cache(f, color);
+   if ((!gc) || (gc->count <= 0))
+      return NULL;
+
+   if (fg < 0)
+      fg = -1;
+
+   if (bg < 0)
+      bg = -1;
+
+   prev = &gc->colors;
+   n = 0;
+
+   for (gcol = gc->colors; gcol; gcol = gcol->next) {
+      if ((gcol->depth == depth) && (gcol->fg == fg) && (gcol->bg == bg)) {
+	 if (gcol != gc->colors) {
+	    *prev = gcol->next;
+	    gcol->next = gc->colors;
+	    gc->colors = gcol;
+	 }
+	 return gcol;
+      }
+
+      if ((++n >= MAX_GLYPH_COLORS) && (gcol->next)) {
+	 destroy_glyph_color(gcol->next);
+	 gcol->next = NULL;
+	 break;
+      }
+
+      prev = &gcol->next;
+   }
+
+   pages = (gc->count + GLYPH_PAGE_MASK) >> GLYPH_PAGE_SHIFT;
+
+   gcol = _AL_MALLOC(sizeof(GLYPH_COLOR));
+   if (!gcol)
+      return NULL;
+
+   gcol->page = _AL_MALLOC(sizeof(GLYPH_IMAGE *) * pages);
+   if (!gcol->page) {
+      _AL_FREE(gcol);
+      return NULL;
+   }
+
+   memset(gcol->page, 0, sizeof(GLYPH_IMAGE *) * pages);
+   gcol->depth = depth;
+   gcol->fg = fg;
+   gcol->bg = bg;
+   gcol->mask = bitmap_mask_color(bmp);
+   gcol->cache = gc;
+   gcol->next = gc->colors;
+   gc->colors = gcol;
+
+   return gcol;
+}
+
+
+
+/* render_glyph_image:
+ *  Pre-renders a glyph in the colors of a glyph image set, producing the
+ *  same pixels mono_render_char() or color_render_char() would. Leaves the
+ *  state at -1 for the cases that can't be cached: glyphs whose color is
+ *  the mask color, and 256 color glyphs that need the palette.
+ */
+static void render_glyph_image(GLYPH_COLOR *gcol, void *glyph, GLYPH_IMAGE *img)
+{
+   BITMAP *tmp = NULL;
+   BITMAP *g;
+   FONT_GLYPH *mg;
+   int mask = gcol->mask;
+   int w, h, conv;
+
+   img->state = -1;
+
+   if (!gcol->cache->color) {
+      /* monochrome glyph */
+      mg = (FONT_GLYPH *)glyph;
+
+      if ((gcol->fg < 0) || ((gcol->bg < 0) && (gcol->fg == mask)))
+	 return;
+
+      if ((mg->w <= 0) || (mg->h <= 0)) {
+	 img->state = 1;
+	 return;
+      }
+
+      tmp = create_bitmap_ex(gcol->depth, mg->w, mg->h);
+      if (!tmp)
+	 return;
+
+      clear_to_color(tmp, (gcol->bg < 0) ? mask : gcol->bg);
+      tmp->vtable->draw_glyph(tmp, mg, 0, 0, gcol->fg, gcol->bg);
+   }
+   else {
+      /* color glyph */
+      g = (BITMAP *)glyph;
+
+      if ((g->w <= 0) || (g->h <= 0)) {
+	 img->state = 1;
+	 return;
+      }
+
+      w = g->w;
+      h = g->h;
+
+      if (bitmap_color_depth(g) == 8) {
+	 if (gcol->fg >= 0) {
+	    if ((gcol->bg < 0) && (gcol->fg == mask))
+	       return;
+
+	    tmp = create_bitmap_ex(gcol->depth, w, h);
+	    if (!tmp)
+	       return;
+
+	    clear_to_color(tmp, (gcol->bg < 0) ? mask : gcol->bg);
+	    tmp->vtable->draw_character(tmp, g, 0, 0, gcol->fg, gcol->bg);
+	 }
+	 else {
+	    /* only a plain sprite if it needn't go through the palette */
+	    if (gcol->depth != 8)
+	       return;
+
+	    img->rle = get_rle_sprite(g);
+	    if (img->rle)
+	       img->state = 1;
+	    return;
+	 }
+      }
+      else if (bitmap_color_depth(g) == gcol->depth) {
+	 img->rle = get_rle_sprite(g);
+	 if (img->rle)
+	    img->state = 1;
+	 return;
+      }
+      else {
+	 if (gcol->depth == 8)
+	    return;
+
+	 tmp = create_bitmap_ex(gcol->depth, w, h);
+	 if (!tmp)
+	    return;
+
+	 conv = get_color_conversion();
+	 set_color_conversion(COLORCONV_MOST | COLORCONV_KEEP_TRANS);
+	 blit(g, tmp, 0, 0, 0, 0, w, h);
+	 set_color_conversion(conv);
+
+	 /* drawn with masked_blit(), whatever the background */
+	 img->rle = get_rle_sprite(tmp);
+	 destroy_bitmap(tmp);
+	 if (img->rle)
+	    img->state = 1;
+	 return;
+      }
+   }
+
+   if (gcol->bg >= 0) {
+      img->bmp = tmp;
+   }
+   else {
+      img->rle = get_rle_sprite(tmp);
+      destroy_bitmap(tmp);
+      if (!img->rle)
+	 return;
+   }
+
+   img->state = 1;
+}
+
+
+
+/* render_cached:
+ *  Draws a string using pre-rendered glyph images, falling back to the
+ *  render_char vtable entry for the glyphs that can't be cached.
+ */
+static void render_cached(AL_CONST FONT *f, GLYPH_COLOR *gcol, AL_CONST char *text, int fg, int bg, BITMAP *bmp, int x, int y, int h)
+{
+   GLYPH_CACHE *gc = gcol->cache;
+   AL_CONST char *p = text;
+   GLYPH_IMAGE *img;
+   BITMAP *g;
+   FONT_GLYPH *mg;
+   int ch, i, gw, gh;
+
+   while ((ch = ugetxc(&p))) {
+      i = glyph_index(gc, ch);
+      if ((i < 0) || (!gc->glyph[i]))
+	 continue;
+
+      img = gcol->page[i >> GLYPH_PAGE_SHIFT];
+      if (!img) {
+	 img = _AL_MALLOC(sizeof(GLYPH_IMAGE) * GLYPH_PAGE_SIZE);
+	 if (!img) {
+	    x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+	    continue;
+	 }
+	 memset(img, 0, sizeof(GLYPH_IMAGE) * GLYPH_PAGE_SIZE);
+	 gcol->page[i >> GLYPH_PAGE_SHIFT] = img;
+      }
+
+      img += i & GLYPH_PAGE_MASK;
+
+      if (!img->state)
+	 render_glyph_image(gcol, gc->glyph[i], img);
+
+      if (img->state < 0) {
+	 x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+	 continue;
+      }
+
+      if (gc->color) {
+	 g = (BITMAP *)gc->glyph[i];
+	 gw = g->w;
+	 gh = g->h;
+      }
+      else {
+	 mg = (FONT_GLYPH *)gc->glyph[i];
+	 gw = mg->w;
+	 gh = mg->h;
+      }
+
+      if (img->rle)
+	 draw_rle_sprite(bmp, img->rle, x, y + (h-gh)/2);
+      else if (img->bmp)
+	 blit(img->bmp, bmp, 0, 0, x, y + (h-gh)/2, gw, gh);
+
+      x += gw;
+   }
+}
+
+
+
 /* font_height:
  *  (mono and color vtable entry)
  *  Returns the height, in pixels of the font.
@@ -478,6 +1053,13 @@ static int length(AL_CONST FONT* f, AL_CONST char* text)
 FONT_GLYPH* _mono_find_glyph(AL_CONST FONT* f, int ch)
 {
     FONT_MONO_DATA* mf = (FONT_MONO_DATA*)(f->data);
+    GLYPH_CACHE* gc = get_glyph_cache(f, FALSE);
+    int i;
+
+    if(gc) {
+        i = glyph_index(gc, ch);
+        return (i >= 0) ? (FONT_GLYPH*)gc->glyph[i] : 0;
+    }
 
     while(mf) {
         if(ch >= mf->begin && ch < mf->end) return mf->glyphs[ch - mf->begin];
@@ -539,11 +1121,20 @@ static void mono_render(AL_CONST FONT* f, AL_CONST char* text, int fg, int bg, B
 {
     int ch = 0;
     AL_CONST char* p = text;
+    GLYPH_COLOR* gcol = 0;
 
     acquire_bitmap(bmp);
 
-    while( (ch = ugetxc(&p)) ) {
-        x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+    if(f->vtable->render_char == mono_render_char)
+        gcol = get_glyph_color(f, FALSE, bmp, fg, bg);
+
+    if(gcol) {
+        render_cached(f, gcol, text, fg, bg, bmp, x, y, f->height);
+    }
+    else {
+        while( (ch = ugetxc(&p)) ) {
+            x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+        }
     }
 
     release_bitmap(bmp);
@@ -561,6 +1152,8 @@ static void mono_destroy(FONT* f)
 
     if(!f) return;
 
+    destroy_glyph_cache(f);
+
     mf = (FONT_MONO_DATA*)(f->data);
     while(mf) {
         FONT_MONO_DATA* next = mf->next;
@@ -842,6 +1435,8 @@ static int mono_transpose_font(FONT* f, int drange)
    if (!f) 
       return -1;
 
+   destroy_glyph_cache(f);
+
    mf = (FONT_MONO_DATA*)(f->data);
 
    while(mf) {
@@ -863,6 +1458,13 @@ static int mono_transpose_font(FONT* f, int drange)
 BITMAP* _color_find_glyph(AL_CONST FONT* f, int ch)
 {
     FONT_COLOR_DATA* cf = (FONT_COLOR_DATA*)(f->data);
+    GLYPH_CACHE* gc = get_glyph_cache(f, TRUE);
+    int i;
+
+    if(gc) {
+        i = glyph_index(gc, ch);
+        return (i >= 0) ? (BITMAP*)gc->glyph[i] : 0;
+    }
 
     while(cf) {
         if(ch >= cf->begin && ch < cf->end) return cf->bitmaps[ch - cf->begin];
@@ -993,6 +1595,7 @@ static int trans_render_char(AL_CONST FONT* f, int ch, int fg, int bg, BITMAP* b
 static void color_render(AL_CONST FONT* f, AL_CONST char* text, int fg, int bg, BITMAP* bmp, int x, int y)
 {
     AL_CONST char* p = text;
+    GLYPH_COLOR* gcol = 0;
     int ch = 0;
 
     acquire_bitmap(bmp);
@@ -1002,8 +1605,16 @@ static void color_render(AL_CONST FONT* f, AL_CONST char* text, int fg, int bg,
 	bg = -1; /* to avoid filling rectangles for each character */
     }
 
-    while( (ch = ugetxc(&p)) ) {
-        x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+    if(f->vtable->render_char == color_render_char)
+        gcol = get_glyph_color(f, TRUE, bmp, fg, bg);
+
+    if(gcol) {
+        render_cached(f, gcol, text, fg, bg, bmp, x, y, f->vtable->font_height(f));
+    }
+    else {
+        while( (ch = ugetxc(&p)) ) {
+            x += f->vtable->render_char(f, ch, fg, bg, bmp, x, y);
+        }
     }
 
     release_bitmap(bmp);
@@ -1021,6 +1632,8 @@ static void color_destroy(FONT* f)
 
     if(!f) return;
 
+    destroy_glyph_cache(f);
+
     cf = (FONT_COLOR_DATA*)(f->data);
 
     while(cf) {
@@ -1370,6 +1983,8 @@ static int color_transpose_font(FONT* f, int drange)
    if (!f) 
       return -1;
 
+   destroy_glyph_cache(f);
+
    cf = (FONT_COLOR_DATA*)(f->data);
 
    while(cf) {
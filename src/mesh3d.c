@@ -0,0 +1,475 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Indexed triangle mesh pipeline: bulk transform, frustum and
+ *      backface culling, clipping of the straddling triangles only,
+ *      and meshes that share vertex and edge setup between triangles.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* frustum outcodes, matching the planes used by clip3d_f() */
+#define OUT_LEFT        1
+#define OUT_RIGHT       2
+#define OUT_TOP         4
+#define OUT_BOTTOM      8
+#define OUT_NEAR        16
+#define OUT_FAR         32
+
+
+/* a triangle straddling all six planes gains at most six vertices, but
+ * clip3d_f() asks for room for vc * (1.5 ^ 6) of them.
+ */
+#define MESH_CLIP_MAX   36
+
+
+typedef struct MESH_VERTEX       /* a vertex after the camera transform */
+{
+   V3D_f cam;                    /* camera space position */
+   V3D_f scr;                    /* projected position */
+   int out;                      /* frustum outcode */
+   int projected;                /* scr is valid for this call */
+} MESH_VERTEX;
+
+
+typedef struct MESH_CACHE         /* per-mesh work area */
+{
+   MESH_VERTEX *vtx;             /* transformed vertices */
+   POLYGON_EDGE *edge;           /* edge setup shared between triangles */
+   int *edge_ok;                 /* what _fill_3d_edge_structure_f() said */
+   int *edge_stamp;              /* draw in which the edge was set up */
+   int stamp;                    /* current draw */
+} MESH_CACHE;
+
+
+static MESH_VERTEX *mesh_vtx = NULL;
+static int mesh_vtx_size = 0;
+
+
+
+/* free_mesh_buffer:
+ *  Releases the transformed vertex buffer on allegro_exit().
+ */
+static void free_mesh_buffer(void)
+{
+   if (mesh_vtx) {
+      _AL_FREE(mesh_vtx);
+      mesh_vtx = NULL;
+      mesh_vtx_size = 0;
+   }
+
+   _remove_exit_func(free_mesh_buffer);
+}
+
+
+
+/* transform_mesh_vertices:
+ *  Applies the camera matrix to every vertex in one pass and computes the
+ *  frustum outcodes.
+ */
+static void transform_mesh_vertices(MESH_VERTEX *dest, AL_CONST MATRIX_f *m, float min_z, float max_z, int vc, AL_CONST V3D_f vtx[])
+{
+   MESH_VERTEX *mv;
+   float x, y, z;
+   int i;
+
+   for (i=0; i<vc; i++) {
+      mv = dest + i;
+      x = vtx[i].x;
+      y = vtx[i].y;
+      z = vtx[i].z;
+
+      if (m) {
+	 mv->cam.x = x * m->v[0][0] + y * m->v[0][1] + z * m->v[0][2] + m->t[0];
+	 mv->cam.y = x * m->v[1][0] + y * m->v[1][1] + z * m->v[1][2] + m->t[1];
+	 mv->cam.z = x * m->v[2][0] + y * m->v[2][1] + z * m->v[2][2] + m->t[2];
+      }
+      else {
+	 mv->cam.x = x;
+	 mv->cam.y = y;
+	 mv->cam.z = z;
+      }
+
+      mv->cam.u = vtx[i].u;
+      mv->cam.v = vtx[i].v;
+      mv->cam.c = vtx[i].c;
+
+      x = mv->cam.x;
+      y = mv->cam.y;
+      z = mv->cam.z;
+
+      mv->out = 0;
+
+      if (x < -z)
+	 mv->out |= OUT_LEFT;
+      else if (x > z)
+	 mv->out |= OUT_RIGHT;
+
+      if (y < -z)
+	 mv->out |= OUT_TOP;
+      else if (y > z)
+	 mv->out |= OUT_BOTTOM;
+
+      if (z < min_z)
+	 mv->out |= OUT_NEAR;
+      else if ((max_z > min_z) && (z > max_z))
+	 mv->out |= OUT_FAR;
+
+      mv->projected = FALSE;
+   }
+}
+
+
+
+/* project_mesh_vertex:
+ *  Returns the screen space version of a vertex, projecting it the first
+ *  time it is needed so that shared vertices are only projected once.
+ */
+static V3D_f *project_mesh_vertex(MESH_VERTEX *mv)
+{
+   if (!mv->projected) {
+      mv->scr = mv->cam;
+      persp_project_f(mv->cam.x, mv->cam.y, mv->cam.z, &mv->scr.x, &mv->scr.y);
+      mv->projected = TRUE;
+   }
+
+   return &mv->scr;
+}
+
+
+
+/* draw_mesh_polygon:
+ *  Sends one surviving polygon to the bitmap or to the scene renderer.
+ */
+static void draw_mesh_polygon(BITMAP *bmp, int type, BITMAP *texture, int vc, V3D_f *v[], int flags)
+{
+   if (flags & MESH3D_SCENE)
+      scene_polygon3d_f(type, texture, vc, v);
+   else if (vc == 3)
+      triangle3d_f(bmp, type, texture, v[0], v[1], v[2]);
+   else
+      polygon3d_f(bmp, type, texture, vc, v);
+}
+
+
+
+/* mesh_edge:
+ *  Returns the edge structure of a mesh edge, setting it up the first time
+ *  it is needed during this draw.
+ */
+static AL_CONST POLYGON_EDGE *mesh_edge(MESH_CACHE *cache, AL_CONST MESH3D_f *mesh, int e, int interp, BITMAP *bmp, int *ok)
+{
+   if (cache->edge_stamp[e] != cache->stamp) {
+      MESH_VERTEX *m1 = cache->vtx + mesh->edge_vtx[e*2];
+      MESH_VERTEX *m2 = cache->vtx + mesh->edge_vtx[e*2+1];
+
+      cache->edge_ok[e] = _fill_3d_edge_structure_f(cache->edge + e, project_mesh_vertex(m1), project_mesh_vertex(m2), interp, bmp);
+      cache->edge_stamp[e] = cache->stamp;
+   }
+
+   *ok = cache->edge_ok[e];
+   return cache->edge + e;
+}
+
+
+
+/* render_mesh_triangles:
+ *  Culls, clips and draws a list of triangles whose vertices have already
+ *  been through transform_mesh_vertices(). If a mesh is given and the
+ *  bitmap uses the software triangle renderer, the edge setup of trivially
+ *  accepted triangles is shared through the mesh cache.
+ */
+static int render_mesh_triangles(BITMAP *bmp, int type, BITMAP *texture, float min_z, float max_z, MESH_VERTEX *mv, int tc, AL_CONST int *idx, AL_CONST MESH3D_f *mesh, int flags)
+{
+   V3D_f clip_vtx[MESH_CLIP_MAX * 2];
+   V3D_f *vout[MESH_CLIP_MAX], *vtmp[MESH_CLIP_MAX];
+   AL_CONST V3D_f *vin[3];
+   AL_CONST POLYGON_EDGE *edge[3];
+   int out[MESH_CLIP_MAX], ok[3];
+   MESH_VERTEX *m1, *m2, *m3;
+   MESH_CACHE *cache = NULL;
+   POLYGON_SEGMENT info;
+   V3D_f *v[3];
+   int i, j, n, interp = 0, drawn = 0;
+
+   for (i=0; i<MESH_CLIP_MAX; i++) {
+      vout[i] = &clip_vtx[i];
+      vtmp[i] = &clip_vtx[i + MESH_CLIP_MAX];
+   }
+
+   if (!(flags & MESH3D_SCENE)) {
+      if ((mesh) && (bmp->vtable->triangle3d_f == _soft_triangle3d_f)) {
+	 /* the edge setup only depends on the bitmap and interpolation mode */
+	 if (_get_scanline_filler(type, &interp, &info, texture, bmp)) {
+	    cache = mesh->cache;
+	    cache->stamp++;
+	 }
+      }
+
+      acquire_bitmap(bmp);
+   }
+
+   for (i=0; i<tc; i++, idx+=3) {
+      m1 = mv + idx[0];
+      m2 = mv + idx[1];
+      m3 = mv + idx[2];
+
+      /* trivial reject: all three vertices outside the same plane */
+      if (m1->out & m2->out & m3->out)
+	 continue;
+
+      if ((m1->out | m2->out | m3->out) == 0) {
+	 /* trivial accept: use the shared projected vertices */
+	 v[0] = project_mesh_vertex(m1);
+	 v[1] = project_mesh_vertex(m2);
+	 v[2] = project_mesh_vertex(m3);
+
+	 if ((flags & MESH3D_CULL_BACKFACES) && (polygon_z_normal_f(v[0], v[1], v[2]) <= 0))
+	    continue;
+
+	 if (cache) {
+	    for (j=0; j<3; j++)
+	       edge[j] = mesh_edge(cache, mesh, mesh->tri_edge[i*3+j], interp, bmp, &ok[j]);
+
+	    _soft_triangle3d_edges_f(bmp, type, texture, v, edge, ok);
+	 }
+	 else
+	    draw_mesh_polygon(bmp, type, texture, 3, v, flags);
+
+	 drawn++;
+      }
+      else {
+	 /* the triangle straddles the frustum, so clip it */
+	 vin[0] = &m1->cam;
+	 vin[1] = &m2->cam;
+	 vin[2] = &m3->cam;
+
+	 n = clip3d_f(type, min_z, max_z, 3, vin, vout, vtmp, out);
+	 if (n < 3)
+	    continue;
+
+	 for (j=0; j<n; j++)
+	    persp_project_f(vout[j]->x, vout[j]->y, vout[j]->z, &vout[j]->x, &vout[j]->y);
+
+	 if ((flags & MESH3D_CULL_BACKFACES) && (polygon_z_normal_f(vout[0], vout[1], vout[2]) <= 0))
+	    continue;
+
+	 draw_mesh_polygon(bmp, type, texture, n, vout, flags);
+	 drawn++;
+      }
+   }
+
+   if (!(flags & MESH3D_SCENE))
+      release_bitmap(bmp);
+
+   return drawn;
+}
+
+
+
+/* mesh3d_f:
+ *  Draws a list of tc indexed triangles. Every vertex goes through the
+ *  camera matrix once; triangles that lie entirely outside the frustum are
+ *  rejected by their outcodes, and only those which straddle a plane are
+ *  passed through clip3d_f(). Returns the number of polygons drawn.
+ */
+int mesh3d_f(BITMAP *bmp, int type, BITMAP *texture, AL_CONST MATRIX_f *camera, float min_z, float max_z, int vc, AL_CONST V3D_f vtx[], int tc, AL_CONST int idx[], int flags)
+{
+   MESH_VERTEX *mv;
+   ASSERT(vtx);
+   ASSERT(idx);
+   ASSERT(bmp || (flags & MESH3D_SCENE));
+
+   if (vc > mesh_vtx_size) {
+      mv = _AL_REALLOC(mesh_vtx, vc * sizeof(MESH_VERTEX));
+      if (!mv)
+	 return 0;
+
+      if (!mesh_vtx)
+	 _add_exit_func(free_mesh_buffer, "free_mesh_buffer");
+
+      mesh_vtx = mv;
+      mesh_vtx_size = vc;
+   }
+
+   transform_mesh_vertices(mesh_vtx, camera, min_z, max_z, vc, vtx);
+
+   return render_mesh_triangles(bmp, type, texture, min_z, max_z, mesh_vtx, tc, idx, NULL, flags);
+}
+
+
+
+/* create_mesh3d_f:
+ *  Creates an indexed triangle mesh from copies of the vertex and index
+ *  arrays, and builds the table of distinct edges so that triangles which
+ *  share an edge also share its setup when drawn.
+ */
+MESH3D_f *create_mesh3d_f(int vc, AL_CONST V3D_f vtx[], int tc, AL_CONST int idx[])
+{
+   MESH3D_f *mesh;
+   MESH_CACHE *cache;
+   int *first, *next;
+   int i, j, a, b, e;
+   ASSERT(vc > 0);
+   ASSERT(tc > 0);
+   ASSERT(vtx);
+   ASSERT(idx);
+
+   mesh = _AL_MALLOC(sizeof(MESH3D_f));
+   if (!mesh)
+      return NULL;
+
+   mesh->vc = vc;
+   mesh->tc = tc;
+   mesh->ec = 0;
+   mesh->vtx = _AL_MALLOC(vc * sizeof(V3D_f));
+   mesh->idx = _AL_MALLOC(tc * 3 * sizeof(int));
+   mesh->tri_edge = _AL_MALLOC(tc * 3 * sizeof(int));
+   mesh->edge_vtx = _AL_MALLOC(tc * 3 * 2 * sizeof(int));
+   mesh->cache = cache = _AL_MALLOC(sizeof(MESH_CACHE));
+
+   if (cache) {
+      cache->vtx = NULL;
+      cache->edge = NULL;
+      cache->edge_ok = NULL;
+      cache->edge_stamp = NULL;
+   }
+
+   first = _AL_MALLOC(vc * sizeof(int));
+   next = _AL_MALLOC(tc * 3 * sizeof(int));
+
+   if ((!mesh->vtx) || (!mesh->idx) || (!mesh->tri_edge) || (!mesh->edge_vtx) ||
+       (!cache) || (!first) || (!next)) {
+      if (first)
+	 _AL_FREE(first);
+      if (next)
+	 _AL_FREE(next);
+      destroy_mesh3d_f(mesh);
+      return NULL;
+   }
+
+   memcpy(mesh->vtx, vtx, vc * sizeof(V3D_f));
+   memcpy(mesh->idx, idx, tc * 3 * sizeof(int));
+
+   /* find the distinct edges, keeping a list of them per lowest vertex */
+   for (i=0; i<vc; i++)
+      first[i] = -1;
+
+   for (i=0; i<tc; i++) {
+      for (j=0; j<3; j++) {
+	 a = idx[i*3+j];
+	 b = idx[i*3+(j+1)%3];
+	 ASSERT((a >= 0) && (a < vc) && (b >= 0) && (b < vc));
+
+	 if (a > b) {
+	    e = a;
+	    a = b;
+	    b = e;
+	 }
+
+	 for (e=first[a]; e>=0; e=next[e])
+	    if (mesh->edge_vtx[e*2+1] == b)
+	       break;
+
+	 if (e < 0) {
+	    e = mesh->ec++;
+	    mesh->edge_vtx[e*2] = a;
+	    mesh->edge_vtx[e*2+1] = b;
+	    next[e] = first[a];
+	    first[a] = e;
+	 }
+
+	 mesh->tri_edge[i*3+j] = e;
+      }
+   }
+
+   _AL_FREE(first);
+   _AL_FREE(next);
+
+   cache->vtx = _AL_MALLOC(vc * sizeof(MESH_VERTEX));
+   cache->edge = _AL_MALLOC(mesh->ec * sizeof(POLYGON_EDGE));
+   cache->edge_ok = _AL_MALLOC(mesh->ec * sizeof(int));
+   cache->edge_stamp = _AL_MALLOC(mesh->ec * sizeof(int));
+   cache->stamp = 0;
+
+   if ((!cache->vtx) || (!cache->edge) || (!cache->edge_ok) || (!cache->edge_stamp)) {
+      destroy_mesh3d_f(mesh);
+      return NULL;
+   }
+
+   for (e=0; e<mesh->ec; e++)
+      cache->edge_stamp[e] = 0;
+
+   return mesh;
+}
+
+
+
+/* destroy_mesh3d_f:
+ *  Frees a mesh created by create_mesh3d_f().
+ */
+void destroy_mesh3d_f(MESH3D_f *mesh)
+{
+   MESH_CACHE *cache;
+
+   if (!mesh)
+      return;
+
+   cache = mesh->cache;
+
+   if (cache) {
+      if (cache->vtx)
+	 _AL_FREE(cache->vtx);
+      if (cache->edge)
+	 _AL_FREE(cache->edge);
+      if (cache->edge_ok)
+	 _AL_FREE(cache->edge_ok);
+      if (cache->edge_stamp)
+	 _AL_FREE(cache->edge_stamp);
+      _AL_FREE(cache);
+   }
+
+   if (mesh->vtx)
+      _AL_FREE(mesh->vtx);
+   if (mesh->idx)
+      _AL_FREE(mesh->idx);
+   if (mesh->tri_edge)
+      _AL_FREE(mesh->tri_edge);
+   if (mesh->edge_vtx)
+      _AL_FREE(mesh->edge_vtx);
+
+   _AL_FREE(mesh);
+}
+
+
+
+/* draw_mesh3d_f:
+ *  Draws a mesh created by create_mesh3d_f(). This does the same job as
+ *  mesh3d_f(), except that the transformed vertices live in the mesh and
+ *  edges shared by two visible triangles are only set up once.
+ */
+int draw_mesh3d_f(BITMAP *bmp, int type, BITMAP *texture, MESH3D_f *mesh, AL_CONST MATRIX_f *camera, float min_z, float max_z, int flags)
+{
+   MESH_CACHE *cache;
+   ASSERT(mesh);
+   ASSERT(bmp || (flags & MESH3D_SCENE));
+
+   cache = mesh->cache;
+
+   transform_mesh_vertices(cache->vtx, camera, min_z, max_z, mesh->vc, mesh->vtx);
+
+   return render_mesh_triangles(bmp, type, texture, min_z, max_z, cache->vtx, mesh->tc, mesh->idx, mesh, flags);
+}
@@ -122,6 +122,10 @@ static PATCH_TABLE patch_table[128];            /* GM -> external synth */
 static int midi_seeking;                        /* set during seeks */
 static int midi_looping;                        /* set during loops */
 
+static int midi_timing = MIDI_TIMING_TIMER;     /* what runs midi_player */
+static int midi_on_mixer = FALSE;               /* run by the sample mixer? */
+static LONG_LONG midi_mixer_error;              /* rounding carried over */
+
 /* hook functions */
 void (*midi_msg_callback)(int msg, int byte1, int byte2) = NULL;
 void (*midi_meta_callback)(int type, AL_CONST unsigned char *data, int length) = NULL;
@@ -912,8 +916,89 @@ END_OF_STATIC_FUNCTION(process_midi_event);
 
 
 
+/* midi_mixer_delay:
+ *  Converts a delay in timer ticks into samples of the mixer, carrying the
+ *  rounding error over to the next delay so that the two clocks never
+ *  drift apart.
+ */
+static int midi_mixer_delay(long speed)
+{
+   LONG_LONG t = speed;
+   int samples;
+
+   /* keep absurdly long gaps from overflowing */
+   if (t > (LONG_LONG)TIMERS_PER_SECOND * 3600)
+      t = (LONG_LONG)TIMERS_PER_SECOND * 3600;
+
+   t = t * get_mixer_frequency() + midi_mixer_error;
+   samples = (int)(t / TIMERS_PER_SECOND);
+
+   midi_mixer_error = t - (LONG_LONG)samples * TIMERS_PER_SECOND;
+
+   return samples;
+}
+
+END_OF_STATIC_FUNCTION(midi_mixer_delay);
+
+
+
+/* schedule_midi_player:
+ *  Arranges for midi_player() to run again after the given number of
+ *  timer ticks, either from the timer or at that point of the mixed
+ *  stream.
+ */
+static void schedule_midi_player(long speed)
+{
+   if (midi_on_mixer)
+      _mixer_set_sequencer(midi_player, midi_mixer_delay(speed));
+   else
+      install_int_ex(midi_player, speed);
+}
+
+END_OF_STATIC_FUNCTION(schedule_midi_player);
+
+
+
+/* start_midi_player:
+ *  Starts calling midi_player() after the given number of timer ticks,
+ *  deciding whether the timer or the mixer will drive it. The mixer has
+ *  no latency to allow for, so it resumes exactly where the file is.
+ *  With the offline render driver there is no real time to follow, so
+ *  the mixer always drives it.
+ */
+static void start_midi_player(long speed)
+{
+   midi_on_mixer = (((midi_timing == MIDI_TIMING_MIXER) || (digi_card == DIGI_RENDER)) &&
+		    (midi_driver->id == MIDI_DIGMID) &&
+		    (get_mixer_frequency() > 0));
+
+   midi_mixer_error = 0;
+
+   schedule_midi_player(midi_on_mixer ? midi_timer_speed : speed);
+}
+
+END_OF_STATIC_FUNCTION(start_midi_player);
+
+
+
+/* stop_midi_player:
+ *  Stops calling midi_player().
+ */
+static void stop_midi_player(void)
+{
+   if (midi_on_mixer)
+      _mixer_set_sequencer(NULL, 0);
+   else
+      remove_int(midi_player);
+}
+
+END_OF_STATIC_FUNCTION(stop_midi_player);
+
+
+
 /* midi_player:
- *  The core MIDI player: to be used as a timer callback.
+ *  The core MIDI player: to be used as a timer callback, or run by the
+ *  mixer at the exact sample where the next events are due.
  */
 static void midi_player(void)
 {
@@ -926,7 +1011,7 @@ static void midi_player(void)
 
    if (midi_semaphore) {
       midi_timer_speed += BPS_TO_TIMER(MIDI_TIMER_FREQUENCY);
-      install_int_ex(midi_player, BPS_TO_TIMER(MIDI_TIMER_FREQUENCY));
+      schedule_midi_player(BPS_TO_TIMER(MIDI_TIMER_FREQUENCY));
       return;
    }
 
@@ -1000,7 +1085,7 @@ static void midi_player(void)
    if ((!active) || ((midi_loop_end > 0) && (midi_pos >= midi_loop_end))) {
       if ((midi_loop) && (!midi_looping)) {
 	 if (midi_loop_start > 0) {
-	    remove_int(midi_player);
+	    stop_midi_player();
 	    midi_semaphore = FALSE;
 	    midi_looping = TRUE;
 	    if (midi_seek(midi_loop_start) != 0) {
@@ -1028,12 +1113,13 @@ static void midi_player(void)
       }
    }
 
-   /* reprogram the timer */
-   if (midi_timer_speed < BPS_TO_TIMER(MIDI_TIMER_FREQUENCY))
+   /* reprogram the timer, which can't be trusted with short delays (the
+      mixer can, so it runs us exactly when the next event is due) */
+   if ((!midi_on_mixer) && (midi_timer_speed < BPS_TO_TIMER(MIDI_TIMER_FREQUENCY)))
       midi_timer_speed = BPS_TO_TIMER(MIDI_TIMER_FREQUENCY);
 
    if (!midi_seeking) 
-      install_int_ex(midi_player, midi_timer_speed);
+      schedule_midi_player(midi_timer_speed);
 
    /* controller changes are cached and only processed here, so we can 
       condense streams of controller data into just a few voice updates */ 
@@ -1284,7 +1370,7 @@ int play_midi(MIDI *midi, int loop)
 {
    int c;
 
-   remove_int(midi_player);
+   stop_midi_player();
 
    for (c=0; c<16; c++) {
       all_notes_off(c);
@@ -1303,7 +1389,7 @@ int play_midi(MIDI *midi, int loop)
       prepare_to_play(midi);
 
       /* arbitrary speed, midi_player() will adjust it */
-      install_int(midi_player, 20);
+      start_midi_player(MSEC_TO_TIMER(20));
    }
    else {
       midifile = NULL;
@@ -1361,7 +1447,7 @@ void midi_pause(void)
    if (!midifile)
       return;
 
-   remove_int(midi_player);
+   stop_midi_player();
 
    for (c=0; c<16; c++) {
       all_notes_off(c);
@@ -1381,7 +1467,7 @@ void midi_resume(void)
    if (!midifile)
       return;
 
-   install_int_ex(midi_player, midi_timer_speed);
+   start_midi_player(midi_timer_speed);
 }
 
 END_OF_FUNCTION(midi_resume);
@@ -1483,14 +1569,14 @@ int midi_seek(int target)
 
       /* if we didn't hit the end of the file, continue playing */
       if (!midi_looping)
-	 install_int(midi_player, 20);
+	 start_midi_player(MSEC_TO_TIMER(20));
 
       return 0;
    }
 
    if ((midi_loop) && (!midi_looping)) {  /* was file looped? */
       prepare_to_play(old_midifile);
-      install_int(midi_player, 20);
+      start_midi_player(MSEC_TO_TIMER(20));
       return 2;                           /* seek past EOF => file restarted */
    }
 
@@ -1501,6 +1587,29 @@ END_OF_FUNCTION(midi_seek);
 
 
 
+/* set_midi_timing:
+ *  Selects what drives the MIDI player from the next play_midi() or
+ *  midi_resume() on: the timer, or the sample mixer if the DIGMID driver
+ *  is in use. Returns zero if the mode can be used with the drivers that
+ *  are installed, which for MIDI_TIMING_MIXER means calling this after
+ *  install_sound().
+ */
+int set_midi_timing(int mode)
+{
+   ASSERT((mode == MIDI_TIMING_TIMER) || (mode == MIDI_TIMING_MIXER));
+
+   midi_timing = mode;
+
+   if (mode == MIDI_TIMING_MIXER) {
+      if ((!midi_driver) || (midi_driver->id != MIDI_DIGMID) || (get_mixer_frequency() <= 0))
+	 return -1;
+   }
+
+   return 0;
+}
+
+
+
 /* get_midi_length:
  *  Returns the length, in seconds, of the specified midi. This will stop any
  *  currently playing midi. Don't call it too often, since it simulates playing
@@ -1595,6 +1704,9 @@ static void midi_lock_mem(void)
    LOCK_VARIABLE(midi_sysex_callback);
    LOCK_VARIABLE(midi_seeking);
    LOCK_VARIABLE(midi_looping);
+   LOCK_VARIABLE(midi_timing);
+   LOCK_VARIABLE(midi_on_mixer);
+   LOCK_VARIABLE(midi_mixer_error);
    LOCK_FUNCTION(parse_var_len);
    LOCK_FUNCTION(raw_program_change);
    LOCK_FUNCTION(midi_note_off);
@@ -1607,6 +1719,10 @@ static void midi_lock_mem(void)
    LOCK_FUNCTION(process_controller);
    LOCK_FUNCTION(process_meta_event);
    LOCK_FUNCTION(process_midi_event);
+   LOCK_FUNCTION(midi_mixer_delay);
+   LOCK_FUNCTION(schedule_midi_player);
+   LOCK_FUNCTION(start_midi_player);
+   LOCK_FUNCTION(stop_midi_player);
    LOCK_FUNCTION(midi_player);
    LOCK_FUNCTION(prepare_to_play);
    LOCK_FUNCTION(play_midi);
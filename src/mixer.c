@@ -52,6 +52,8 @@ typedef struct MIXER_VOICE
    long loop_end;             /* fixed point loop end position */
    int lvol;                  /* left channel volume */
    int rvol;                  /* right channel volume */
+   void (*refill)(void *param, int pos, int count);   /* stream top-up */
+   void *refill_param;        /* passed to the refill routine */
 } MIXER_VOICE;
 
 
@@ -84,6 +86,10 @@ static int mix_bits;
 /* shift factor for volume per voice */
 static int voice_volume_scale = 1;
 
+/* routine to call at an exact point of the mixed stream */
+static void (*mix_sequencer)(void) = NULL;
+static int mix_sequencer_delay;        /* samples until it is due */
+
 static void mixer_lock_mem(void);
 
 #ifdef ALLEGRO_MULTITHREADED
@@ -264,6 +270,12 @@ int _mixer_init(int bufsize, int freq, int stereo, int is16bit, int *voices)
    if((_sound_hq < 0) || (_sound_hq > 2))
       _sound_hq = 2;
 
+   /* the high quality mixers only write stereo, as set_mixer_quality()
+    * knows
+    */
+   if (!stereo)
+      _sound_hq = 0;
+
    mix_voices = *voices;
    if(mix_voices > MIXER_MAX_SFX)
       *voices = mix_voices = MIXER_MAX_SFX;
@@ -276,6 +288,7 @@ int _mixer_init(int bufsize, int freq, int stereo, int is16bit, int *voices)
    for (i=0; i<MIXER_MAX_SFX; i++) {
       mixer_voice[i].playing = FALSE;
       mixer_voice[i].data.buffer = NULL;
+      mixer_voice[i].refill = NULL;
    }
 
    /* temporary buffer for sample mixing */
@@ -334,6 +347,8 @@ void _mixer_exit(void)
    mix_channels = 0;
    mix_bits = 0;
    mix_voices = 0;
+
+   mix_sequencer = NULL;
 }
 
 
@@ -1062,44 +1077,62 @@ END_OF_STATIC_FUNCTION(mix_hq2_16x2_samples);
 
 
 
-#define MAX_24 (0x00FFFFFF)
-
-/* _mix_some_samples:
- *  Mixes samples into a buffer in memory (the buf parameter should be a
- *  linear offset into the specified segment), using the buffer size, sample
- *  frequency, etc, set when you called _mixer_init(). This should be called
- *  by the audio driver to get the next buffer full of samples.
+/* is_unscaled:
+ *  Checks whether a voice is playing at the mixing frequency, from a
+ *  whole sample position, and will stay that way. Bidirectional loops
+ *  don't count, because the two mixers turn round at the loop ends in
+ *  different places.
  */
-void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
+static INLINE int is_unscaled(MIXER_VOICE *mv, PHYS_VOICE *pv)
 {
-   signed int *p = mix_buffer;
-   int i;
+   return (((mv->diff == MIX_FIX_SCALE) || (mv->diff == -MIX_FIX_SCALE)) &&
+           (!(mv->pos & (MIX_FIX_SCALE-1))) && (!pv->dfreq) &&
+           (!(pv->playmode & PLAYMODE_BIDIR)));
+}
 
-   /* clear mixing buffer */
-   memset(p, 0, mix_size*mix_channels * sizeof(*p));
 
-#ifdef ALLEGRO_MULTITHREADED
-   system_driver->lock_mutex(mixer_mutex);
-#endif
+
+/* mix_segment:
+ *  Mixes len samples of every playing voice into the buffer at p.
+ */
+static void mix_segment(signed int *p, int len)
+{
+   int i;
 
    for (i=0; i<mix_voices; i++) {
       if (mixer_voice[i].playing) {
+         /* let a stream write the data we are about to read: counting
+          * from the whole sample we are at, the fraction past it, the
+          * distance we will move, and the next sample along for the
+          * interpolation
+          */
+         if (mixer_voice[i].refill) {
+            mixer_voice[i].refill(mixer_voice[i].refill_param,
+                                  mixer_voice[i].pos >> MIX_FIX_SHIFT,
+                                  (((mixer_voice[i].pos & (MIX_FIX_SCALE-1)) +
+                                    len * ABS(mixer_voice[i].diff)) >> MIX_FIX_SHIFT) + 2);
+         }
+
          if ((_phys_voice[i].vol > 0) || (_phys_voice[i].dvol > 0)) {
-            /* Interpolated mixing */
-            if (_sound_hq >= 2) {
+            /* Interpolated mixing, unless the voice steps through whole
+             * samples at the mixing frequency, in which case there is
+             * nothing to interpolate and the high quality mixer gives
+             * exactly the same result
+             */
+            if ((_sound_hq >= 2) && (!is_unscaled(mixer_voice+i, _phys_voice+i))) {
                /* stereo input -> interpolated output */
                if (mixer_voice[i].channels != 1) {
                   if (mixer_voice[i].bits == 8)
-                     mix_hq2_8x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq2_8x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_hq2_16x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq2_16x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
                /* mono input -> interpolated output */
                else {
                   if (mixer_voice[i].bits == 8)
-                     mix_hq2_8x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq2_8x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_hq2_16x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq2_16x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
             }
             /* high quality mixing */
@@ -1107,16 +1140,16 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
                /* stereo input -> high quality output */
                if (mixer_voice[i].channels != 1) {
                   if (mixer_voice[i].bits == 8)
-                     mix_hq1_8x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq1_8x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_hq1_16x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq1_16x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
                /* mono input -> high quality output */
                else {
                   if (mixer_voice[i].bits == 8)
-                     mix_hq1_8x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq1_8x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_hq1_16x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_hq1_16x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
             }
             /* low quality (fast?) stereo mixing */
@@ -1124,16 +1157,16 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
                /* stereo input -> stereo output */
                if (mixer_voice[i].channels != 1) {
                   if (mixer_voice[i].bits == 8)
-                     mix_stereo_8x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_stereo_8x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_stereo_16x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_stereo_16x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
                /* mono input -> stereo output */
                else {
                   if (mixer_voice[i].bits == 8)
-                     mix_stereo_8x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_stereo_8x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_stereo_16x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_stereo_16x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
             }
             /* low quality (fast?) mono mixing */
@@ -1141,23 +1174,67 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
                /* stereo input -> mono output */
                if (mixer_voice[i].channels != 1) {
                   if (mixer_voice[i].bits == 8)
-                     mix_mono_8x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_mono_8x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_mono_16x2_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_mono_16x2_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
                /* mono input -> mono output */
                else {
                   if (mixer_voice[i].bits == 8)
-                     mix_mono_8x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_mono_8x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                   else
-                     mix_mono_16x1_samples(mixer_voice+i, _phys_voice+i, p, mix_size);
+                     mix_mono_16x1_samples(mixer_voice+i, _phys_voice+i, p, len);
                }
             }
          }
          else
-            mix_silent_samples(mixer_voice+i, _phys_voice+i, mix_size);
+            mix_silent_samples(mixer_voice+i, _phys_voice+i, len);
       }
    }
+}
+
+END_OF_STATIC_FUNCTION(mix_segment);
+
+
+
+#define MAX_24 (0x00FFFFFF)
+
+/* mix_samples:
+ *  Mixes size samples (no more than mix_size) into a buffer in memory, the
+ *  buf parameter being a linear offset into the specified segment.
+ */
+static void mix_samples(uintptr_t buf, unsigned short seg, int issigned, int size)
+{
+   signed int *p = mix_buffer;
+   int i, pos, len;
+
+   /* clear mixing buffer */
+   memset(p, 0, size*mix_channels * sizeof(*p));
+
+#ifdef ALLEGRO_MULTITHREADED
+   system_driver->lock_mutex(mixer_mutex);
+#endif
+
+   for (pos=0; pos<size; pos+=len) {
+      len = size - pos;
+
+      /* stop where the sequencer wants to run, so whatever it does to the
+       * voices is heard from that exact sample
+       */
+      while ((mix_sequencer) && (mix_sequencer_delay <= 0)) {
+	 void (*proc)(void) = mix_sequencer;
+	 mix_sequencer = NULL;
+	 proc();
+      }
+
+      if ((mix_sequencer) && (mix_sequencer_delay < len))
+	 len = mix_sequencer_delay;
+
+      mix_segment(p + pos*mix_channels, len);
+
+      if (mix_sequencer)
+	 mix_sequencer_delay -= len;
+   }
 
 #ifdef ALLEGRO_MULTITHREADED
    system_driver->unlock_mutex(mixer_mutex);
@@ -1168,14 +1245,14 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
    /* transfer to the audio driver's buffer */
    if (mix_bits == 16) {
       if (issigned) {
-         for (i=mix_size*mix_channels; i>0; i--) {
+         for (i=size*mix_channels; i>0; i--) {
             _farnspokew(buf, (clamp_val((*p)+0x800000, MAX_24) >> 8) ^ 0x8000);
             buf += 2;
             p++;
          }
       }
       else {
-         for (i=mix_size*mix_channels; i>0; i--) {
+         for (i=size*mix_channels; i>0; i--) {
             _farnspokew(buf, clamp_val((*p)+0x800000, MAX_24) >> 8);
             buf += 2;
             p++;
@@ -1184,14 +1261,14 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
    }
    else {
       if(issigned) {
-         for (i=mix_size*mix_channels; i>0; i--) {
+         for (i=size*mix_channels; i>0; i--) {
             _farnspokeb(buf, (clamp_val((*p)+0x800000, MAX_24) >> 16) ^ 0x80);
             buf++;
             p++;
          }
       }
       else {
-         for (i=mix_size*mix_channels; i>0; i--) {
+         for (i=size*mix_channels; i>0; i--) {
             _farnspokeb(buf, clamp_val((*p)+0x800000, MAX_24) >> 16);
             buf++;
             p++;
@@ -1200,10 +1277,110 @@ void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
    }
 }
 
+END_OF_STATIC_FUNCTION(mix_samples);
+
+
+
+/* _mix_some_samples:
+ *  Mixes samples into a buffer in memory (the buf parameter should be a
+ *  linear offset into the specified segment), using the buffer size, sample
+ *  frequency, etc, set when you called _mixer_init(). This should be called
+ *  by the audio driver to get the next buffer full of samples.
+ */
+void _mix_some_samples(uintptr_t buf, unsigned short seg, int issigned)
+{
+   mix_samples(buf, seg, issigned, mix_size);
+}
+
 END_OF_FUNCTION(_mix_some_samples);
 
 
 
+/* _mixer_render:
+ *  Mixes len samples into a buffer in regular memory, in as many passes
+ *  as it takes. Used to render sound without a driver pulling on the
+ *  mixer, as fast as the CPU allows.
+ */
+void _mixer_render(void *buf, int len, int issigned)
+{
+   int size = mix_channels * mix_bits / 8;
+   unsigned char *p = buf;
+   int n;
+
+   while (len > 0) {
+      n = MIN(len, mix_size);
+      mix_samples((uintptr_t)p, _default_ds(), issigned, n);
+      p += n * size;
+      len -= n;
+   }
+}
+
+
+
+
+/* _mixer_set_sequencer:
+ *  Makes the mixer call proc once it has mixed delay more samples, or
+ *  cancels the call if proc is NULL. When called from proc itself, the
+ *  delay counts from the point where proc runs, so a routine can keep
+ *  itself going at exact sample intervals. proc runs with the mixer
+ *  locked and can use the voice functions. Returns zero on success, or
+ *  -1 if the mixer isn't in use.
+ */
+int _mixer_set_sequencer(void (*proc)(void), int delay)
+{
+   if (!mix_buffer)
+      return -1;
+
+#ifdef ALLEGRO_MULTITHREADED
+   system_driver->lock_mutex(mixer_mutex);
+#endif
+
+   mix_sequencer = proc;
+   mix_sequencer_delay = delay;
+
+#ifdef ALLEGRO_MULTITHREADED
+   system_driver->unlock_mutex(mixer_mutex);
+#endif
+
+   return 0;
+}
+
+END_OF_FUNCTION(_mixer_set_sequencer);
+
+
+
+/* _mixer_set_refill:
+ *  Makes the mixer call proc before each stretch it mixes of the voice,
+ *  with the sample position the voice is at and the number of samples it
+ *  is going to read from there (wrapping round the loop), so that the
+ *  data can be written just before it is needed. proc runs with the
+ *  mixer locked and must not use the voice functions. Pass NULL to stop
+ *  the calls, which also stop when the voice is reused or released.
+ *  Returns zero on success, or -1 if the mixer isn't in use.
+ */
+int _mixer_set_refill(int voice, void (*proc)(void *param, int pos, int count), void *param)
+{
+   if (!mix_buffer)
+      return -1;
+
+#ifdef ALLEGRO_MULTITHREADED
+   system_driver->lock_mutex(mixer_mutex);
+#endif
+
+   mixer_voice[voice].refill = proc;
+   mixer_voice[voice].refill_param = param;
+
+#ifdef ALLEGRO_MULTITHREADED
+   system_driver->unlock_mutex(mixer_mutex);
+#endif
+
+   return 0;
+}
+
+END_OF_FUNCTION(_mixer_set_refill);
+
+
+
 /* _mixer_init_voice:
  *  Initialises the specificed voice ready for playing a sample.
  */
@@ -1218,6 +1395,8 @@ void _mixer_init_voice(int voice, AL_CONST SAMPLE *sample)
    mixer_voice[voice].loop_end = sample->loop_end << MIX_FIX_SHIFT;
 
    mixer_voice[voice].data.buffer = sample->data;
+   mixer_voice[voice].refill = NULL;
+   mixer_voice[voice].refill_param = NULL;
 
    update_mixer_volume(mixer_voice+voice, _phys_voice+voice);
    update_mixer_freq(mixer_voice+voice, _phys_voice+voice);
@@ -1238,6 +1417,8 @@ void _mixer_release_voice(int voice)
 
    mixer_voice[voice].playing = FALSE;
    mixer_voice[voice].data.buffer = NULL;
+   mixer_voice[voice].refill = NULL;
+   mixer_voice[voice].refill_param = NULL;
 
 #ifdef ALLEGRO_MULTITHREADED
    system_driver->unlock_mutex(mixer_mutex);
@@ -1525,6 +1706,8 @@ static void mixer_lock_mem(void)
    LOCK_VARIABLE(mix_freq);
    LOCK_VARIABLE(mix_channels);
    LOCK_VARIABLE(mix_bits);
+   LOCK_VARIABLE(mix_sequencer);
+   LOCK_VARIABLE(mix_sequencer_delay);
    LOCK_FUNCTION(set_mixer_quality);
    LOCK_FUNCTION(get_mixer_quality);
    LOCK_FUNCTION(get_mixer_buffer_length);
@@ -1553,7 +1736,11 @@ static void mixer_lock_mem(void)
    LOCK_FUNCTION(update_mixer_volume);
    LOCK_FUNCTION(update_mixer);
    LOCK_FUNCTION(update_silent_mixer);
+   LOCK_FUNCTION(mix_segment);
+   LOCK_FUNCTION(mix_samples);
    LOCK_FUNCTION(_mix_some_samples);
+   LOCK_FUNCTION(_mixer_set_sequencer);
+   LOCK_FUNCTION(_mixer_set_refill);
    LOCK_FUNCTION(_mixer_init_voice);
    LOCK_FUNCTION(_mixer_release_voice);
    LOCK_FUNCTION(_mixer_start_voice);
@@ -0,0 +1,317 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Offline sound rendering: a digital driver with no hardware behind
+ *      it, which mixes samples and DIGMID music into memory or a WAV file
+ *      as fast as the CPU allows.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* samples mixed in each pass */
+#define RENDER_BUFFER_SIZE    2048
+
+/* how many seconds past get_midi_length() a WAV render may run, in case
+ * the player never gets to the end of the file
+ */
+#define RENDER_MIDI_TAIL      5
+
+
+static int render_detect(int input);
+static int render_init(int input, int voices);
+static void render_exit(int input);
+static int render_buffer_size(void);
+
+
+
+DIGI_DRIVER digi_render =
+{
+   DIGI_RENDER,
+   empty_string,
+   empty_string,
+   "Offline render",
+   0,
+   0,
+   MIXER_MAX_SFX,
+   MIXER_DEF_SFX,
+
+   render_detect,
+   render_init,
+   render_exit,
+   NULL,
+   NULL,
+
+   NULL,
+   NULL,
+   render_buffer_size,
+   _mixer_init_voice,
+   _mixer_release_voice,
+   _mixer_start_voice,
+   _mixer_stop_voice,
+   _mixer_loop_voice,
+
+   _mixer_get_position,
+   _mixer_set_position,
+
+   _mixer_get_volume,
+   _mixer_set_volume,
+   _mixer_ramp_volume,
+   _mixer_stop_volume_ramp,
+
+   _mixer_get_frequency,
+   _mixer_set_frequency,
+   _mixer_sweep_frequency,
+   _mixer_stop_frequency_sweep,
+
+   _mixer_get_pan,
+   _mixer_set_pan,
+   _mixer_sweep_pan,
+   _mixer_stop_pan_sweep,
+
+   _mixer_set_echo,
+   _mixer_set_tremolo,
+   _mixer_set_vibrato,
+   0, 0,
+   NULL,
+   NULL,
+   NULL,
+   NULL,
+   NULL,
+   NULL
+};
+
+
+
+/* render_detect:
+ *  There is nothing to look for, so this can't fail, but we don't do
+ *  recording.
+ */
+static int render_detect(int input)
+{
+   if (input) {
+      ustrzcpy(allegro_error, ALLEGRO_ERROR_SIZE, get_config_text("Input is not supported"));
+      return FALSE;
+   }
+
+   return TRUE;
+}
+
+
+
+/* render_init:
+ *  Sets up the mixer in the format asked for in the config file, or
+ *  44100 Hz, 16 bit stereo by default.
+ */
+static int render_init(int input, int voices)
+{
+   int freq = (_sound_freq > 0) ? _sound_freq : 44100;
+   int bits = (_sound_bits == 8) ? 8 : 16;
+   int stereo = (_sound_stereo != 0);
+
+   if (input)
+      return -1;
+
+   digi_render.voices = voices;
+
+   if (_mixer_init(RENDER_BUFFER_SIZE * (stereo ? 2 : 1), freq, stereo,
+		   ((bits == 16) ? 1 : 0), &digi_render.voices) != 0) {
+      ustrzcpy(allegro_error, ALLEGRO_ERROR_SIZE, get_config_text("Can not init software mixer"));
+      return -1;
+   }
+
+   digi_render.name = digi_render.desc = get_config_text(digi_render.ascii_name);
+
+   return 0;
+}
+
+
+
+/* render_exit:
+ *  Shuts down the mixer.
+ */
+static void render_exit(int input)
+{
+   if (input)
+      return;
+
+   _mixer_exit();
+}
+
+
+
+/* render_buffer_size:
+ *  Returns the number of samples mixed in each pass, for the audiostream
+ *  code.
+ */
+static int render_buffer_size(void)
+{
+   return RENDER_BUFFER_SIZE;
+}
+
+
+
+/* render_sound:
+ *  Mixes the next len samples of whatever is playing into buf, in the same
+ *  unsigned format as SAMPLE data. Returns zero on success, or -1 if the
+ *  render driver isn't installed.
+ */
+int render_sound(void *buf, int len)
+{
+   ASSERT(buf);
+   ASSERT(len >= 0);
+
+   if ((!_sound_installed) || (digi_driver != &digi_render))
+      return -1;
+
+   _mixer_render(buf, len, FALSE);
+
+   return 0;
+}
+
+
+
+/* can_render_midi:
+ *  Checks that MIDI files will be played by DIGMID on the render driver,
+ *  which is what makes the MIDI player run from the mixer rather than
+ *  from the timer in real time.
+ */
+static int can_render_midi(void)
+{
+   return ((_sound_installed) && (digi_driver == &digi_render) &&
+	   (midi_driver == &midi_digmid) && (get_mixer_frequency() > 0));
+}
+
+
+
+/* render_midi:
+ *  Plays a MIDI file from the start and renders it into buf, which has
+ *  room for len samples, stopping at the end of the file or when the
+ *  buffer is full. Returns the number of samples rendered, rounded up to
+ *  a whole pass of the mixer, or -1 on error.
+ */
+long render_midi(MIDI *midi, void *buf, long len)
+{
+   int size, n;
+   long pos = 0;
+   ASSERT(midi);
+   ASSERT(buf);
+
+   if (!can_render_midi())
+      return -1;
+
+   size = get_mixer_channels() * get_mixer_bits() / 8;
+
+   if (play_midi(midi, FALSE) != 0)
+      return -1;
+
+   while ((pos < len) && (midi_pos >= 0)) {
+      n = MIN(len - pos, RENDER_BUFFER_SIZE);
+      _mixer_render((unsigned char *)buf + pos * size, n, FALSE);
+      pos += n;
+   }
+
+   stop_midi();
+
+   return pos;
+}
+
+
+
+/* render_midi_wav:
+ *  Plays a MIDI file from the start and writes the whole of it to the
+ *  packfile as a RIFF WAV file. The sound is rendered into memory first,
+ *  because the header needs its length. Returns the number of samples
+ *  written, or -1 on error.
+ */
+long render_midi_wav(MIDI *midi, PACKFILE *f)
+{
+   unsigned char *data = NULL;
+   unsigned char *p;
+   long size = 0;
+   long pos = 0;
+   long bytes, limit, i;
+   int channels, bits, sample_size;
+   ASSERT(midi);
+   ASSERT(f);
+
+   if (!can_render_midi())
+      return -1;
+
+   channels = get_mixer_channels();
+   bits = get_mixer_bits();
+   sample_size = channels * bits / 8;
+
+   /* never go on for much longer than the file says it lasts */
+   limit = (long)(get_midi_length(midi) + RENDER_MIDI_TAIL) * get_mixer_frequency();
+
+   if (play_midi(midi, FALSE) != 0)
+      return -1;
+
+   /* 16 bit WAV data is signed, 8 bit data is unsigned */
+   while ((midi_pos >= 0) && (pos < limit)) {
+      if (pos + RENDER_BUFFER_SIZE > size) {
+	 size = MAX(size * 2, RENDER_BUFFER_SIZE * 16);
+	 p = _AL_REALLOC(data, size * sample_size);
+	 if (!p) {
+	    stop_midi();
+	    _AL_FREE(data);
+	    *allegro_errno = ENOMEM;
+	    return -1;
+	 }
+	 data = p;
+      }
+
+      _mixer_render(data + pos * sample_size, RENDER_BUFFER_SIZE, (bits == 16));
+      pos += RENDER_BUFFER_SIZE;
+   }
+
+   stop_midi();
+
+   bytes = pos * sample_size;
+
+   pack_fputs("RIFF", f);
+   pack_iputl(36 + bytes, f);
+   pack_fputs("WAVE", f);
+
+   pack_fputs("fmt ", f);
+   pack_iputl(16, f);
+   pack_iputw(1, f);                         /* PCM data */
+   pack_iputw(channels, f);
+   pack_iputl(get_mixer_frequency(), f);
+   pack_iputl(get_mixer_frequency() * sample_size, f);
+   pack_iputw(sample_size, f);
+   pack_iputw(bits, f);
+
+   pack_fputs("data", f);
+   pack_iputl(bytes, f);
+
+   if (bits == 16) {
+      for (i=0; i<bytes/2; i++)
+	 pack_iputw(((unsigned short *)data)[i], f);
+   }
+   else
+      pack_fwrite(data, bytes, f);
+
+   if (data)
+      _AL_FREE(data);
+
+   if (pack_ferror(f))
+      return -1;
+
+   return pos;
+}
@@ -1613,6 +1613,41 @@ void _soft_triangle3d(BITMAP *bmp, int type, BITMAP *texture, V3D *v1, V3D *v2,
 
 
 
+/* do_triangle3d_f:
+ *  Fills a 3d triangle whose vertices are sorted by y, given the long edge
+ *  from vt1 to vt3 and the two short edges, each of which is only drawn if
+ *  its ok flag is set.
+ */
+static void do_triangle3d_f(BITMAP *bmp, SCANLINE_FILLER drawer, int flags, int color, POLYGON_SEGMENT *info, AL_CONST V3D_f *vt2, POLYGON_EDGE *edge1, POLYGON_EDGE *edge2, int ok2, POLYGON_EDGE *edge3, int ok3)
+{
+   acquire_bitmap(bmp);
+
+   /* calculate deltas */
+   if (drawer != _poly_scanline_dummy) {
+      fixed w, h;
+      POLYGON_SEGMENT s1 = edge1->dat;
+
+      h = ftofix(vt2->y) - (edge1->top << 16);
+      _clip_polygon_segment(&s1, h, flags);
+
+      w = edge1->x + fixmul(h, edge1->dx) - ftofix(vt2->x);
+      if (w) _triangle_deltas_f(bmp, w, &s1, info, vt2, flags);
+   }
+
+   /* draws part between y1 and y2 */
+   if (ok2)
+      draw_triangle_part(bmp, edge2->top, edge2->bottom, edge1, edge2, drawer, flags, color, info);
+
+   /* draws part between y2 and y3 */
+   if (ok3)
+      draw_triangle_part(bmp, edge3->top, edge3->bottom, edge1, edge3, drawer, flags, color, info);
+
+   bmp_unwrite_line(bmp);
+   release_bitmap(bmp);
+}
+
+
+
 /* triangle3d_f:
  *  Draws a 3d triangle.
  */
@@ -1626,9 +1661,10 @@ void _soft_triangle3d_f(BITMAP *bmp, int type, BITMAP *texture, V3D_f *v1, V3D_f
 
    int color = v1->c;
    V3D_f *vt1, *vt2, *vt3;
-   POLYGON_EDGE edge1, edge2;
+   POLYGON_EDGE edge1, edge2, edge3;
    POLYGON_SEGMENT info;
    SCANLINE_FILLER drawer;
+   int ok2, ok3;
    ASSERT(bmp);
 
    /* set up the drawing mode */
@@ -1667,33 +1703,92 @@ void _soft_triangle3d_f(BITMAP *bmp, int type, BITMAP *texture, V3D_f *v1, V3D_f
 
    /* do 3D triangle*/
    if (_fill_3d_edge_structure_f(&edge1, vt1, vt3, flags, bmp)) {
+      ok2 = _fill_3d_edge_structure_f(&edge2, vt1, vt2, flags, bmp);
+      ok3 = _fill_3d_edge_structure_f(&edge3, vt2, vt3, flags, bmp);
+      do_triangle3d_f(bmp, drawer, flags, color, &info, vt2, &edge1, &edge2, ok2, &edge3, ok3);
+   }
 
-      acquire_bitmap(bmp);
+   /* reset fpu mode */
+   #ifdef ALLEGRO_DOS
+      if (flags & (INTERP_Z | INTERP_FLOAT_UV))
+	 _control87(old87, MCW_PC | MCW_RC);
+   #endif
+}
 
-      /* calculate deltas */
-      if (drawer != _poly_scanline_dummy) {
-	 fixed w, h;
-	 POLYGON_SEGMENT s1 = edge1.dat;
 
-	 h = ftofix(vt2->y) - (edge1.top << 16);
-	 _clip_polygon_segment(&s1, h, flags);
 
-	 w = edge1.x + fixmul(h, edge1.dx) - ftofix(vt2->x);
-	 if (w) _triangle_deltas_f(bmp, w, &s1, &info, vt2, flags);
-      }
+/* _soft_triangle3d_edges_f:
+ *  Draws a 3d triangle like _soft_triangle3d_f(), but with edge structures
+ *  that were already set up by _fill_3d_edge_structure_f() for this bitmap
+ *  and polygon type. edge[i] joins v[i] and v[(i+1)%3], and ok[i] is the
+ *  value returned when it was filled. Used by the mesh renderer, which sets
+ *  up each edge once however many triangles share it.
+ */
+void _soft_triangle3d_edges_f(BITMAP *bmp, int type, BITMAP *texture, V3D_f *v[3], AL_CONST POLYGON_EDGE *edge[3], AL_CONST int ok[3])
+{
+   int flags;
 
-      /* draws part between y1 and y2 */
-      if (_fill_3d_edge_structure_f(&edge2, vt1, vt2, flags, bmp))
-	 draw_triangle_part(bmp, edge2.top, edge2.bottom, &edge1, &edge2, drawer, flags, color, &info);
+   #ifdef ALLEGRO_DOS
+      int old87 = 0;
+   #endif
 
-      /* draws part between y2 and y3 */
-      if (_fill_3d_edge_structure_f(&edge2, vt2, vt3, flags, bmp))
-	 draw_triangle_part(bmp, edge2.top, edge2.bottom, &edge1, &edge2, drawer, flags, color, &info);
+   int color = v[0]->c;
+   int i1, i2, i3, it;
+   POLYGON_EDGE edge1, edge2, edge3;
+   POLYGON_SEGMENT info;
+   SCANLINE_FILLER drawer;
+   ASSERT(bmp);
 
-      bmp_unwrite_line(bmp);
-      release_bitmap(bmp);
+   /* set up the drawing mode */
+   drawer = _get_scanline_filler(type, &flags, &info, texture, bmp);
+   if (!drawer)
+      return;
+
+   /* sort the vertex indices so that v[i1]->y <= v[i2]->y <= v[i3]->y */
+   if (v[0]->y > v[1]->y) {
+      i1 = 1;
+      i2 = 0;
+   }
+   else {
+      i1 = 0;
+      i2 = 1;
    }
 
+   if (v[i1]->y > v[2]->y) {
+      i3 = i1;
+      i1 = 2;
+   }
+   else
+      i3 = 2;
+
+   if (v[i2]->y > v[i3]->y) {
+      it = i2;
+      i2 = i3;
+      i3 = it;
+   }
+
+   /* the edge joining v[a] and v[b] is edge[a] if b follows a, else edge[b] */
+   #define EDGE_INDEX(a, b)   ((((a) + 1) % 3 == (b)) ? (a) : (b))
+
+   it = EDGE_INDEX(i1, i3);
+   if (!ok[it])
+      return;
+
+   /* set fpu to single-precision, truncate mode */
+   #ifdef ALLEGRO_DOS
+      if (flags & (INTERP_Z | INTERP_FLOAT_UV))
+         old87 = _control87(PC_24 | RC_CHOP, MCW_PC | MCW_RC);
+   #endif
+
+   /* the edges get modified while drawing, so work on copies */
+   edge1 = *edge[it];
+   edge2 = *edge[EDGE_INDEX(i1, i2)];
+   edge3 = *edge[EDGE_INDEX(i2, i3)];
+
+   do_triangle3d_f(bmp, drawer, flags, color, &info, v[i2], &edge1, &edge2, ok[EDGE_INDEX(i1, i2)], &edge3, ok[EDGE_INDEX(i2, i3)]);
+
+   #undef EDGE_INDEX
+
    /* reset fpu mode */
    #ifdef ALLEGRO_DOS
       if (flags & (INTERP_Z | INTERP_FLOAT_UV))
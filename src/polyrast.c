@@ -0,0 +1,779 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Reusable polygon rasteriser: sorted edge tables, direct span
+ *      fills on memory bitmaps and anti-aliased coverage rendering.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* number of sub-scanlines sampled per pixel row by the anti-aliaser */
+#define AA_SUBSAMPLES      8
+#define AA_SUBSHIFT        3
+
+
+
+/* _poly_raster_grow:
+ *  Makes sure a buffer of the raster context holds at least size bytes.
+ *  Returns zero on failure.
+ */
+int _poly_raster_grow(void **buf, int *buf_size, int size)
+{
+   void *p;
+
+   if (size <= *buf_size)
+      return TRUE;
+
+   size = MAX(size, *buf_size * 2);
+
+   p = _AL_REALLOC(*buf, size);
+   if (!p)
+      return FALSE;
+
+   *buf = p;
+   *buf_size = size;
+   return TRUE;
+}
+
+
+
+/* create_polygon_raster:
+ *  Creates a polygon rasteriser context. Its buffers grow as needed and
+ *  are kept between calls, so drawing does not allocate any memory once
+ *  the largest polygon has been seen.
+ */
+POLYGON_RASTER *create_polygon_raster(void)
+{
+   POLYGON_RASTER *pr = _AL_MALLOC(sizeof(POLYGON_RASTER));
+
+   if (pr)
+      memset(pr, 0, sizeof(POLYGON_RASTER));
+
+   return pr;
+}
+
+
+
+/* destroy_polygon_raster:
+ *  Frees a polygon rasteriser context.
+ */
+void destroy_polygon_raster(POLYGON_RASTER *pr)
+{
+   if (!pr)
+      return;
+
+   if (pr->edge)
+      _AL_FREE(pr->edge);
+   if (pr->order)
+      _AL_FREE(pr->order);
+   if (pr->aa_edge)
+      _AL_FREE(pr->aa_edge);
+   if (pr->active)
+      _AL_FREE(pr->active);
+   if (pr->cross)
+      _AL_FREE(pr->cross);
+   if (pr->cover)
+      _AL_FREE(pr->cover);
+
+   _AL_FREE(pr);
+}
+
+
+
+/* solid_span:
+ *  Fills a horizontal span of a memory bitmap in DRAW_MODE_SOLID, writing
+ *  whole words at a time instead of going through the vtable.
+ */
+static void solid_span(BITMAP *bmp, int x1, int y, int x2, int color)
+{
+   int w;
+
+   if (x1 < bmp->cl)
+      x1 = bmp->cl;
+   if (x2 >= bmp->cr)
+      x2 = bmp->cr - 1;
+   if ((x1 > x2) || (y < bmp->ct) || (y >= bmp->cb))
+      return;
+
+   w = x2 - x1 + 1;
+
+   switch (bitmap_color_depth(bmp)) {
+
+      #ifdef ALLEGRO_COLOR8
+	 case 8:
+	    memset(bmp->line[y] + x1, color, w);
+	    break;
+      #endif
+
+      #ifdef ALLEGRO_COLOR16
+	 case 15:
+	 case 16: {
+	    uint16_t *d = (uint16_t *)bmp->line[y] + x1;
+	    uint32_t c2 = (color & 0xFFFF) | ((uint32_t)color << 16);
+	    uint32_t *d2;
+
+	    if (((uintptr_t)d & 2) && (w > 0)) {
+	       *d++ = color;
+	       w--;
+	    }
+
+	    for (d2 = (uint32_t *)d; w >= 2; w -= 2)
+	       *d2++ = c2;
+
+	    if (w)
+	       *(uint16_t *)d2 = color;
+	    break;
+	 }
+      #endif
+
+      #ifdef ALLEGRO_COLOR24
+	 case 24: {
+	    unsigned char *d = bmp->line[y] + x1 * 3;
+
+	    while (w--) {
+	       WRITE3BYTES(d, color);
+	       d += 3;
+	    }
+	    break;
+	 }
+      #endif
+
+      #ifdef ALLEGRO_COLOR32
+	 case 32: {
+	    uint32_t *d = (uint32_t *)bmp->line[y] + x1;
+
+	    while (w--)
+	       *d++ = color;
+	    break;
+	 }
+      #endif
+   }
+}
+
+
+
+/* vtable_span:
+ *  Fills a horizontal span through the bitmap vtable.
+ */
+static void vtable_span(BITMAP *bmp, int x1, int y, int x2, int color)
+{
+   bmp->vtable->hfill(bmp, x1, y, x2, color);
+}
+
+
+
+/* compare_edge_top:
+ *  qsort() callback for the table of edge pointers: sorts by top line, and
+ *  for edges starting on the same line puts the later ones first, which is
+ *  the order polygon() ends up with.
+ */
+static int compare_edge_top(AL_CONST void *e1, AL_CONST void *e2)
+{
+   AL_CONST POLYGON_EDGE *a = *(POLYGON_EDGE * AL_CONST *)e1;
+   AL_CONST POLYGON_EDGE *b = *(POLYGON_EDGE * AL_CONST *)e2;
+
+   if (a->top != b->top)
+      return a->top - b->top;
+
+   return (b < a) ? -1 : ((b > a) ? 1 : 0);
+}
+
+
+
+/* add_active_edge:
+ *  Inserts an edge into the active list, sorted by x.
+ */
+static POLYGON_EDGE *add_active_edge(POLYGON_EDGE *list, POLYGON_EDGE *edge)
+{
+   POLYGON_EDGE *pos = list;
+   POLYGON_EDGE *prev = NULL;
+
+   while ((pos) && (pos->x < edge->x)) {
+      prev = pos;
+      pos = pos->next;
+   }
+
+   edge->next = pos;
+   edge->prev = prev;
+
+   if (pos)
+      pos->prev = edge;
+
+   if (prev) {
+      prev->next = edge;
+      return list;
+   }
+   else
+      return edge;
+}
+
+
+
+/* draw_polygon_edges:
+ *  Scan converts a polygon exactly like polygon() does, except that the
+ *  edges are sorted once instead of being inserted into a list one at a
+ *  time, and the spans are filled with the given function.
+ */
+static void draw_polygon_edges(POLYGON_RASTER *pr, BITMAP *bmp, int vertices, AL_CONST int *points, int color, void (*span)(BITMAP *bmp, int x1, int y, int x2, int color))
+{
+   int c, ne, ni;
+   int top = INT_MAX;
+   int bottom = INT_MIN;
+   AL_CONST int *i1, *i2;
+   POLYGON_EDGE *edge, *next_edge;
+   POLYGON_EDGE *active_edges = NULL;
+
+   if ((!_poly_raster_grow((void **)&pr->edge, &pr->edge_size, sizeof(POLYGON_EDGE) * vertices)) ||
+       (!_poly_raster_grow((void **)&pr->order, &pr->order_size, sizeof(POLYGON_EDGE *) * vertices)))
+      return;
+
+   /* fill the edge table */
+   edge = pr->edge;
+   i1 = points;
+   i2 = points + (vertices-1) * 2;
+
+   for (c=0; c<vertices; c++) {
+      if (i2[1] < i1[1]) {
+	 edge->top = i2[1];
+	 edge->bottom = i1[1];
+	 edge->x = (i2[0] << POLYGON_FIX_SHIFT) + (1 << (POLYGON_FIX_SHIFT-1));
+	 edge->dx = ((i1[0] - i2[0]) << POLYGON_FIX_SHIFT) / (i1[1] - i2[1]);
+      }
+      else {
+	 edge->top = i1[1];
+	 edge->bottom = i2[1];
+	 edge->x = (i1[0] << POLYGON_FIX_SHIFT) + (1 << (POLYGON_FIX_SHIFT-1));
+	 if (i2[1] != i1[1])
+	    edge->dx = ((i2[0] - i1[0]) << POLYGON_FIX_SHIFT) / (i2[1] - i1[1]);
+	 else
+	    edge->dx = ((i2[0] - i1[0]) << POLYGON_FIX_SHIFT) << 1;
+      }
+
+      edge->w = MAX(ABS(edge->dx)-1, 0);
+      if (edge->dx < 0)
+	 edge->x += edge->dx/2;
+
+      if (edge->top < top)
+	 top = edge->top;
+
+      if (edge->bottom > bottom)
+	 bottom = edge->bottom;
+
+      pr->order[c] = edge;
+      edge++;
+      i2 = i1;
+      i1 += 2;
+   }
+
+   ne = vertices;
+   qsort(pr->order, ne, sizeof(POLYGON_EDGE *), compare_edge_top);
+   ni = 0;
+
+   if (bottom >= bmp->cb)
+      bottom = bmp->cb-1;
+
+   /* for each scanline in the polygon... */
+   for (c=top; c<=bottom; c++) {
+      int hid = 0;
+      int b1 = 0;
+      int e1 = 0;
+      int up = 0;
+      int draw = 0;
+      int e;
+
+      /* check for newly active edges */
+      while ((ni < ne) && (pr->order[ni]->top == c))
+	 active_edges = add_active_edge(active_edges, pr->order[ni++]);
+
+      /* draw horizontal line segments */
+      edge = active_edges;
+      while (edge) {
+	 e = edge->w;
+	 if (edge->bottom != c) {
+	    up = 1 - up;
+	 }
+	 else {
+	    e = edge->w >> 1;
+	 }
+
+	 if (edge->top == c) {
+	    e = edge->w >> 1;
+	 }
+
+	 if ((draw < 1) && (up >= 1)) {
+	    b1 = (edge->x + e) >> POLYGON_FIX_SHIFT;
+	 }
+	 else if (draw >= 1) {
+	    /* filling the polygon */
+	    e1 = edge->x >> POLYGON_FIX_SHIFT;
+	    hid = MAX(hid, b1 + 1);
+
+	    if (hid <= e1-1) {
+	       span(bmp, hid, c, e1-1, color);
+	    }
+
+	    b1 = (edge->x + e) >> POLYGON_FIX_SHIFT;
+	 }
+
+	 /* drawing the edge */
+	 hid = MAX(hid, edge->x >> POLYGON_FIX_SHIFT);
+	 if (hid <= ((edge->x + e) >> POLYGON_FIX_SHIFT)) {
+	    span(bmp, hid, c, (edge->x + e) >> POLYGON_FIX_SHIFT, color);
+	    hid = 1 + ((edge->x + e) >> POLYGON_FIX_SHIFT);
+	 }
+
+	 edge = edge->next;
+	 draw = up;
+      }
+
+      /* update edges, sorting and removing dead ones */
+      edge = active_edges;
+      while (edge) {
+	 next_edge = edge->next;
+	 if (c >= edge->bottom) {
+	    active_edges = _remove_edge(active_edges, edge);
+	 }
+	 else {
+	    edge->x += edge->dx;
+	    if ((edge->top == c) && (edge->dx > 0)) {
+	       edge->x -= edge->dx/2;
+	    }
+	    if ((edge->bottom == c+1) && (edge->dx < 0)) {
+	       edge->x -= edge->dx/2;
+	    }
+	    while ((edge->prev) && (edge->x < edge->prev->x)) {
+	       if (edge->next)
+		  edge->next->prev = edge->prev;
+	       edge->prev->next = edge->next;
+	       edge->next = edge->prev;
+	       edge->prev = edge->prev->prev;
+	       edge->next->prev = edge;
+	       if (edge->prev)
+		  edge->prev->next = edge;
+	       else
+		  active_edges = edge;
+	    }
+	 }
+	 edge = next_edge;
+      }
+   }
+}
+
+
+
+/* get_span_filler:
+ *  Picks the fastest way of filling spans on this bitmap.
+ */
+static void (*get_span_filler(BITMAP *bmp))(BITMAP *bmp, int x1, int y, int x2, int color)
+{
+   if ((_drawing_mode == DRAW_MODE_SOLID) && (is_memory_bitmap(bmp)) && (bmp->clip))
+      return solid_span;
+
+   return vtable_span;
+}
+
+
+
+/* raster_polygon:
+ *  Draws a filled polygon, producing exactly the same pixels as polygon().
+ */
+void raster_polygon(POLYGON_RASTER *pr, BITMAP *bmp, int vertices, AL_CONST int *points, int color)
+{
+   ASSERT(pr);
+   ASSERT(bmp);
+   ASSERT(points);
+
+   if (vertices < 1)
+      return;
+
+   acquire_bitmap(bmp);
+   draw_polygon_edges(pr, bmp, vertices, points, color, get_span_filler(bmp));
+   release_bitmap(bmp);
+}
+
+
+
+/* raster_polygons:
+ *  Draws count filled polygons. vertices[i] is the number of corners of
+ *  polygon i, whose points follow those of the previous polygon in the
+ *  points array, and colors[i] is its color.
+ */
+void raster_polygons(POLYGON_RASTER *pr, BITMAP *bmp, int count, AL_CONST int *vertices, AL_CONST int *points, AL_CONST int *colors)
+{
+   void (*span)(BITMAP *bmp, int x1, int y, int x2, int color);
+   int i;
+   ASSERT(pr);
+   ASSERT(bmp);
+   ASSERT(vertices);
+   ASSERT(points);
+   ASSERT(colors);
+
+   span = get_span_filler(bmp);
+
+   acquire_bitmap(bmp);
+
+   for (i=0; i<count; i++) {
+      if (vertices[i] > 0)
+	 draw_polygon_edges(pr, bmp, vertices[i], points, colors[i], span);
+
+      points += vertices[i] * 2;
+   }
+
+   release_bitmap(bmp);
+}
+
+
+
+/* compare_aa_edge:
+ *  qsort() callback sorting anti-aliased edges by their first sub-scanline.
+ */
+static int compare_aa_edge(AL_CONST void *e1, AL_CONST void *e2)
+{
+   AL_CONST POLY_AA_EDGE *a = e1;
+   AL_CONST POLY_AA_EDGE *b = e2;
+
+   return (a->top > b->top) - (a->top < b->top);
+}
+
+
+
+/* add_aa_span:
+ *  Adds the coverage of the span [xa, xb) on one sub-scanline, measured in
+ *  1/256ths of a pixel, to the coverage buffer. Whole pixels go into a
+ *  difference array so that long spans cost no more than short ones.
+ */
+static void add_aa_span(POLYGON_RASTER *pr, int xa, int xb)
+{
+   int *part = pr->cover;
+   int *diff = pr->cover + pr->cover_w + 1;
+   int ia, ib;
+
+   if (xa < 0)
+      xa = 0;
+   if (xb > (pr->cover_w << 8))
+      xb = pr->cover_w << 8;
+   if (xa >= xb)
+      return;
+
+   ia = xa >> 8;
+   ib = xb >> 8;
+
+   if (ia == ib) {
+      part[ia] += xb - xa;
+   }
+   else {
+      part[ia] += 256 - (xa & 255);
+      diff[ia+1] += 256;
+      diff[ib] -= 256;
+      part[ib] += xb & 255;
+   }
+
+   if (ia < pr->cover_min)
+      pr->cover_min = ia;
+   if (ib > pr->cover_max)
+      pr->cover_max = ib;
+}
+
+
+
+/* blend_aa_row:
+ *  Writes the accumulated coverage of one pixel row to the bitmap, and
+ *  clears the coverage buffer for the next one.
+ */
+static void blend_aa_row(POLYGON_RASTER *pr, BITMAP *bmp, int y, int color)
+{
+   int *part = pr->cover;
+   int *diff = pr->cover + pr->cover_w + 1;
+   int x, a, run = 0;
+   int x1 = pr->cover_min;
+   int x2 = MIN(pr->cover_max, pr->cover_w - 1);
+   int depth = bitmap_color_depth(bmp);
+   int direct = is_memory_bitmap(bmp);
+   unsigned long (*blend)(unsigned long x, unsigned long y, unsigned long n);
+
+   switch (depth) {
+      case 15: blend = _blender_trans15; break;
+      case 16: blend = _blender_trans16; break;
+      default: blend = _blender_trans24; break;
+   }
+
+   for (x=x1; x<=x2; x++) {
+      run += diff[x];
+      a = (run + part[x]) >> AA_SUBSHIFT;
+
+      if (a > 0) {
+	 if (depth == 8) {
+	    /* no way to blend with a palette, so just threshold */
+	    if (a >= 128)
+	       putpixel(bmp, pr->cover_x + x, y, color);
+	 }
+	 else if (direct) {
+	    int bx = pr->cover_x + x;
+
+	    switch (depth) {
+
+	       #ifdef ALLEGRO_COLOR16
+		  case 15:
+		  case 16: {
+		     uint16_t *d = (uint16_t *)bmp->line[y] + bx;
+		     *d = (a >= 256) ? (unsigned long)color : blend(color, *d, a);
+		     break;
+		  }
+	       #endif
+
+	       #ifdef ALLEGRO_COLOR24
+		  case 24: {
+		     unsigned char *d = bmp->line[y] + bx * 3;
+		     unsigned long c = (a >= 256) ? (unsigned long)color : blend(color, READ3BYTES(d), a);
+		     WRITE3BYTES(d, c);
+		     break;
+		  }
+	       #endif
+
+	       #ifdef ALLEGRO_COLOR32
+		  case 32: {
+		     uint32_t *d = (uint32_t *)bmp->line[y] + bx;
+		     *d = (a >= 256) ? (uint32_t)color : blend(color, *d, a);
+		     break;
+		  }
+	       #endif
+	    }
+	 }
+	 else {
+	    int bx = pr->cover_x + x;
+
+	    if (a >= 256)
+	       putpixel(bmp, bx, y, color);
+	    else
+	       putpixel(bmp, bx, y, blend(color, getpixel(bmp, bx, y), a));
+	 }
+      }
+
+      part[x] = 0;
+      diff[x] = 0;
+   }
+
+   diff[x2+1] = 0;
+
+   pr->cover_min = INT_MAX;
+   pr->cover_max = INT_MIN;
+}
+
+
+
+/* _poly_raster_aa:
+ *  Renders an anti-aliased path made of several closed contours, using the
+ *  non-zero winding rule. counts[i] is the number of points in contour i,
+ *  and points holds their x, y coordinates in fixed point. Each pixel row
+ *  is sampled on AA_SUBSAMPLES sub-scanlines, with exact horizontal
+ *  coverage on each of them, and the result is blended onto the bitmap.
+ */
+void _poly_raster_aa(POLYGON_RASTER *pr, BITMAP *bmp, int contours, AL_CONST int *counts, AL_CONST fixed *points, int color)
+{
+   POLY_AA_EDGE *edge, *e;
+   int *active;
+   int i, j, n, ne, na, ni, total;
+   int k, k_end, y, sub, wind, start, xa;
+   int cl, cr, ct, cb;
+   int prev_drawmode = _drawing_mode;
+   AL_CONST fixed *p1, *p2;
+
+   if (bmp->clip) {
+      cl = bmp->cl;
+      cr = bmp->cr;
+      ct = bmp->ct;
+      cb = bmp->cb;
+   }
+   else {
+      cl = 0;
+      cr = bmp->w;
+      ct = 0;
+      cb = bmp->h;
+   }
+
+   if ((cl >= cr) || (ct >= cb))
+      return;
+
+   for (i=0, total=0; i<contours; i++)
+      total += counts[i];
+
+   if ((!_poly_raster_grow((void **)&pr->aa_edge, &pr->aa_edge_size, sizeof(POLY_AA_EDGE) * total)) ||
+       (!_poly_raster_grow((void **)&pr->active, &pr->active_size, sizeof(int) * total)) ||
+       (!_poly_raster_grow((void **)&pr->cross, &pr->cross_size, sizeof(int) * 2 * total)) ||
+       (!_poly_raster_grow((void **)&pr->cover, &pr->cover_size, sizeof(int) * 2 * (cr - cl + 2))))
+      return;
+
+   /* set up the edge table, in sub-scanline units */
+   edge = pr->aa_edge;
+   ne = 0;
+   k_end = INT_MIN;
+
+   for (i=0; i<contours; i++) {
+      n = counts[i];
+      p1 = points + (n-1) * 2;
+
+      for (j=0; j<n; j++) {
+	 double x0, y0, x1, y1, slope;
+
+	 p2 = points + j * 2;
+
+	 if (p1[1] != p2[1]) {
+	    e = edge + ne;
+
+	    if (p1[1] < p2[1]) {
+	       x0 = fixtof(p1[0]); y0 = fixtof(p1[1]);
+	       x1 = fixtof(p2[0]); y1 = fixtof(p2[1]);
+	       e->dir = 1;
+	    }
+	    else {
+	       x0 = fixtof(p2[0]); y0 = fixtof(p2[1]);
+	       x1 = fixtof(p1[0]); y1 = fixtof(p1[1]);
+	       e->dir = -1;
+	    }
+
+	    /* sub-scanline k samples the row at y = (k + 0.5) / AA_SUBSAMPLES */
+	    e->top = (int)ceil(y0 * AA_SUBSAMPLES - 0.5);
+	    e->bottom = (int)ceil(y1 * AA_SUBSAMPLES - 0.5);
+
+	    if (e->top < ct * AA_SUBSAMPLES)
+	       e->top = ct * AA_SUBSAMPLES;
+
+	    if (e->bottom > cb * AA_SUBSAMPLES)
+	       e->bottom = cb * AA_SUBSAMPLES;
+
+	    if (e->top < e->bottom) {
+	       slope = (x1 - x0) / (y1 - y0);
+	       e->x = (int)floor(((x0 + (((e->top + 0.5) / AA_SUBSAMPLES) - y0) * slope) - cl) * 65536.0 + 0.5);
+	       e->dx = (int)floor(slope / AA_SUBSAMPLES * 65536.0 + 0.5);
+
+	       if (e->bottom > k_end)
+		  k_end = e->bottom;
+
+	       ne++;
+	    }
+	 }
+
+	 p1 = p2;
+      }
+
+      points += n * 2;
+   }
+
+   if (!ne)
+      return;
+
+   qsort(edge, ne, sizeof(POLY_AA_EDGE), compare_aa_edge);
+
+   pr->cover_x = cl;
+   pr->cover_w = cr - cl;
+   pr->cover_min = INT_MAX;
+   pr->cover_max = INT_MIN;
+   memset(pr->cover, 0, sizeof(int) * 2 * (cr - cl + 2));
+
+   active = pr->active;
+   na = 0;
+   ni = 0;
+
+   acquire_bitmap(bmp);
+
+   /* the drawing mode is ignored, even where we go through putpixel() */
+   _drawing_mode = DRAW_MODE_SOLID;
+
+   /* walk the sub-scanlines, one pixel row at a time */
+   k = edge[0].top & ~(AA_SUBSAMPLES-1);
+
+   while (k < k_end) {
+      y = k >> AA_SUBSHIFT;
+
+      for (sub=0; sub<AA_SUBSAMPLES; sub++, k++) {
+	 int *cross = pr->cross;
+	 int nc = 0;
+
+	 /* newly active edges */
+	 while ((ni < ne) && (edge[ni].top <= k))
+	    active[na++] = ni++;
+
+	 /* collect the crossings, dropping the edges that have ended */
+	 for (i=0; i<na; ) {
+	    e = edge + active[i];
+
+	    if (e->bottom <= k) {
+	       active[i] = active[--na];
+	       continue;
+	    }
+
+	    /* insertion sort on x, which hardly ever has to move anything */
+	    for (j=nc; (j > 0) && (cross[(j-1)*2] > e->x); j--) {
+	       cross[j*2] = cross[(j-1)*2];
+	       cross[j*2+1] = cross[(j-1)*2+1];
+	    }
+
+	    cross[j*2] = e->x;
+	    cross[j*2+1] = e->dir;
+	    nc++;
+
+	    e->x += e->dx;
+	    i++;
+	 }
+
+	 /* turn the crossings into spans with the non-zero winding rule */
+	 wind = 0;
+	 start = 0;
+
+	 for (i=0; i<nc; i++) {
+	    xa = cross[i*2] >> 8;
+
+	    if (!wind)
+	       start = xa;
+
+	    wind += cross[i*2+1];
+
+	    if (!wind)
+	       add_aa_span(pr, start, xa);
+	 }
+      }
+
+      if (pr->cover_min <= pr->cover_max)
+	 blend_aa_row(pr, bmp, y, color);
+   }
+
+   _drawing_mode = prev_drawmode;
+
+   bmp_unwrite_line(bmp);
+   release_bitmap(bmp);
+}
+
+
+
+/* raster_polygon_aa:
+ *  Draws an anti-aliased filled polygon with sub-pixel (fixed point)
+ *  coordinates. Pixel (x, y) is the square from (x, y) to (x+1, y+1).
+ */
+void raster_polygon_aa(POLYGON_RASTER *pr, BITMAP *bmp, int vertices, AL_CONST fixed *points, int color)
+{
+   ASSERT(pr);
+   ASSERT(bmp);
+   ASSERT(points);
+
+   if (vertices < 3)
+      return;
+
+   _poly_raster_aa(pr, bmp, 1, &vertices, points, color);
+}
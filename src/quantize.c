@@ -33,6 +33,7 @@
  */
 
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -520,3 +521,603 @@ int generate_optimized_palette(BITMAP *image, PALETTE pal, AL_CONST signed char
    return generate_optimized_palette_ex(image, pal, rsvdcols, DEFAULT_PREC, DEFAULT_FRACTION, DEFAULT_MAXSWAPS, DEFAULT_MINDIFF);
 }
 
+
+
+
+/* The median cut quantizer works on a histogram with the same 6 bits per
+ * component as the palette itself. The box holding the largest weighted
+ * squared error is split at the median of its pixels along the axis where
+ * it varies most, until there are as many boxes as free palette entries,
+ * and each box then becomes the mean of the pixels that fell into it.
+ * Every pass is linear in the number of pixels or histogram cells, so
+ * even large images take milliseconds rather than seconds.
+ */
+#define MC_CELLS           (64*64*64)
+#define MC_CELL(r, g, b)   (((r) << 12) | ((g) << 6) | (b))
+
+
+typedef struct MC_BOX {
+   int lo[3], hi[3];          /* inclusive bounds, shrunk to the pixels */
+   double count;
+   double mean[3];
+   double error;              /* weighted squared distance to the mean */
+   int axis;                  /* where to split it, -1 for a single cell */
+   int split;                 /* last value of the lower half */
+} MC_BOX;
+
+
+/* the same weights as bestfit_color(), in red, green, blue order */
+static AL_CONST int mc_weight[3] = { 30*30, 59*59, 11*11 };
+
+
+
+/* mc_read_row:
+ *  Reads w pixels of a bitmap line as 8 bit red, green and blue triplets.
+ *  If mask is not NULL, it is set for the pixels of the mask color.
+ */
+static void mc_read_row(BITMAP *bmp, int y, int w, int *rgb, unsigned char *mask)
+{
+   int depth = bitmap_color_depth(bmp);
+   int mask_color = bitmap_mask_color(bmp);
+   uintptr_t s;
+   int x, c;
+
+   s = bmp_read_line(bmp, y);
+   bmp_select(bmp);
+
+   for (x=0; x<w; x++) {
+      switch (depth) {
+
+	 case 8:
+	    c = bmp_read8(s + x);
+	    rgb[0] = getr8(c);
+	    rgb[1] = getg8(c);
+	    rgb[2] = getb8(c);
+	    break;
+
+	 case 15:
+	    c = bmp_read15(s + x*sizeof(short));
+	    rgb[0] = getr15(c);
+	    rgb[1] = getg15(c);
+	    rgb[2] = getb15(c);
+	    break;
+
+	 case 16:
+	    c = bmp_read16(s + x*sizeof(short));
+	    rgb[0] = getr16(c);
+	    rgb[1] = getg16(c);
+	    rgb[2] = getb16(c);
+	    break;
+
+	 case 24:
+	    c = bmp_read24(s + x*3);
+	    rgb[0] = getr24(c);
+	    rgb[1] = getg24(c);
+	    rgb[2] = getb24(c);
+	    break;
+
+	 default:
+	    c = bmp_read32(s + x*sizeof(int32_t));
+	    rgb[0] = getr32(c);
+	    rgb[1] = getg32(c);
+	    rgb[2] = getb32(c);
+	    break;
+      }
+
+      if (mask)
+	 mask[x] = (c == mask_color);
+
+      rgb += 3;
+   }
+
+   bmp_unwrite_line(bmp);
+}
+
+
+
+/* mc_fit_box:
+ *  Shrinks a box to the cells of the histogram it really uses, and works
+ *  out its mean, its error and where it should be split.
+ */
+static void mc_fit_box(AL_CONST unsigned int *hist, MC_BOX *box)
+{
+   double sum[3], sum2[3], marg[3][64];
+   int lo[3], hi[3];
+   double n, v, best;
+   unsigned int k;
+   int r, g, b, i, c;
+
+   n = 0;
+
+   for (i=0; i<3; i++) {
+      sum[i] = sum2[i] = 0;
+      lo[i] = 63;
+      hi[i] = 0;
+      memset(marg[i], 0, sizeof(marg[i]));
+   }
+
+   for (r=box->lo[0]; r<=box->hi[0]; r++) {
+      for (g=box->lo[1]; g<=box->hi[1]; g++) {
+	 AL_CONST unsigned int *cell = hist + MC_CELL(r, g, 0);
+
+	 for (b=box->lo[2]; b<=box->hi[2]; b++) {
+	    k = cell[b];
+	    if (!k)
+	       continue;
+
+	    n += k;
+	    marg[0][r] += k;
+	    marg[1][g] += k;
+	    marg[2][b] += k;
+
+	    if (r < lo[0]) lo[0] = r;
+	    if (r > hi[0]) hi[0] = r;
+	    if (g < lo[1]) lo[1] = g;
+	    if (g > hi[1]) hi[1] = g;
+	    if (b < lo[2]) lo[2] = b;
+	    if (b > hi[2]) hi[2] = b;
+	 }
+      }
+   }
+
+   box->count = n;
+   box->error = 0;
+   box->axis = -1;
+
+   if (n == 0)
+      return;
+
+   /* the marginals are enough for the per axis sums and variances */
+   for (i=0; i<3; i++) {
+      for (c=lo[i]; c<=hi[i]; c++) {
+	 sum[i] += marg[i][c] * c;
+	 sum2[i] += marg[i][c] * c * c;
+      }
+
+      box->lo[i] = lo[i];
+      box->hi[i] = hi[i];
+      box->mean[i] = sum[i] / n;
+   }
+
+   best = -1;
+
+   for (i=0; i<3; i++) {
+      v = (sum2[i] - sum[i] * sum[i] / n) * mc_weight[i];
+      box->error += v;
+
+      if ((hi[i] > lo[i]) && (v > best)) {
+	 best = v;
+	 box->axis = i;
+      }
+   }
+
+   if (box->axis < 0)
+      return;
+
+   /* split at the median, leaving at least one value on either side */
+   i = box->axis;
+   v = 0;
+
+   for (c=lo[i]; c<hi[i]-1; c++) {
+      v += marg[i][c];
+      if (v * 2 >= n)
+	 break;
+   }
+
+   box->split = c;
+}
+
+
+
+/* generate_median_cut_palette:
+ *  Median cut version of generate_optimized_palette(), with the same
+ *  meaning for the reserved colors and the return value.
+ */
+int generate_median_cut_palette(BITMAP *image, PALETTE pal, AL_CONST signed char rsvdcols[PAL_SIZE])
+{
+   MC_BOX box[PAL_SIZE];
+   signed char tmprsvd[PAL_SIZE];
+   unsigned int *hist;
+   int *rgb, *p;
+   int i, j, x, y, boxes, freecnt, count;
+   double worst;
+   ASSERT(image);
+
+   if (bitmap_color_depth(image) == 8)
+      return 0;
+
+   hist = _AL_MALLOC(MC_CELLS * sizeof(unsigned int));
+   rgb = _AL_MALLOC(image->w * 3 * sizeof(int));
+
+   if ((!hist) || (!rgb)) {
+      if (hist)
+	 _AL_FREE(hist);
+      if (rgb)
+	 _AL_FREE(rgb);
+      return 0;
+   }
+
+   if (!rsvdcols) {
+      pal[0].r = 63;
+      pal[0].g = 0;
+      pal[0].b = 63;
+
+      tmprsvd[0] = 1;
+      for (i=1; i<PAL_SIZE; i++)
+	 tmprsvd[i] = 0;
+
+      rsvdcols = tmprsvd;
+   }
+
+   /* fix palette */
+   for (i=0; i<PAL_SIZE; i++) {
+      pal[i].r &= 0x3F;
+      pal[i].g &= 0x3F;
+      pal[i].b &= 0x3F;
+   }
+
+   /* fill the histogram */
+   memset(hist, 0, MC_CELLS * sizeof(unsigned int));
+
+   for (y=0; y<image->h; y++) {
+      mc_read_row(image, y, image->w, rgb, NULL);
+
+      for (x=0, p=rgb; x<image->w; x++, p+=3)
+	 hist[MC_CELL(p[0] >> 2, p[1] >> 2, p[2] >> 2)]++;
+   }
+
+   _AL_FREE(rgb);
+
+   count = 0;
+   for (i=0; i<MC_CELLS; i++)
+      if (hist[i])
+	 count++;
+
+   /* pixels that fixed palette entries already match exactly don't need
+    * any more colors
+    */
+   freecnt = 0;
+
+   for (i=0; i<PAL_SIZE; i++) {
+      if (rsvdcols[i] > 0)
+	 hist[MC_CELL(pal[i].r, pal[i].g, pal[i].b)] = 0;
+      else if (!rsvdcols[i])
+	 freecnt++;
+   }
+
+   boxes = 0;
+
+   if (freecnt > 0) {
+      for (i=0; i<3; i++) {
+	 box[0].lo[i] = 0;
+	 box[0].hi[i] = 63;
+      }
+
+      mc_fit_box(hist, &box[0]);
+      if (box[0].count > 0)
+	 boxes = 1;
+
+      while (boxes < freecnt) {
+	 j = -1;
+	 worst = -1;
+
+	 for (i=0; i<boxes; i++) {
+	    if ((box[i].axis >= 0) && (box[i].error > worst)) {
+	       worst = box[i].error;
+	       j = i;
+	    }
+	 }
+
+	 if (j < 0)
+	    break;
+
+	 box[boxes] = box[j];
+	 box[j].hi[box[j].axis] = box[j].split;
+	 box[boxes].lo[box[j].axis] = box[j].split + 1;
+
+	 mc_fit_box(hist, &box[j]);
+	 mc_fit_box(hist, &box[boxes]);
+
+	 boxes++;
+      }
+   }
+
+   _AL_FREE(hist);
+
+   /* copy the boxes to 'pal', skipping 'rsvd' */
+   for (i=0, j=0; i<boxes; j++) {
+      if (!rsvdcols[j]) {
+	 pal[j].r = (int)(box[i].mean[0] + 0.5);
+	 pal[j].g = (int)(box[i].mean[1] + 0.5);
+	 pal[j].b = (int)(box[i].mean[2] + 0.5);
+	 i++;
+      }
+   }
+
+   return count;
+}
+
+
+
+/* Nearest color searches for remap_to_palette(). Colors 1-255 are kept in
+ * an implicit k-d tree: each range of the array is sorted along the axis
+ * where its colors spread the most and its middle element splits it in
+ * two. Answers are remembered, since images repeat the same colors over
+ * and over, and are always exactly what bestfit_color() would return.
+ */
+typedef struct PAL_TREE {
+   int col[PAL_SIZE][3];
+   unsigned char idx[PAL_SIZE-1];      /* colors 1-255 in tree order */
+   unsigned char axis[PAL_SIZE-1];
+   unsigned char memo[MC_CELLS];
+   unsigned char known[MC_CELLS/8];
+} PAL_TREE;
+
+
+
+/* pal_tree_build:
+ *  Turns the range lo - hi of the index array into a subtree.
+ */
+static void pal_tree_build(PAL_TREE *tree, int lo, int hi)
+{
+   int min[3], max[3];
+   int i, j, a, m, v, t;
+
+   while (hi - lo > 1) {
+      for (a=0; a<3; a++) {
+	 min[a] = 255;
+	 max[a] = 0;
+      }
+
+      for (i=lo; i<hi; i++) {
+	 for (a=0; a<3; a++) {
+	    v = tree->col[tree->idx[i]][a];
+	    if (v < min[a]) min[a] = v;
+	    if (v > max[a]) max[a] = v;
+	 }
+      }
+
+      m = 0;
+      for (a=1; a<3; a++) {
+	 if ((max[a] - min[a]) * (max[a] - min[a]) * mc_weight[a] >
+	     (max[m] - min[m]) * (max[m] - min[m]) * mc_weight[m])
+	    m = a;
+      }
+
+      /* insertion sort, there are at most 255 colors */
+      for (i=lo+1; i<hi; i++) {
+	 t = tree->idx[i];
+	 v = tree->col[t][m];
+
+	 for (j=i; (j > lo) && (tree->col[tree->idx[j-1]][m] > v); j--)
+	    tree->idx[j] = tree->idx[j-1];
+
+	 tree->idx[j] = t;
+      }
+
+      i = (lo + hi) / 2;
+      tree->axis[i] = m;
+
+      pal_tree_build(tree, lo, i);
+      lo = i + 1;
+   }
+}
+
+
+
+/* pal_tree_create:
+ *  Builds the search tree for a palette.
+ */
+static PAL_TREE *pal_tree_create(AL_CONST PALETTE pal)
+{
+   PAL_TREE *tree;
+   int i;
+
+   tree = _AL_MALLOC(sizeof(PAL_TREE));
+   if (!tree)
+      return NULL;
+
+   for (i=0; i<PAL_SIZE; i++) {
+      tree->col[i][0] = pal[i].r;
+      tree->col[i][1] = pal[i].g;
+      tree->col[i][2] = pal[i].b;
+   }
+
+   for (i=0; i<PAL_SIZE-1; i++) {
+      tree->idx[i] = i+1;
+      tree->axis[i] = 0;
+   }
+
+   pal_tree_build(tree, 0, PAL_SIZE-1);
+
+   memset(tree->known, 0, sizeof(tree->known));
+
+   return tree;
+}
+
+
+
+/* pal_tree_search:
+ *  Looks for a closer color than *bestfit in the range lo - hi of the tree.
+ */
+static void pal_tree_search(PAL_TREE *tree, int lo, int hi, AL_CONST int *c, int *bestfit, int *lowest)
+{
+   AL_CONST int *p;
+   int i, m, a, d, dist;
+
+   while (lo < hi) {
+      m = (lo + hi) / 2;
+      i = tree->idx[m];
+      p = tree->col[i];
+
+      dist = (p[0] - c[0]) * (p[0] - c[0]) * mc_weight[0] +
+	     (p[1] - c[1]) * (p[1] - c[1]) * mc_weight[1] +
+	     (p[2] - c[2]) * (p[2] - c[2]) * mc_weight[2];
+
+      /* on ties the lower index wins, like in the linear search */
+      if ((dist < *lowest) || ((dist == *lowest) && (i < *bestfit))) {
+	 *lowest = dist;
+	 *bestfit = i;
+      }
+
+      a = tree->axis[m];
+      d = c[a] - p[a];
+
+      /* the near side first, then the far one if it can still compete */
+      if (d < 0) {
+	 pal_tree_search(tree, lo, m, c, bestfit, lowest);
+	 if (d * d * mc_weight[a] > *lowest)
+	    return;
+	 lo = m + 1;
+      }
+      else {
+	 pal_tree_search(tree, m+1, hi, c, bestfit, lowest);
+	 if (d * d * mc_weight[a] > *lowest)
+	    return;
+	 hi = m;
+      }
+   }
+}
+
+
+
+/* pal_tree_find:
+ *  Returns the palette index closest to a 6 bit color.
+ */
+static INLINE int pal_tree_find(PAL_TREE *tree, int r, int g, int b)
+{
+   int key = MC_CELL(r, g, b);
+   int c[3], bestfit, lowest;
+
+   if (tree->known[key >> 3] & (1 << (key & 7)))
+      return tree->memo[key];
+
+   c[0] = r;
+   c[1] = g;
+   c[2] = b;
+
+   bestfit = 0;
+   lowest = INT_MAX;
+
+   /* only the transparent (pink) color can be mapped to index 0 */
+   if ((r == 63) && (g == 0) && (b == 63)) {
+      lowest = (tree->col[0][0] - r) * (tree->col[0][0] - r) * mc_weight[0] +
+	       (tree->col[0][1] - g) * (tree->col[0][1] - g) * mc_weight[1] +
+	       (tree->col[0][2] - b) * (tree->col[0][2] - b) * mc_weight[2];
+   }
+
+   pal_tree_search(tree, 0, PAL_SIZE-1, c, &bestfit, &lowest);
+
+   tree->memo[key] = bestfit;
+   tree->known[key >> 3] |= 1 << (key & 7);
+
+   return bestfit;
+}
+
+
+
+/* remap_to_palette:
+ *  Converts an image to 8 bit colors from the given palette, optionally
+ *  with Floyd-Steinberg error diffusion.
+ */
+void remap_to_palette(BITMAP *src, BITMAP *dest, AL_CONST PALETTE pal, int dither)
+{
+   PAL_TREE *tree;
+   unsigned char *mask;
+   int *rgb, *err, *cur, *next, *p, *e;
+   int x, y, i, n, w, h, dir, c, v[3], d[3];
+   uintptr_t addr;
+   ASSERT(src);
+   ASSERT(dest);
+   ASSERT(bitmap_color_depth(dest) == 8);
+
+   w = MIN(src->w, dest->w);
+   h = MIN(src->h, dest->h);
+
+   if ((w <= 0) || (h <= 0))
+      return;
+
+   tree = pal_tree_create(pal);
+   rgb = _AL_MALLOC(w * 3 * sizeof(int));
+   mask = _AL_MALLOC(w);
+   err = (dither) ? _AL_MALLOC((w+2) * 3 * 2 * sizeof(int)) : NULL;
+
+   if ((!tree) || (!rgb) || (!mask) || ((dither) && (!err)))
+      goto getout;
+
+   /* error rows, with room for a pixel on either side */
+   if (dither)
+      memset(err, 0, (w+2) * 3 * 2 * sizeof(int));
+
+   cur = err;
+   next = (err) ? err + (w+2) * 3 : NULL;
+
+   for (y=0; y<h; y++) {
+      mc_read_row(src, y, w, rgb, mask);
+
+      addr = bmp_write_line(dest, y);
+      bmp_select(dest);
+
+      if (!dither) {
+	 for (x=0, p=rgb; x<w; x++, p+=3) {
+	    if (mask[x])
+	       c = 0;
+	    else
+	       c = pal_tree_find(tree, p[0] >> 2, p[1] >> 2, p[2] >> 2);
+
+	    bmp_write8(addr + x, c);
+	 }
+      }
+      else {
+	 /* serpentine scan, so the errors don't all drift the same way */
+	 dir = (y & 1) ? -1 : 1;
+	 x = (y & 1) ? w-1 : 0;
+
+	 memset(next, 0, (w+2) * 3 * sizeof(int));
+
+	 for (n=0; n<w; n++, x+=dir) {
+	    if (mask[x]) {
+	       bmp_write8(addr + x, 0);
+	       continue;
+	    }
+
+	    p = rgb + x*3;
+	    e = cur + (x+1)*3;
+
+	    for (i=0; i<3; i++)
+	       v[i] = MID(0, p[i] + e[i] / 16, 255);
+
+	    c = pal_tree_find(tree, v[0] >> 2, v[1] >> 2, v[2] >> 2);
+	    bmp_write8(addr + x, c);
+
+	    d[0] = v[0] - _rgb_scale_6[tree->col[c][0]];
+	    d[1] = v[1] - _rgb_scale_6[tree->col[c][1]];
+	    d[2] = v[2] - _rgb_scale_6[tree->col[c][2]];
+
+	    for (i=0; i<3; i++) {
+	       (cur + (x+1+dir)*3)[i] += d[i] * 7;
+	       (next + (x+1-dir)*3)[i] += d[i] * 3;
+	       (next + (x+1)*3)[i] += d[i] * 5;
+	       (next + (x+1+dir)*3)[i] += d[i];
+	    }
+	 }
+
+	 e = cur;
+	 cur = next;
+	 next = e;
+      }
+
+      bmp_unwrite_line(dest);
+   }
+
+ getout:
+
+   if (err)
+      _AL_FREE(err);
+   if (mask)
+      _AL_FREE(mask);
+   if (rgb)
+      _AL_FREE(rgb);
+   if (tree)
+      _AL_FREE(tree);
+}
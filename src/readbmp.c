@@ -28,6 +28,7 @@ typedef struct BITMAP_TYPE_INFO
    char *ext;
    BITMAP *(*load)(AL_CONST char *filename, RGB *pal);
    int (*save)(AL_CONST char *filename, BITMAP *bmp, AL_CONST RGB *pal);
+   int (*load_lines)(AL_CONST char *filename, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp);
    struct BITMAP_TYPE_INFO *next;
 } BITMAP_TYPE_INFO;
 
@@ -57,6 +58,7 @@ void register_bitmap_file_type(AL_CONST char *ext, BITMAP *(*load)(AL_CONST char
    if (iter) {
       iter->load = load;
       iter->save = save;
+      iter->load_lines = NULL;
       iter->ext = _al_strdup(aext);
       iter->next = NULL;
    }
@@ -64,6 +66,35 @@ void register_bitmap_file_type(AL_CONST char *ext, BITMAP *(*load)(AL_CONST char
 
 
 
+/* register_bitmap_file_lines:
+ *  Tells Allegro how to read files of an image type a line at a time, for
+ *  load_bitmap_lines(). Types without such a function are loaded whole.
+ */
+void register_bitmap_file_lines(AL_CONST char *ext, int (*load_lines)(AL_CONST char *filename, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp))
+{
+   char tmp[32], *aext;
+   BITMAP_TYPE_INFO *iter, *last = NULL;
+
+   aext = uconvert_toascii(ext, tmp);
+   if (strlen(aext) == 0) return;
+
+   for (iter = bitmap_type_list; iter; iter = iter->next) {
+      if (stricmp(iter->ext, aext) == 0) {
+	 iter->load_lines = load_lines;
+	 return;
+      }
+      last = iter;
+   }
+
+   register_bitmap_file_type(ext, NULL, NULL);
+
+   iter = (last) ? last->next : bitmap_type_list;
+   if (iter)
+      iter->load_lines = load_lines;
+}
+
+
+
 /* load_bitmap:
  *  Loads a bitmap from disk.
  */
@@ -88,6 +119,78 @@ BITMAP *load_bitmap(AL_CONST char *filename, RGB *pal)
 
 
 
+/* load_bitmap_lines:
+ *  Reads an image from disk a line at a time, passing each line to the
+ *  callback as a one pixel high bitmap in the color depth of the file.
+ */
+int load_bitmap_lines(AL_CONST char *filename, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   char tmp[32], *aext;
+   BITMAP_TYPE_INFO *iter;
+   BITMAP *bmp;
+   int conv, ret;
+   ASSERT(filename);
+   ASSERT(callback);
+
+   aext = uconvert_toascii(get_extension(filename), tmp);
+
+   for (iter = bitmap_type_list; iter; iter = iter->next) {
+      if (stricmp(iter->ext, aext) == 0) {
+	 if (iter->load_lines)
+	    return iter->load_lines(filename, pal, callback, dp);
+
+	 if (!iter->load)
+	    return -1;
+
+	 /* no streaming reader: load it whole, in its own color depth */
+	 conv = get_color_conversion();
+	 set_color_conversion(COLORCONV_NONE);
+	 bmp = iter->load(filename, pal);
+	 set_color_conversion(conv);
+
+	 if (!bmp)
+	    return -1;
+
+	 ret = _feed_bitmap_lines(bmp, callback, dp);
+	 destroy_bitmap(bmp);
+
+	 return ret;
+      }
+   }
+
+   return -1;
+}
+
+
+
+/* _feed_bitmap_lines:
+ *  Passes the lines of a whole bitmap to a load_bitmap_lines() callback,
+ *  for the image types that can't be read a line at a time.
+ */
+int _feed_bitmap_lines(BITMAP *bmp, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   BITMAP *line;
+   int y, ret = 0;
+
+   line = create_bitmap_ex(bitmap_color_depth(bmp), bmp->w, 1);
+   if (!line)
+      return -1;
+
+   for (y=0; y<bmp->h; y++) {
+      blit(bmp, line, 0, y, 0, 0, bmp->w, 1);
+
+      ret = callback(line, y, bmp->h, dp);
+      if (ret)
+	 break;
+   }
+
+   destroy_bitmap(line);
+
+   return ret;
+}
+
+
+
 /* save_bitmap:
  *  Writes a bitmap to disk.
  */
@@ -210,6 +313,9 @@ void _register_bitmap_file_type_init(void)
    register_bitmap_file_type(uconvert_ascii("lbm", buf), load_lbm, NULL);
    register_bitmap_file_type(uconvert_ascii("pcx", buf), load_pcx, save_pcx);
    register_bitmap_file_type(uconvert_ascii("tga", buf), load_tga, save_tga);
+
+   register_bitmap_file_lines(uconvert_ascii("bmp", buf), load_bmp_lines);
+   register_bitmap_file_lines(uconvert_ascii("tga", buf), load_tga_lines);
 }
 
 
@@ -0,0 +1,344 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Sample format conversion, with a band-limited resampler so that
+ *      samples can be brought to the mixing frequency once, at load time,
+ *      rather than every time they are played.
+ *
+ *      See readme.txt for copyright information.
+ */
+
+
+#include <math.h>
+
+#include "allegro.h"
+#include "allegro/internal/aintern.h"
+
+
+
+/* The resampler convolves the input with a Kaiser windowed sinc, reaching
+ * out this many zero crossings either side of each output sample. The
+ * kernel is tabulated at RESAMPLE_TABLE_RES points per zero crossing and
+ * linearly interpolated between them.
+ */
+#define RESAMPLE_ZERO_CROSSINGS  16
+#define RESAMPLE_TABLE_RES       256
+#define RESAMPLE_TABLE_SIZE      (RESAMPLE_ZERO_CROSSINGS * RESAMPLE_TABLE_RES + 2)
+#define RESAMPLE_KAISER_BETA     8.0
+
+/* cutoff, as a fraction of the lower of the two Nyquist frequencies */
+#define RESAMPLE_ROLLOFF         0.95
+
+
+/* format that load_wav() and load_voc() convert to (-1 to keep as is) */
+static int load_bits = -1;
+static int load_stereo = -1;
+static int load_freq = -1;
+
+
+
+/* bessel_i0:
+ *  Zeroth order modified Bessel function of the first kind, for the
+ *  Kaiser window.
+ */
+static double bessel_i0(double x)
+{
+   double sum = 1.0;
+   double term = 1.0;
+   int k;
+
+   for (k=1; k<64; k++) {
+      term *= (x / (2*k)) * (x / (2*k));
+      sum += term;
+      if (term < sum * 1e-12)
+	 break;
+   }
+
+   return sum;
+}
+
+
+
+/* make_kernel:
+ *  Tabulates one side of the windowed sinc, for distances from zero to
+ *  RESAMPLE_ZERO_CROSSINGS.
+ */
+static float *make_kernel(void)
+{
+   float *table;
+   double u, r, i0_beta;
+   int i;
+
+   table = _AL_MALLOC_ATOMIC(RESAMPLE_TABLE_SIZE * sizeof(float));
+   if (!table)
+      return NULL;
+
+   i0_beta = bessel_i0(RESAMPLE_KAISER_BETA);
+
+   for (i=0; i<RESAMPLE_TABLE_SIZE; i++) {
+      u = (double)i / RESAMPLE_TABLE_RES;
+
+      if (u >= RESAMPLE_ZERO_CROSSINGS) {
+	 table[i] = 0;
+      }
+      else {
+	 r = u / RESAMPLE_ZERO_CROSSINGS;
+	 table[i] = bessel_i0(RESAMPLE_KAISER_BETA * sqrt(1.0 - r*r)) / i0_beta;
+	 if (i > 0)
+	    table[i] *= sin(AL_PI * u) / (AL_PI * u);
+      }
+   }
+
+   return table;
+}
+
+
+
+/* sample_value:
+ *  Returns a value of the sample data, as a signed 16 bit quantity.
+ */
+static INLINE float sample_value(AL_CONST SAMPLE *spl, long i)
+{
+   if (spl->bits == 8)
+      return (((unsigned char *)spl->data)[i] - 0x80) * 256.0f;
+   else
+      return ((unsigned short *)spl->data)[i] - 0x8000;
+}
+
+
+
+/* unpack_sample:
+ *  Reads the sample data into floats in the range of a signed 16 bit
+ *  value, with channels interleaved. Stereo data is mixed down to mono
+ *  if channels is one.
+ */
+static float *unpack_sample(AL_CONST SAMPLE *spl, int channels)
+{
+   float *buf;
+   long i;
+
+   buf = _AL_MALLOC_ATOMIC(spl->len * channels * sizeof(float));
+   if (!buf)
+      return NULL;
+
+   if ((spl->stereo) && (channels == 1)) {
+      for (i=0; i<(long)spl->len; i++)
+	 buf[i] = (sample_value(spl, i*2) + sample_value(spl, i*2+1)) * 0.5f;
+   }
+   else {
+      for (i=0; i<(long)spl->len * channels; i++)
+	 buf[i] = sample_value(spl, i);
+   }
+
+   return buf;
+}
+
+
+
+/* resample:
+ *  Band-limited conversion of len frames of in (at in_freq) into out_len
+ *  frames of out (at out_freq). The kernel is widened when going down in
+ *  frequency, so that nothing above the new Nyquist frequency aliases.
+ */
+static void resample(AL_CONST float *in, long len, int in_freq, float *out, long out_len, int out_freq, int channels, AL_CONST float *table)
+{
+   double step = (double)in_freq / out_freq;
+   double fc = RESAMPLE_ROLLOFF * MIN(1.0, (double)out_freq / in_freq);
+   double width = RESAMPLE_ZERO_CROSSINGS / fc;
+   double t, x, w, wsum, sum[2];
+   long i, j, first, last;
+   int c, k;
+
+   for (i=0; i<out_len; i++) {
+      t = i * step;
+      first = (long)ceil(t - width);
+      last = (long)floor(t + width);
+
+      sum[0] = sum[1] = 0;
+      wsum = 0;
+
+      for (j=first; j<=last; j++) {
+	 /* look up the kernel, interpolating between its entries */
+	 x = fabs(t - j) * fc * RESAMPLE_TABLE_RES;
+	 k = (int)x;
+	 if (k >= RESAMPLE_TABLE_SIZE - 1)
+	    continue;
+
+	 x -= k;
+	 w = table[k] + (table[k+1] - table[k]) * x;
+	 wsum += w;
+
+	 /* anything outside the sample is silence */
+	 if ((j >= 0) && (j < len)) {
+	    for (c=0; c<channels; c++)
+	       sum[c] += in[j*channels + c] * w;
+	 }
+      }
+
+      for (c=0; c<channels; c++)
+	 out[i*channels + c] = (wsum > 0) ? sum[c] / wsum : 0;
+   }
+}
+
+
+
+/* pack_sample:
+ *  Writes floats in the range of a signed 16 bit value into the sample
+ *  data, rounding and clipping them, and duplicating mono data if the
+ *  sample is stereo.
+ */
+static void pack_sample(SAMPLE *spl, AL_CONST float *buf, int channels)
+{
+   int out_channels = (spl->stereo) ? 2 : 1;
+   long n = spl->len * out_channels;
+   double v;
+   long i;
+   int s;
+
+   for (i=0; i<n; i++) {
+      v = buf[i / out_channels * channels + (i % out_channels) % channels];
+
+      if (spl->bits == 8) {
+	 s = (int)floor(v / 256.0 + 0.5);
+	 ((unsigned char *)spl->data)[i] = MID(-128, s, 127) + 0x80;
+      }
+      else {
+	 s = (int)floor(v + 0.5);
+	 ((unsigned short *)spl->data)[i] = MID(-32768, s, 32767) + 0x8000;
+      }
+   }
+}
+
+
+
+/* convert_sample:
+ *  Creates a copy of a sample with the given bit depth, number of channels
+ *  and frequency, resampling it with a band-limited filter if it has to.
+ *  Pass -1 for any of them that should stay the same. The loop points
+ *  are moved to the same place in the new sample. Returns NULL if we run
+ *  out of memory.
+ */
+SAMPLE *convert_sample(AL_CONST SAMPLE *spl, int bits, int stereo, int freq)
+{
+   SAMPLE *dst;
+   float *in, *out, *table;
+   double ratio;
+   long len;
+   int channels;
+   ASSERT(spl);
+   ASSERT(spl->len > 0);
+
+   if (bits <= 0)
+      bits = spl->bits;
+
+   if (stereo < 0)
+      stereo = spl->stereo;
+   else
+      stereo = (stereo != 0);
+
+   if (freq <= 0)
+      freq = spl->freq;
+
+   ASSERT((bits == 8) || (bits == 16));
+
+   ratio = (double)freq / spl->freq;
+   len = (long)floor(spl->len * ratio + 0.5);
+   if (len < 1)
+      len = 1;
+
+   dst = create_sample(bits, stereo, freq, len);
+   if (!dst)
+      return NULL;
+
+   dst->priority = spl->priority;
+   dst->loop_start = MIN((unsigned long)floor(spl->loop_start * ratio + 0.5), dst->len);
+   dst->loop_end = MIN((unsigned long)floor(spl->loop_end * ratio + 0.5), dst->len);
+
+   /* work on as few channels as possible */
+   channels = ((spl->stereo) && (stereo)) ? 2 : 1;
+
+   in = unpack_sample(spl, channels);
+   if (!in) {
+      destroy_sample(dst);
+      return NULL;
+   }
+
+   if (freq == spl->freq) {
+      pack_sample(dst, in, channels);
+      _AL_FREE(in);
+      return dst;
+   }
+
+   table = make_kernel();
+   out = _AL_MALLOC_ATOMIC(len * channels * sizeof(float));
+
+   if ((!table) || (!out)) {
+      if (table)
+	 _AL_FREE(table);
+      if (out)
+	 _AL_FREE(out);
+      _AL_FREE(in);
+      destroy_sample(dst);
+      return NULL;
+   }
+
+   resample(in, spl->len, spl->freq, out, len, freq, channels, table);
+   pack_sample(dst, out, channels);
+
+   _AL_FREE(table);
+   _AL_FREE(out);
+   _AL_FREE(in);
+
+   return dst;
+}
+
+
+
+/* set_sample_load_format:
+ *  Makes load_wav() and load_voc() convert every sample they load to the
+ *  given format, as with convert_sample(). Pass -1 to leave a setting as
+ *  the file has it, which is the default for all three.
+ */
+void set_sample_load_format(int bits, int stereo, int freq)
+{
+   ASSERT((bits <= 0) || (bits == 8) || (bits == 16));
+
+   load_bits = bits;
+   load_stereo = stereo;
+   load_freq = freq;
+}
+
+
+
+/* _convert_loaded_sample:
+ *  Helper for the sample loaders, which brings a freshly loaded sample to
+ *  the format set by set_sample_load_format(). If it can't, the sample is
+ *  returned the way it was loaded.
+ */
+SAMPLE *_convert_loaded_sample(SAMPLE *spl)
+{
+   SAMPLE *dst;
+
+   if ((!spl) || (spl->len == 0))
+      return spl;
+
+   if (((load_bits <= 0) || (load_bits == spl->bits)) &&
+       ((load_stereo < 0) || ((load_stereo != 0) == (spl->stereo != 0))) &&
+       ((load_freq <= 0) || (load_freq == spl->freq)))
+      return spl;
+
+   dst = convert_sample(spl, load_bits, load_stereo, load_freq);
+   if (!dst)
+      return spl;
+
+   destroy_sample(spl);
+
+   return dst;
+}
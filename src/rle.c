@@ -40,76 +40,96 @@
 RLE_SPRITE *get_rle_sprite(BITMAP *bitmap)
 {
    int depth;
-   RLE_SPRITE *s;
+   RLE_SPRITE *s = NULL;
    int x, y;
-   int run;
-   int pix;
+   int n, i;
    int c;
+   int size = 0;
+   int memory;
+   int mask;
    ASSERT(bitmap);
    
    depth = bitmap_color_depth(bitmap);
-
-   #define WRITE_TO_SPRITE8(x) {                                             \
-      _grow_scratch_mem(c+1);                                                \
-      p = (signed char *)_scratch_mem;                                       \
-      p[c] = x;                                                              \
-      c++;                                                                   \
-   }
-
-   #define WRITE_TO_SPRITE16(x) {                                            \
-      _grow_scratch_mem((c+1)*sizeof(int16_t));                              \
-      p = (int16_t *)_scratch_mem;                                           \
-      p[c] = x;                                                              \
-      c++;                                                                   \
-   }
-
-   #define WRITE_TO_SPRITE32(x) {                                            \
-      _grow_scratch_mem((c+1)*sizeof(int32_t));                              \
-      p = (int32_t *)_scratch_mem;                                           \
-      p[c] = x;                                                              \
-      c++;                                                                   \
-   }
-
-   /* helper for building an RLE run */
-   #define DO_RLE(bits)                                                      \
+   memory = is_memory_bitmap(bitmap);
+   mask = bitmap->vtable->mask_color;
+
+   /* memory bitmaps are read straight from their line pointers */
+   #define GET_PIXEL8(x, y)   ((memory) ? bitmap->line[y][x] : getpixel(bitmap, x, y))
+   #define GET_PIXEL16(x, y)  ((memory) ? ((unsigned short *)bitmap->line[y])[x] : getpixel(bitmap, x, y))
+   #define GET_PIXEL24(x, y)  ((memory) ? READ3BYTES(bitmap->line[y] + (x)*3) : getpixel(bitmap, x, y))
+   #define GET_PIXEL32(x, y)  ((memory) ? (int)((uint32_t *)bitmap->line[y])[x] : getpixel(bitmap, x, y))
+
+   #define IS_MASKED(GET_PIXEL, x, y)  ((int)(GET_PIXEL(x, y) & 0xFFFFFF) == mask)
+
+   /* helper for building the RLE data: the first pass only measures it,
+    * the second pass fills in the sprite allocated with the right size,
+    * copying whole runs of pixels when they have the same format.
+    */
+   #define DO_RLE(type, GET_PIXEL, direct)                                   \
    {                                                                         \
-      for (y=0; y<bitmap->h; y++) {                                          \
-	 run = -1;                                                           \
-	 for (x=0; x<bitmap->w; x++) {                                       \
-	    pix = getpixel(bitmap, x, y) & 0xFFFFFF;                         \
-	    if (pix != bitmap->vtable->mask_color) {                         \
-	       if ((run >= 0) && (p[run] > 0) && (p[run] < 127))             \
-		  p[run]++;                                                  \
-	       else {                                                        \
-		  run = c;                                                   \
-		  WRITE_TO_SPRITE##bits(1);                                  \
+      type *p = NULL;                                                        \
+      int pass;                                                              \
+									     \
+      for (pass=0; pass<2; pass++) {                                         \
+	 c = 0;                                                              \
+									     \
+	 for (y=0; y<bitmap->h; y++) {                                       \
+	    x = 0;                                                           \
+	    while (x < bitmap->w) {                                          \
+	       for (n=0; (n < 127) && (x+n < bitmap->w); n++) {              \
+		  if (IS_MASKED(GET_PIXEL, x+n, y))                          \
+		     break;                                                  \
+	       }                                                             \
+									     \
+	       if (n > 0) {                                                  \
+		  /* a run of solid pixels */                                \
+		  if (p) {                                                   \
+		     p[c] = n;                                               \
+		     if (direct)                                             \
+			memcpy(p+c+1, bitmap->line[y] + x*sizeof(type),     \
+			       n*sizeof(type));                              \
+		     else {                                                  \
+			for (i=0; i<n; i++)                                  \
+			   p[c+1+i] = GET_PIXEL(x+i, y);                     \
+		     }                                                       \
+		  }                                                          \
+		  c += n+1;                                                  \
+		  x += n;                                                    \
 	       }                                                             \
-	       WRITE_TO_SPRITE##bits(getpixel(bitmap, x, y));                \
-	    }                                                                \
-	    else {                                                           \
-	       if ((run >= 0) && (p[run] < 0) && (p[run] > -128))            \
-		  p[run]--;                                                  \
 	       else {                                                        \
-		  run = c;                                                   \
-		  WRITE_TO_SPRITE##bits(-1);                                 \
+		  /* a gap of masked pixels */                               \
+		  for (n=1; (n < 128) && (x+n < bitmap->w); n++) {           \
+		     if (!IS_MASKED(GET_PIXEL, x+n, y))                      \
+			break;                                               \
+		  }                                                          \
+		  if (p)                                                     \
+		     p[c] = -n;                                              \
+		  c++;                                                       \
+		  x += n;                                                    \
 	       }                                                             \
 	    }                                                                \
+									     \
+	    if (p)                                                           \
+	       p[c] = mask;                                                  \
+	    c++;                                                             \
+	 }                                                                   \
+									     \
+	 if (pass == 0) {                                                    \
+	    size = c * sizeof(type);                                         \
+	    s = _AL_MALLOC(sizeof(RLE_SPRITE) + size);                       \
+	    if (!s)                                                          \
+	       return NULL;                                                  \
+	    p = (type *)s->dat;                                              \
 	 }                                                                   \
-	 WRITE_TO_SPRITE##bits(bitmap->vtable->mask_color);                  \
       }                                                                      \
    }
 
-   c = 0;
-
    switch (depth) {
 
       #ifdef ALLEGRO_COLOR8
 
 	 case 8:
-	    {
-	       signed char *p = (signed char *)_scratch_mem;
-	       DO_RLE(8);
-	    }
+	    DO_RLE(signed char, GET_PIXEL8, memory);
 	    break;
 
       #endif
@@ -118,37 +138,33 @@ RLE_SPRITE *get_rle_sprite(BITMAP *bitmap)
 
 	 case 15:
 	 case 16:
-	    {
-	       signed short *p = (signed short *)_scratch_mem;
-	       DO_RLE(16);
-	       c *= sizeof(short);
-	    }
+	    DO_RLE(int16_t, GET_PIXEL16, memory);
 	    break;
 
       #endif
 
-      #if (defined ALLEGRO_COLOR24) || (defined ALLEGRO_COLOR32)
+      #ifdef ALLEGRO_COLOR24
 
 	 case 24:
+	    DO_RLE(int32_t, GET_PIXEL24, FALSE);
+	    break;
+
+      #endif
+
+      #ifdef ALLEGRO_COLOR32
+
 	 case 32:
-	    {
-	       int32_t *p = (int32_t *)_scratch_mem;
-	       DO_RLE(32);
-	       c *= sizeof(int32_t);
-	    }
+	    DO_RLE(int32_t, GET_PIXEL32, memory);
 	    break;
 
       #endif
    }
 
-   s = _AL_MALLOC(sizeof(RLE_SPRITE) + c);
-
    if (s) {
       s->w = bitmap->w;
       s->h = bitmap->h;
       s->color_depth = depth;
-      s->size = c;
-      memcpy(s->dat, _scratch_mem, c);
+      s->size = size;
    }
 
    return s;
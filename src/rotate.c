@@ -141,6 +141,250 @@ SCANLINE_DRAWER_GENERIC(generic
 		       [l_spr_x>>16])
 #endif
 
+
+
+/*
+ * Filtered scanline drawers.
+ *
+ * These sample the sprite at the exact position of each pixel centre
+ * instead of taking the nearest pixel. The bilinear ones blend two pixels
+ * at a time in packed form, with all the channels of a pixel spread out in
+ * one 32-bit integer so that a single multiply handles them together. The
+ * bicubic ones use Catmull-Rom weights over 4x4 pixels. In the masked
+ * versions a pixel is drawn if the nearest sprite pixel is solid, like
+ * with the normal drawers, and masked neighbours are replaced by that
+ * nearest pixel so the mask color doesn't bleed into the edges. The
+ * positions are rounded to the precision of the weights, so that drawing
+ * at the original size gives back the original pixels.
+ */
+
+#define FILTER_SPR_PIXEL_15(spr, x, y)  (((unsigned short *)(spr)->line[y])[x])
+#define FILTER_SPR_PIXEL_16(spr, x, y)  (((unsigned short *)(spr)->line[y])[x])
+#define FILTER_SPR_PIXEL_24(spr, x, y)  READ3BYTES((spr)->line[y] + (x) * 3)
+#define FILTER_SPR_PIXEL_32(spr, x, y)  ((int)((uint32_t *)(spr)->line[y])[x])
+
+/* bits of precision of the bilinear weights */
+#define FILTER_BITS_15  5
+#define FILTER_BITS_16  5
+#define FILTER_BITS_24  8
+#define FILTER_BITS_32  8
+
+/* channels of a pixel, for the bicubic filter */
+#define FILTER_SPLIT_15(c, ch)  { ch[0] = ((c) >> 10) & 31; ch[1] = ((c) >> 5) & 31;          \
+				  ch[2] = (c) & 31; ch[3] = 0; }
+#define FILTER_SPLIT_16(c, ch)  { ch[0] = ((c) >> 11) & 31; ch[1] = ((c) >> 5) & 63;          \
+				  ch[2] = (c) & 31; ch[3] = 0; }
+#define FILTER_SPLIT_24(c, ch)  { ch[0] = ((c) >> 16) & 255; ch[1] = ((c) >> 8) & 255;        \
+				  ch[2] = (c) & 255; ch[3] = 0; }
+#define FILTER_SPLIT_32(c, ch)  { ch[0] = ((c) >> 16) & 255; ch[1] = ((c) >> 8) & 255;        \
+				  ch[2] = (c) & 255; ch[3] = ((unsigned)(c) >> 24); }
+
+#define FILTER_MERGE_15(ch)  ((MID(0, ch[0], 31) << 10) | (MID(0, ch[1], 31) << 5) |         \
+			      MID(0, ch[2], 31))
+#define FILTER_MERGE_16(ch)  ((MID(0, ch[0], 31) << 11) | (MID(0, ch[1], 63) << 5) |         \
+			      MID(0, ch[2], 31))
+#define FILTER_MERGE_24(ch)  ((MID(0, ch[0], 255) << 16) | (MID(0, ch[1], 255) << 8) |       \
+			      MID(0, ch[2], 255))
+#define FILTER_MERGE_32(ch)  ((int)(((unsigned)MID(0, ch[3], 255) << 24) |                   \
+			      (MID(0, ch[0], 255) << 16) | (MID(0, ch[1], 255) << 8) |        \
+			      MID(0, ch[2], 255)))
+
+
+
+/* filter_lerp_*:
+ *  Blend two pixels, with a weight f for the second one.
+ */
+static INLINE int filter_lerp_15(int a, int b, int f)
+{
+   uint32_t x = (a | (a << 16)) & 0x03E07C1F;
+   uint32_t y = (b | (b << 16)) & 0x03E07C1F;
+
+   x = ((x * (32 - f) + y * f) >> 5) & 0x03E07C1F;
+   return (x | (x >> 16)) & 0xFFFF;
+}
+
+static INLINE int filter_lerp_16(int a, int b, int f)
+{
+   uint32_t x = (a | (a << 16)) & 0x07E0F81F;
+   uint32_t y = (b | (b << 16)) & 0x07E0F81F;
+
+   x = ((x * (32 - f) + y * f) >> 5) & 0x07E0F81F;
+   return (x | (x >> 16)) & 0xFFFF;
+}
+
+static INLINE int filter_lerp_32(int a, int b, int f)
+{
+   uint32_t rb = (((uint32_t)a & 0xFF00FF) * (256 - f) + ((uint32_t)b & 0xFF00FF) * f) >> 8;
+   uint32_t ag = (((uint32_t)a >> 8) & 0xFF00FF) * (256 - f) + (((uint32_t)b >> 8) & 0xFF00FF) * f;
+
+   return (int)((rb & 0xFF00FF) | (ag & 0xFF00FF00));
+}
+
+#define filter_lerp_24  filter_lerp_32
+
+
+
+/* Catmull-Rom weights for 64 positions between two pixels, scaled to 256 */
+static int cubic_weight[64][4];
+static int cubic_weight_ready = FALSE;
+
+
+
+/* init_cubic_weight:
+ *  Fills in the table of bicubic filter weights.
+ */
+static void init_cubic_weight(void)
+{
+   double t;
+   int i;
+
+   for (i=0; i<64; i++) {
+      t = i / 64.0;
+      cubic_weight[i][0] = (int)floor(256 * (-t*t*t + 2*t*t - t) / 2 + 0.5);
+      cubic_weight[i][2] = (int)floor(256 * (-3*t*t*t + 4*t*t + t) / 2 + 0.5);
+      cubic_weight[i][3] = (int)floor(256 * (t*t*t - t*t) / 2 + 0.5);
+      cubic_weight[i][1] = 256 - cubic_weight[i][0] - cubic_weight[i][2] - cubic_weight[i][3];
+   }
+
+   cubic_weight_ready = TRUE;
+}
+
+
+
+/* bilinear_sample_*, bicubic_sample_*:
+ *  Sample the sprite at (u, v), in the coordinates passed to the scanline
+ *  drawers. Return FALSE if nothing is to be drawn there.
+ */
+#define FILTER_SAMPLERS(bits_pp)                                              \
+   static INLINE int bilinear_sample_##bits_pp(BITMAP *spr, fixed u, fixed v, \
+					       int masked, int *c)            \
+   {                                                                          \
+      int x0, y0, x1, y1, fx, fy;                                             \
+      int p00, p10, p01, p11, nearest;                                        \
+									      \
+      nearest = FILTER_SPR_PIXEL_##bits_pp(spr, u >> 16, v >> 16);           \
+      if ((masked) && (nearest == MASK_COLOR_##bits_pp))                      \
+	 return FALSE;                                                        \
+									      \
+      u -= 0x8000 - (0x8000 >> FILTER_BITS_##bits_pp);                       \
+      v -= 0x8000 - (0x8000 >> FILTER_BITS_##bits_pp);                       \
+      x0 = u >> 16;                                                           \
+      y0 = v >> 16;                                                           \
+      fx = (u & 0xFFFF) >> (16 - FILTER_BITS_##bits_pp);                      \
+      fy = (v & 0xFFFF) >> (16 - FILTER_BITS_##bits_pp);                      \
+      x1 = MIN(x0 + 1, spr->w - 1);                                           \
+      y1 = MIN(y0 + 1, spr->h - 1);                                           \
+      x0 = MAX(x0, 0);                                                        \
+      y0 = MAX(y0, 0);                                                        \
+									      \
+      p00 = FILTER_SPR_PIXEL_##bits_pp(spr, x0, y0);                          \
+      p10 = FILTER_SPR_PIXEL_##bits_pp(spr, x1, y0);                          \
+      p01 = FILTER_SPR_PIXEL_##bits_pp(spr, x0, y1);                          \
+      p11 = FILTER_SPR_PIXEL_##bits_pp(spr, x1, y1);                          \
+									      \
+      if (masked) {                                                           \
+	 if (p00 == MASK_COLOR_##bits_pp) p00 = nearest;                      \
+	 if (p10 == MASK_COLOR_##bits_pp) p10 = nearest;                      \
+	 if (p01 == MASK_COLOR_##bits_pp) p01 = nearest;                      \
+	 if (p11 == MASK_COLOR_##bits_pp) p11 = nearest;                      \
+      }                                                                       \
+									      \
+      *c = filter_lerp_##bits_pp(filter_lerp_##bits_pp(p00, p10, fx),         \
+				 filter_lerp_##bits_pp(p01, p11, fx), fy);    \
+      return TRUE;                                                            \
+   }                                                                          \
+									      \
+   static INLINE int bicubic_sample_##bits_pp(BITMAP *spr, fixed u, fixed v,  \
+					      int masked, int *c)             \
+   {                                                                          \
+      int x[4], y[4], ch[4], sum[4];                                          \
+      int *wx, *wy;                                                           \
+      int i, j, k, p, w, nearest;                                             \
+									      \
+      nearest = FILTER_SPR_PIXEL_##bits_pp(spr, u >> 16, v >> 16);           \
+      if ((masked) && (nearest == MASK_COLOR_##bits_pp))                      \
+	 return FALSE;                                                        \
+									      \
+      u -= 0x8000 - 0x200;                                                    \
+      v -= 0x8000 - 0x200;                                                    \
+      wx = cubic_weight[(u >> 10) & 63];                                      \
+      wy = cubic_weight[(v >> 10) & 63];                                      \
+									      \
+      for (i=0; i<4; i++) {                                                   \
+	 x[i] = MID(0, (u >> 16) + i - 1, spr->w - 1);                        \
+	 y[i] = MID(0, (v >> 16) + i - 1, spr->h - 1);                        \
+	 sum[i] = 0;                                                          \
+      }                                                                       \
+									      \
+      for (j=0; j<4; j++) {                                                   \
+	 for (i=0; i<4; i++) {                                                \
+	    p = FILTER_SPR_PIXEL_##bits_pp(spr, x[i], y[j]);                  \
+	    if ((masked) && (p == MASK_COLOR_##bits_pp))                      \
+	       p = nearest;                                                   \
+	    FILTER_SPLIT_##bits_pp(p, ch);                                    \
+	    w = wx[i] * wy[j];                                                \
+	    for (k=0; k<4; k++)                                               \
+	       sum[k] += ch[k] * w;                                           \
+	 }                                                                    \
+      }                                                                       \
+									      \
+      for (k=0; k<4; k++)                                                     \
+	 sum[k] = (sum[k] + 32768) >> 16;                                     \
+									      \
+      *c = FILTER_MERGE_##bits_pp(sum);                                       \
+      return TRUE;                                                            \
+   }
+
+
+
+#define FILTERED_SCANLINE_DRAWER(name, bits_pp, SAMPLE, masked)          \
+   static void draw_scanline_##name(BITMAP *bmp, BITMAP *spr,            \
+				    fixed l_bmp_x, int bmp_y_i,          \
+				    fixed r_bmp_x,                       \
+				    fixed l_spr_x, fixed l_spr_y,        \
+				    fixed spr_dx, fixed spr_dy)          \
+   {                                                                     \
+      int c;                                                             \
+      uintptr_t addr, end_addr;                                          \
+									 \
+      r_bmp_x >>= 16;                                                    \
+      l_bmp_x >>= 16;                                                    \
+      bmp_select(bmp);                                                   \
+      addr = bmp_write_line(bmp, bmp_y_i);                               \
+      end_addr = addr + r_bmp_x * ((bits_pp + 7) / 8);                   \
+      addr += l_bmp_x * ((bits_pp + 7) / 8);                             \
+      for (; addr <= end_addr; addr += ((bits_pp + 7) / 8)) {            \
+	 if (SAMPLE(spr, l_spr_x, l_spr_y, masked, &c))                  \
+	    bmp_write##bits_pp(addr, c);                                 \
+	 l_spr_x += spr_dx;                                              \
+	 l_spr_y += spr_dy;                                              \
+      }                                                                  \
+   }
+
+
+
+#define FILTERED_SCANLINE_DRAWERS(bits_pp)                                                 \
+   FILTER_SAMPLERS(bits_pp)                                                                \
+   FILTERED_SCANLINE_DRAWER(bilinear_##bits_pp, bits_pp, bilinear_sample_##bits_pp, TRUE)   \
+   FILTERED_SCANLINE_DRAWER(bilinear_opaque_##bits_pp, bits_pp, bilinear_sample_##bits_pp, FALSE) \
+   FILTERED_SCANLINE_DRAWER(bicubic_##bits_pp, bits_pp, bicubic_sample_##bits_pp, TRUE)     \
+   FILTERED_SCANLINE_DRAWER(bicubic_opaque_##bits_pp, bits_pp, bicubic_sample_##bits_pp, FALSE)
+
+#ifdef ALLEGRO_COLOR16
+   FILTERED_SCANLINE_DRAWERS(15)
+   FILTERED_SCANLINE_DRAWERS(16)
+#endif
+
+#ifdef ALLEGRO_COLOR24
+   FILTERED_SCANLINE_DRAWERS(24)
+#endif
+
+#ifdef ALLEGRO_COLOR32
+   FILTERED_SCANLINE_DRAWERS(32)
+#endif
+
+
+
 #ifdef ALLEGRO_GFX_HAS_VGA
    static void draw_scanline_modex(
     BITMAP *bmp, BITMAP *spr, fixed l_bmp_x, int bmp_y_i, fixed r_bmp_x,
@@ -894,3 +1138,447 @@ static void _rotate_scaled_sprite_flip(BITMAP *bmp, BITMAP *sprite,
 /* pivot_scaled_sprite_v_flip: (inlined)
  *  Similar to pivot_scaled_sprite(), except flips the sprite vertically first.
  */
+
+
+
+/*
+ * Filtered drawing.
+ */
+
+
+
+/* halve_*:
+ *  Shrink the src bitmap to half its size into dst, averaging each 2x2
+ *  block of pixels, for mipmapped minification. Masked pixels are left
+ *  out of the average, and a block stays masked unless at least two of
+ *  its pixels are solid.
+ */
+#define FILTER_HALVE(bits_pp)                                                 \
+   static void halve_##bits_pp(BITMAP *src, BITMAP *dst, int masked)         \
+   {                                                                          \
+      int ch[4], sum[4];                                                      \
+      int x, y, i, k, n, c;                                                   \
+									      \
+      for (y=0; y<dst->h; y++) {                                              \
+	 for (x=0; x<dst->w; x++) {                                           \
+	    sum[0] = sum[1] = sum[2] = sum[3] = 0;                            \
+	    n = 0;                                                            \
+									      \
+	    for (i=0; i<4; i++) {                                             \
+	       c = FILTER_SPR_PIXEL_##bits_pp(src,                            \
+					      MIN(x*2 + (i & 1), src->w - 1), \
+					      MIN(y*2 + (i >> 1), src->h - 1)); \
+	       if ((masked) && (c == MASK_COLOR_##bits_pp))                   \
+		  continue;                                                   \
+	       FILTER_SPLIT_##bits_pp(c, ch);                                 \
+	       for (k=0; k<4; k++)                                            \
+		  sum[k] += ch[k];                                            \
+	       n++;                                                           \
+	    }                                                                 \
+									      \
+	    if (n < 2) {                                                      \
+	       c = MASK_COLOR_##bits_pp;                                      \
+	    }                                                                 \
+	    else {                                                            \
+	       for (k=0; k<4; k++)                                            \
+		  sum[k] = (sum[k] + n/2) / n;                                \
+	       c = FILTER_MERGE_##bits_pp(sum);                               \
+	    }                                                                 \
+									      \
+	    bmp_write##bits_pp((uintptr_t)dst->line[y] + x * ((bits_pp + 7) / 8), c); \
+	 }                                                                    \
+      }                                                                       \
+   }
+
+#ifdef ALLEGRO_COLOR16
+   FILTER_HALVE(15)
+   FILTER_HALVE(16)
+#endif
+
+#ifdef ALLEGRO_COLOR24
+   FILTER_HALVE(24)
+#endif
+
+#ifdef ALLEGRO_COLOR32
+   FILTER_HALVE(32)
+#endif
+
+
+
+/* halve_bitmap:
+ *  Returns a copy of a memory bitmap at half the size, or NULL if we are
+ *  out of memory.
+ */
+static BITMAP *halve_bitmap(BITMAP *src, int masked)
+{
+   BITMAP *dst = create_bitmap_ex(bitmap_color_depth(src), (src->w + 1) / 2, (src->h + 1) / 2);
+
+   if (!dst)
+      return NULL;
+
+   switch (bitmap_color_depth(src)) {
+
+      #ifdef ALLEGRO_COLOR16
+	 case 15:
+	    halve_15(src, dst, masked);
+	    break;
+
+	 case 16:
+	    halve_16(src, dst, masked);
+	    break;
+      #endif
+
+      #ifdef ALLEGRO_COLOR24
+	 case 24:
+	    halve_24(src, dst, masked);
+	    break;
+      #endif
+
+      #ifdef ALLEGRO_COLOR32
+	 case 32:
+	    halve_32(src, dst, masked);
+	    break;
+      #endif
+   }
+
+   return dst;
+}
+
+
+
+/* most halvings a bitmap can go through, since it can't be 2^32 wide */
+#define MIPMAP_MAX_LEVELS  32
+
+
+struct MIPMAP
+{
+   int levels;                            /* bitmaps in the chain */
+   BITMAP *level[MIPMAP_MAX_LEVELS];      /* the sprite, then halved copies */
+};
+
+
+
+/* create_mipmap:
+ *  Builds the chain of ever smaller copies of a sprite which the filtered
+ *  functions pick from when shrinking it, down to one pixel wide or high,
+ *  so that sprites drawn often don't have it built on every call. The
+ *  sprite itself is not copied, so it must stay around, and the chain has
+ *  to be built again if the sprite changes. Returns NULL if we are out of
+ *  memory.
+ */
+MIPMAP *create_mipmap(BITMAP *sprite)
+{
+   MIPMAP *mip;
+   BITMAP *level;
+   ASSERT(sprite);
+
+   mip = _AL_MALLOC(sizeof(MIPMAP));
+   if (!mip)
+      return NULL;
+
+   mip->level[0] = sprite;
+   mip->levels = 1;
+
+   if (is_memory_bitmap(sprite)) {
+      level = sprite;
+
+      while ((level->w > 1) && (level->h > 1) && (mip->levels < MIPMAP_MAX_LEVELS)) {
+	 level = halve_bitmap(level, TRUE);
+	 if (!level) {
+	    destroy_mipmap(mip);
+	    return NULL;
+	 }
+
+	 mip->level[mip->levels++] = level;
+      }
+   }
+
+   return mip;
+}
+
+
+
+/* destroy_mipmap:
+ *  Frees the copies made by create_mipmap(), leaving the sprite alone.
+ */
+void destroy_mipmap(MIPMAP *mip)
+{
+   int i;
+
+   if (mip) {
+      for (i=1; i<mip->levels; i++)
+	 destroy_bitmap(mip->level[i]);
+
+      _AL_FREE(mip);
+   }
+}
+
+
+
+/* filter_supported:
+ *  Checks whether a filtered scanline drawer can be used to draw sprite
+ *  onto bmp.
+ */
+static int filter_supported(BITMAP *bmp, BITMAP *sprite, int filter)
+{
+   int depth = bitmap_color_depth(sprite);
+
+   if (((filter & 0xFF) != DRAW_FILTER_BILINEAR) && ((filter & 0xFF) != DRAW_FILTER_BICUBIC))
+      return FALSE;
+
+   if ((depth != bitmap_color_depth(bmp)) || (!is_memory_bitmap(sprite)) || (!is_linear_bitmap(bmp)))
+      return FALSE;
+
+   switch (depth) {
+
+      #ifdef ALLEGRO_COLOR16
+	 case 15:
+	 case 16:
+	    return TRUE;
+      #endif
+
+      #ifdef ALLEGRO_COLOR24
+	 case 24:
+	    return TRUE;
+      #endif
+
+      #ifdef ALLEGRO_COLOR32
+	 case 32:
+	    return TRUE;
+      #endif
+   }
+
+   return FALSE;
+}
+
+
+
+/* parallelogram_map_filtered:
+ *  Like _parallelogram_map_standard(), but with a filtered scanline
+ *  drawer, which filter_supported() must have agreed to. The shrink
+ *  parameter is how many sprite pixels map to one bitmap pixel, for
+ *  picking the level from mip if there is one, or from copies made on
+ *  the spot when DRAW_FILTER_MIPMAP is set.
+ */
+static void parallelogram_map_filtered(BITMAP *bmp, BITMAP *sprite, fixed xs[4], fixed ys[4],
+				       fixed shrink, int filter, int masked, AL_CONST MIPMAP *mip)
+{
+   void (*draw_scanline)(BITMAP *bmp, BITMAP *spr,
+			 fixed l_bmp_x, int bmp_y,
+			 fixed r_bmp_x,
+			 fixed l_spr_x, fixed l_spr_y,
+			 fixed spr_dx, fixed spr_dy) = NULL;
+   BITMAP *level = sprite;
+   BITMAP *next;
+   int bicubic = ((filter & 0xFF) == DRAW_FILTER_BICUBIC);
+
+   if (bicubic && !cubic_weight_ready)
+      init_cubic_weight();
+
+   #define FILTER_DRAWER(bits_pp)                                                       \
+      if (bicubic)                                                                      \
+	 draw_scanline = masked ? draw_scanline_bicubic_##bits_pp                       \
+				: draw_scanline_bicubic_opaque_##bits_pp;               \
+      else                                                                              \
+	 draw_scanline = masked ? draw_scanline_bilinear_##bits_pp                      \
+				: draw_scanline_bilinear_opaque_##bits_pp;
+
+   switch (bitmap_color_depth(sprite)) {
+
+      #ifdef ALLEGRO_COLOR16
+	 case 15:
+	    FILTER_DRAWER(15);
+	    break;
+
+	 case 16:
+	    FILTER_DRAWER(16);
+	    break;
+      #endif
+
+      #ifdef ALLEGRO_COLOR24
+	 case 24:
+	    FILTER_DRAWER(24);
+	    break;
+      #endif
+
+      #ifdef ALLEGRO_COLOR32
+	 case 32:
+	    FILTER_DRAWER(32);
+	    break;
+      #endif
+
+      default:
+	 /* NOTREACHED */
+	 ASSERT(0);
+	 return;
+   }
+
+   #undef FILTER_DRAWER
+
+   /* a filter over neighbouring pixels misses detail when shrinking by
+    * more than two, so pick a smaller copy of the sprite instead
+    */
+   if (mip) {
+      int i = 0;
+
+      while ((shrink >= itofix(2)) && (i+1 < mip->levels)) {
+	 i++;
+	 shrink /= 2;
+      }
+
+      _parallelogram_map(bmp, mip->level[i], xs, ys, draw_scanline, FALSE);
+      return;
+   }
+
+   if (filter & DRAW_FILTER_MIPMAP) {
+      while ((shrink >= itofix(2)) && (level->w > 1) && (level->h > 1)) {
+	 next = halve_bitmap(level, masked);
+	 if (!next)
+	    break;
+
+	 if (level != sprite)
+	    destroy_bitmap(level);
+
+	 level = next;
+	 shrink /= 2;
+      }
+   }
+
+   _parallelogram_map(bmp, level, xs, ys, draw_scanline, FALSE);
+
+   if (level != sprite)
+      destroy_bitmap(level);
+}
+
+
+
+/* stretch_blit_filtered:
+ *  Like stretch_blit(), but samples the source with a bilinear or bicubic
+ *  filter. Falls back to stretch_blit() where the filters can't be used.
+ */
+void stretch_blit_filtered(BITMAP *src, BITMAP *dst, int s_x, int s_y, int s_w, int s_h,
+			   int d_x, int d_y, int d_w, int d_h, int filter)
+{
+   fixed xs[4], ys[4];
+   BITMAP *sub;
+   ASSERT(src);
+   ASSERT(dst);
+
+   if ((s_w <= 0) || (s_h <= 0) || (d_w <= 0) || (d_h <= 0))
+      return;
+
+   if ((!filter_supported(dst, src, filter)) ||
+       (s_x < 0) || (s_y < 0) || (s_x + s_w > src->w) || (s_y + s_h > src->h)) {
+      stretch_blit(src, dst, s_x, s_y, s_w, s_h, d_x, d_y, d_w, d_h);
+      return;
+   }
+
+   sub = create_sub_bitmap(src, s_x, s_y, s_w, s_h);
+   if (!sub)
+      return;
+
+   xs[0] = xs[3] = itofix(d_x);
+   xs[1] = xs[2] = itofix(d_x + d_w);
+   ys[0] = ys[1] = itofix(d_y);
+   ys[2] = ys[3] = itofix(d_y + d_h);
+
+   parallelogram_map_filtered(dst, sub, xs, ys,
+			      MIN(fixdiv(itofix(s_w), itofix(d_w)), fixdiv(itofix(s_h), itofix(d_h))),
+			      filter, FALSE, NULL);
+
+   destroy_bitmap(sub);
+}
+
+
+
+/* pivot_scaled_sprite_filtered_fixed:
+ *  Helper for the filtered rotate and pivot functions, with the
+ *  coordinates in fixed point format. The mip chain of the sprite is
+ *  used if there is one.
+ */
+static void pivot_scaled_sprite_filtered_fixed(BITMAP *bmp, BITMAP *sprite, fixed x, fixed y,
+					       fixed cx, fixed cy, fixed angle, fixed scale, int filter,
+					       AL_CONST MIPMAP *mip)
+{
+   fixed xs[4], ys[4];
+
+   _rotate_scale_flip_coordinates(sprite->w << 16, sprite->h << 16,
+				  x, y, cx, cy, angle, scale, scale,
+				  FALSE, FALSE, xs, ys);
+
+   if ((scale != 0) && (filter_supported(bmp, sprite, filter)))
+      parallelogram_map_filtered(bmp, sprite, xs, ys, fixdiv(itofix(1), ABS(scale)), filter, TRUE, mip);
+   else
+      _parallelogram_map_standard(bmp, sprite, xs, ys);
+}
+
+
+
+/* rotate_scaled_sprite_filtered:
+ *  Like rotate_scaled_sprite(), but samples the sprite with a bilinear or
+ *  bicubic filter.
+ */
+void rotate_scaled_sprite_filtered(BITMAP *bmp, BITMAP *sprite, int x, int y, fixed angle, fixed scale, int filter)
+{
+   ASSERT(bmp);
+   ASSERT(sprite);
+
+   pivot_scaled_sprite_filtered_fixed(bmp, sprite,
+				      (x<<16) + (sprite->w * scale) / 2,
+				      (y<<16) + (sprite->h * scale) / 2,
+				      sprite->w << 15, sprite->h << 15,
+				      angle, scale, filter, NULL);
+}
+
+
+
+/* pivot_scaled_sprite_filtered:
+ *  Like pivot_scaled_sprite(), but samples the sprite with a bilinear or
+ *  bicubic filter.
+ */
+void pivot_scaled_sprite_filtered(BITMAP *bmp, BITMAP *sprite, int x, int y, int cx, int cy,
+				  fixed angle, fixed scale, int filter)
+{
+   ASSERT(bmp);
+   ASSERT(sprite);
+
+   pivot_scaled_sprite_filtered_fixed(bmp, sprite, itofix(x), itofix(y), itofix(cx), itofix(cy),
+				      angle, scale, filter, NULL);
+}
+
+
+
+/* rotate_scaled_sprite_mipmap:
+ *  Like rotate_scaled_sprite_filtered(), but shrinks the sprite by way of
+ *  a chain made by create_mipmap().
+ */
+void rotate_scaled_sprite_mipmap(BITMAP *bmp, MIPMAP *mip, int x, int y, fixed angle, fixed scale, int filter)
+{
+   BITMAP *sprite;
+   ASSERT(bmp);
+   ASSERT(mip);
+
+   sprite = mip->level[0];
+
+   pivot_scaled_sprite_filtered_fixed(bmp, sprite,
+				      (x<<16) + (sprite->w * scale) / 2,
+				      (y<<16) + (sprite->h * scale) / 2,
+				      sprite->w << 15, sprite->h << 15,
+				      angle, scale, filter, mip);
+}
+
+
+
+/* pivot_scaled_sprite_mipmap:
+ *  Like pivot_scaled_sprite_filtered(), but shrinks the sprite by way of
+ *  a chain made by create_mipmap().
+ */
+void pivot_scaled_sprite_mipmap(BITMAP *bmp, MIPMAP *mip, int x, int y, int cx, int cy,
+				fixed angle, fixed scale, int filter)
+{
+   ASSERT(bmp);
+   ASSERT(mip);
+
+   pivot_scaled_sprite_filtered_fixed(bmp, mip->level[0], itofix(x), itofix(y), itofix(cx), itofix(cy),
+				      angle, scale, filter, mip);
+}
@@ -376,6 +376,8 @@ int install_sound(int digi, int midi, AL_CONST char *cfg_path)
 
    if (digi_card == DIGI_NONE)
       digi_driver = &digi_none;
+   else if (digi_card == DIGI_RENDER)
+      digi_driver = &digi_render;
 
    /* autodetect digital driver */
    if (!digi_driver) {
@@ -968,7 +970,7 @@ SAMPLE *load_voc_pf(PACKFILE *f)
    }
 
    getout: 
-   return spl;
+   return _convert_loaded_sample(spl);
 }
 
 
@@ -1102,7 +1104,7 @@ SAMPLE *load_wav_pf(PACKFILE *f)
    }
 
    getout:
-   return spl;
+   return _convert_loaded_sample(spl);
 }
 
 
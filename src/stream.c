@@ -21,28 +21,15 @@
 
 
 
-/* play_audio_stream:
- *  Creates a new audio stream and starts it playing. The length is the
- *  size of each transfer buffer.
+/* create_stream:
+ *  Helper for the play functions, which sets up a stream with a looped
+ *  sample of the given length, filled with silence, on a voice that
+ *  isn't started yet.
  */
-AUDIOSTREAM *play_audio_stream(int len, int bits, int stereo, int freq, int vol, int pan)
+static AUDIOSTREAM *create_stream(int len, int bufcount, int samples, int bits, int stereo, int freq, int vol, int pan)
 {
    AUDIOSTREAM *stream;
-   int i, bufcount;
-   ASSERT(len > 0);
-   ASSERT(bits > 0);
-   ASSERT(freq > 0);
-
-   /* decide how many buffer fragments we will need */
-   if ((digi_driver) && (digi_driver->buffer_size))
-      i = digi_driver->buffer_size();
-   else
-      i = 2048;
-
-   if (len >= i)
-      bufcount = 1;
-   else
-      bufcount = (i + len-1) / len;
+   int i;
 
    /* create the stream structure */
    stream = _AL_MALLOC(sizeof(AUDIOSTREAM));
@@ -54,9 +41,13 @@ AUDIOSTREAM *play_audio_stream(int len, int bits, int stereo, int freq, int vol,
    stream->bufnum = 0;
    stream->active = 1;
    stream->locked = NULL;
+   stream->callback = NULL;
+   stream->param = NULL;
+   stream->filled = 0;
+   stream->last_pos = 0;
 
    /* create the underlying sample */
-   stream->samp = create_sample(bits, stereo, freq, len*bufcount*2);
+   stream->samp = create_sample(bits, stereo, freq, samples);
    if (!stream->samp) {
       _AL_FREE(stream);
       return NULL;
@@ -65,12 +56,12 @@ AUDIOSTREAM *play_audio_stream(int len, int bits, int stereo, int freq, int vol,
    /* fill with silence */
    if (bits == 16) {
       unsigned short *p = stream->samp->data;
-      for (i=0; i < len*bufcount*2 * ((stereo) ? 2 : 1); i++)
+      for (i=0; i < samples * ((stereo) ? 2 : 1); i++)
 	 p[i] = 0x8000;
    }
    else {
       unsigned char *p = stream->samp->data;
-      for (i=0; i < len*bufcount*2 * ((stereo) ? 2 : 1); i++)
+      for (i=0; i < samples * ((stereo) ? 2 : 1); i++)
 	 p[i] = 0x80;
    }
 
@@ -94,12 +85,166 @@ AUDIOSTREAM *play_audio_stream(int len, int bits, int stereo, int freq, int vol,
 
 
 
+/* play_audio_stream:
+ *  Creates a new audio stream and starts it playing. The length is the
+ *  size of each transfer buffer.
+ */
+AUDIOSTREAM *play_audio_stream(int len, int bits, int stereo, int freq, int vol, int pan)
+{
+   int i, bufcount;
+   ASSERT(len > 0);
+   ASSERT(bits > 0);
+   ASSERT(freq > 0);
+
+   /* decide how many buffer fragments we will need */
+   if ((digi_driver) && (digi_driver->buffer_size))
+      i = digi_driver->buffer_size();
+   else
+      i = 2048;
+
+   if (len >= i)
+      bufcount = 1;
+   else
+      bufcount = (i + len-1) / len;
+
+   return create_stream(len, bufcount, len*bufcount*2, bits, stereo, freq, vol, pan);
+}
+
+
+
+/* stream_refill:
+ *  Called by the mixer before it reads count samples from position pos of
+ *  a callback stream. Moves on past what has been played since last time
+ *  and has the callback write as many blocks, straight into the sample,
+ *  as it takes to cover the samples about to be read.
+ */
+static void stream_refill(void *param, int pos, int count)
+{
+   AUDIOSTREAM *stream = param;
+   int size = stream->len * stream->bufcount;
+   int bytes = ((stream->samp->bits == 8) ? 1 : sizeof(short)) * ((stream->samp->stereo) ? 2 : 1);
+   int played;
+
+   played = pos - stream->last_pos;
+   if (played < 0)
+      played += size;
+
+   stream->last_pos = pos;
+   stream->filled -= played;
+
+   /* the voice has been moved: start again from the block it is in */
+   if (stream->filled < 0) {
+      stream->bufnum = pos / stream->len;
+      stream->filled = -(pos % stream->len);
+   }
+
+   while ((stream->filled < count) && (stream->filled + stream->len <= size)) {
+      stream->callback((char *)stream->samp->data + stream->bufnum * stream->len * bytes,
+		       stream->len, stream->param);
+
+      stream->bufnum++;
+      if (stream->bufnum >= stream->bufcount)
+	 stream->bufnum = 0;
+
+      stream->filled += stream->len;
+   }
+}
+
+END_OF_STATIC_FUNCTION(stream_refill);
+
+
+
+/* stream_poll:
+ *  Timer routine that drives callback streams on drivers which don't use
+ *  the mixer, by filling each buffer of a normal stream as it comes free.
+ */
+static void stream_poll(void *param)
+{
+   AUDIOSTREAM *stream = param;
+   void *buf;
+
+   while ((buf = get_audio_stream_buffer(stream)) != NULL) {
+      stream->callback(buf, stream->len, stream->param);
+      free_audio_stream_buffer(stream);
+   }
+}
+
+END_OF_STATIC_FUNCTION(stream_poll);
+
+
+
+/* play_audio_stream_callback:
+ *  Creates an audio stream that gets its data from a callback, in blocks
+ *  of len samples, and starts it playing. With the software mixer the
+ *  callback is called by the mixer itself, just before each block is
+ *  needed, and writes it straight into the sample being played. Other
+ *  drivers poll a normal stream from a timer.
+ */
+AUDIOSTREAM *play_audio_stream_callback(int len, int bits, int stereo, int freq, int vol, int pan, void (*callback)(void *buf, int len, void *param), void *param)
+{
+   AUDIOSTREAM *stream;
+   int i, count, bufcount;
+   ASSERT(len > 0);
+   ASSERT(bits > 0);
+   ASSERT(freq > 0);
+   ASSERT(callback);
+
+   LOCK_FUNCTION(stream_refill);
+   LOCK_FUNCTION(stream_poll);
+
+   if (get_mixer_buffer_length() <= 0) {
+      stream = play_audio_stream(len, bits, stereo, freq, vol, pan);
+      if (!stream)
+	 return NULL;
+
+      stream->callback = callback;
+      stream->param = param;
+
+      if (install_param_int_ex(stream_poll, stream, MAX((long)len * TIMERS_PER_SECOND / freq / 2, 1)) != 0) {
+	 stop_audio_stream(stream);
+	 return NULL;
+      }
+
+      return stream;
+   }
+
+   /* enough blocks to cover a whole pass of the mixer with the voice
+    * pitched up two octaves, plus the one being written
+    */
+   count = (int)((4.0 * get_mixer_buffer_length() * freq) / get_mixer_frequency()) + 3;
+   bufcount = (count + len-1) / len + 1;
+
+   stream = create_stream(len, bufcount, len*bufcount, bits, stereo, freq, vol, pan);
+   if (!stream)
+      return NULL;
+
+   stream->callback = callback;
+   stream->param = param;
+
+   /* the mixer works on physical voices */
+   for (i=0; i<DIGI_VOICES; i++) {
+      if (_phys_voice[i].num == stream->voice) {
+	 _mixer_set_refill(i, stream_refill, stream);
+	 break;
+      }
+   }
+
+   voice_start(stream->voice);
+
+   return stream;
+}
+
+
+
 /* stop_audio_stream:
  *  Destroys an audio stream when it is no longer required.
  */
 void stop_audio_stream(AUDIOSTREAM *stream)
 {
    ASSERT(stream);
+
+   if (stream->callback)
+      remove_param_int(stream_poll, stream);
    
    if ((stream->locked) && (digi_driver->unlock_voice))
       digi_driver->unlock_voice(stream->voice);
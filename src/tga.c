@@ -244,57 +244,30 @@ static void rle_tga_read16(unsigned short *b, int w, PACKFILE *f)
 
 
 
-/* load_tga:
- *  Loads a TGA file, returning a bitmap structure and storing the
- *  palette data in the specified palette (this should be an array
- *  of at least 256 RGB structures).
- */
-BITMAP *load_tga(AL_CONST char *filename, RGB *pal)
+/* what read_tga_header() found out about an image */
+typedef struct TGA_INFO
 {
-   PACKFILE *f;
-   BITMAP *bmp;
-   ASSERT(filename);
-
-   f = pack_fopen(filename, F_READ);
-   if (!f)
-      return NULL;
-
-   bmp = load_tga_pf(f, pal);
-
-   pack_fclose(f);
-
-   return bmp;
-}
+   int width, height;
+   int bpp;
+   int image_type;
+   int compressed;
+   int top_down;
+} TGA_INFO;
 
 
 
-/* load_tga_pf:
- *  Like load_tga, but starts loading from the current place in the PACKFILE
- *  specified. If successful the offset into the file will be left just after
- *  the image data. If unsuccessful the offset into the file is unspecified,
- *  i.e. you must either reset the offset to some known place or close the
- *  packfile. The packfile is not closed by this function.
+/* read_tga_header:
+ *  Reads the header and the palette of a TGA file. Returns zero on success.
  */
-BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
+static int read_tga_header(PACKFILE *f, RGB *pal, TGA_INFO *info)
 {
    unsigned char image_id[256], image_palette[256][3];
    unsigned char id_length, palette_type, image_type, palette_entry_size;
    unsigned char bpp, descriptor_bits;
    short unsigned int palette_colors;
    short unsigned int image_width, image_height;
-   unsigned int c, i, y, yc;
-   int dest_depth;
+   unsigned int c, i;
    int compressed;
-   BITMAP *bmp;
-   PALETTE tmppal;
-   int want_palette = TRUE;
-   ASSERT(f);
-
-   /* we really need a palette */
-   if (!pal) {
-      want_palette = FALSE;
-      pal = tmppal;
-   }
 
    id_length = pack_getc(f);
    palette_type = pack_getc(f);
@@ -336,7 +309,7 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
       }
    }
    else if (palette_type != 0) {
-      return NULL;
+      return -1;
    }
 
    /* Image type:
@@ -352,7 +325,7 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
    image_type &= 7;
 
    if ((image_type < 1) || (image_type > 3)) {
-      return NULL;
+      return -1;
    }
 
    switch (image_type) {
@@ -360,7 +333,7 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
       case 1:
 	 /* paletted image */
 	 if ((palette_type != 1) || (bpp != 8)) {
-	    return NULL;
+	    return -1;
 	 }
 
 	 for(i=0; i<palette_colors; i++) {
@@ -368,28 +341,20 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
 	     pal[i].g = image_palette[i][1] >> 2;
 	     pal[i].b = image_palette[i][0] >> 2;
 	 }
-
-	 dest_depth = _color_load_depth(8, FALSE);
 	 break;
 
       case 2:
 	 /* truecolor image */
-	 if ((palette_type == 0) && ((bpp == 15) || (bpp == 16))) {
+	 if ((palette_type == 0) && ((bpp == 15) || (bpp == 16)))
 	    bpp = 15;
-	    dest_depth = _color_load_depth(15, FALSE);
-	 }
-	 else if ((palette_type == 0) && ((bpp == 24) || (bpp == 32))) {
-	    dest_depth = _color_load_depth(bpp, (bpp == 32));
-	 }
-	 else {
-	    return NULL;
-	 }
+	 else if ((palette_type != 0) || ((bpp != 24) && (bpp != 32)))
+	    return -1;
 	 break;
 
       case 3:
 	 /* grayscale image */
 	 if ((palette_type != 0) || (bpp != 8)) {
-	    return NULL;
+	    return -1;
 	 }
 
 	 for (i=0; i<256; i++) {
@@ -397,55 +362,126 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
 	     pal[i].g = i>>2;
 	     pal[i].b = i>>2;
 	 }
-
-	 dest_depth = _color_load_depth(bpp, FALSE);
 	 break;
 
       default:
-	 return NULL;
+	 return -1;
    }
 
-   bmp = create_bitmap_ex(bpp, image_width, image_height);
-   if (!bmp) {
+   info->width = image_width;
+   info->height = image_height;
+   info->bpp = bpp;
+   info->image_type = image_type;
+   info->compressed = compressed;
+   info->top_down = (descriptor_bits & 0x20);
+
+   return 0;
+}
+
+
+
+/* read_tga_line:
+ *  Reads one line of a TGA image.
+ */
+static void read_tga_line(PACKFILE *f, AL_CONST TGA_INFO *info, unsigned char *line)
+{
+   switch (info->image_type) {
+
+      case 1:
+      case 3:
+	 if (info->compressed)
+	    rle_tga_read8(line, info->width, f);
+	 else
+	    raw_tga_read8(line, info->width, f);
+	 break;
+
+      case 2:
+	 if (info->bpp == 32) {
+	    if (info->compressed)
+	       rle_tga_read32((unsigned int *)line, info->width, f);
+	    else
+	       raw_tga_read32((unsigned int *)line, info->width, f);
+	 }
+	 else if (info->bpp == 24) {
+	    if (info->compressed)
+	       rle_tga_read24(line, info->width, f);
+	    else
+	       raw_tga_read24(line, info->width, f);
+	 }
+	 else {
+	    if (info->compressed)
+	       rle_tga_read16((unsigned short *)line, info->width, f);
+	    else
+	       raw_tga_read16((unsigned short *)line, info->width, f);
+	 }
+	 break;
+   }
+}
+
+
+
+/* load_tga:
+ *  Loads a TGA file, returning a bitmap structure and storing the
+ *  palette data in the specified palette (this should be an array
+ *  of at least 256 RGB structures).
+ */
+BITMAP *load_tga(AL_CONST char *filename, RGB *pal)
+{
+   PACKFILE *f;
+   BITMAP *bmp;
+   ASSERT(filename);
+
+   f = pack_fopen(filename, F_READ);
+   if (!f)
       return NULL;
+
+   bmp = load_tga_pf(f, pal);
+
+   pack_fclose(f);
+
+   return bmp;
+}
+
+
+
+/* load_tga_pf:
+ *  Like load_tga, but starts loading from the current place in the PACKFILE
+ *  specified. If successful the offset into the file will be left just after
+ *  the image data. If unsuccessful the offset into the file is unspecified,
+ *  i.e. you must either reset the offset to some known place or close the
+ *  packfile. The packfile is not closed by this function.
+ */
+BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
+{
+   TGA_INFO info;
+   unsigned int y, yc;
+   int dest_depth;
+   BITMAP *bmp;
+   PALETTE tmppal;
+   int want_palette = TRUE;
+   ASSERT(f);
+
+   /* we really need a palette */
+   if (!pal) {
+      want_palette = FALSE;
+      pal = tmppal;
    }
 
-   *allegro_errno = 0;
+   if (read_tga_header(f, pal, &info) != 0)
+      return NULL;
 
-   for (y=image_height; y; y--) {
-      yc = (descriptor_bits & 0x20) ? image_height-y : y-1;
+   dest_depth = _color_load_depth(info.bpp, (info.bpp == 32));
 
-      switch (image_type) {
+   bmp = create_bitmap_ex(info.bpp, info.width, info.height);
+   if (!bmp) {
+      return NULL;
+   }
 
-	 case 1:
-	 case 3:
-	    if (compressed)
-	       rle_tga_read8(bmp->line[yc], image_width, f);
-	    else
-	       raw_tga_read8(bmp->line[yc], image_width, f);
-	    break;
+   *allegro_errno = 0;
 
-	 case 2:
-	    if (bpp == 32) {
-	       if (compressed)
-		  rle_tga_read32((unsigned int *)bmp->line[yc], image_width, f);
-	       else
-		  raw_tga_read32((unsigned int *)bmp->line[yc], image_width, f);
-	    }
-	    else if (bpp == 24) {
-	       if (compressed)
-		  rle_tga_read24(bmp->line[yc], image_width, f);
-	       else
-		  raw_tga_read24(bmp->line[yc], image_width, f);
-	    }
-	    else {
-	       if (compressed)
-		  rle_tga_read16((unsigned short *)bmp->line[yc], image_width, f);
-	       else
-		  raw_tga_read16((unsigned short *)bmp->line[yc], image_width, f);
-	    }
-	    break;
-      }
+   for (y=info.height; y; y--) {
+      yc = (info.top_down) ? info.height-y : y-1;
+      read_tga_line(f, &info, bmp->line[yc]);
    }
 
    if (*allegro_errno) {
@@ -453,16 +489,16 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
       return NULL;
    }
 
-   if (dest_depth != bpp) {
+   if (dest_depth != info.bpp) {
       /* restore original palette except if it comes from the bitmap */
-      if ((bpp != 8) && (!want_palette))
+      if ((info.bpp != 8) && (!want_palette))
 	 pal = NULL;
 
       bmp = _fixup_loaded_bitmap(bmp, pal, dest_depth);
    }
    
    /* construct a fake palette if 8-bit mode is not involved */
-   if ((bpp != 8) && (dest_depth != 8) && want_palette)
+   if ((info.bpp != 8) && (dest_depth != 8) && want_palette)
       generate_332_palette(pal);
       
    return bmp;
@@ -470,6 +506,90 @@ BITMAP *load_tga_pf(PACKFILE *f, RGB *pal)
 
 
 
+/* load_tga_lines:
+ *  Reads a TGA file a line at a time, see load_bitmap_lines().
+ */
+int load_tga_lines(AL_CONST char *filename, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   PACKFILE *f;
+   int ret;
+   ASSERT(filename);
+
+   f = pack_fopen(filename, F_READ);
+   if (!f)
+      return -1;
+
+   ret = load_tga_lines_pf(f, pal, callback, dp);
+
+   pack_fclose(f);
+
+   return ret;
+}
+
+
+
+/* load_tga_lines_pf:
+ *  Like load_tga_lines, but starts reading from the current place in the
+ *  PACKFILE specified. Only one line of the image is held in memory.
+ */
+int load_tga_lines_pf(PACKFILE *f, RGB *pal, int (*callback)(BITMAP *line, int y, int h, void *dp), void *dp)
+{
+   TGA_INFO info;
+   BITMAP *buf, *line;
+   PALETTE tmppal;
+   int want_palette = TRUE;
+   int y, ret;
+   ASSERT(f);
+   ASSERT(callback);
+
+   /* we really need a palette */
+   if (!pal) {
+      want_palette = FALSE;
+      pal = tmppal;
+   }
+
+   if (read_tga_header(f, pal, &info) != 0)
+      return -1;
+
+   /* construct a fake palette if 8-bit mode is not involved */
+   if ((info.bpp != 8) && want_palette)
+      generate_332_palette(pal);
+
+   /* a run may carry on past the end of a line, so leave room for one */
+   buf = create_bitmap_ex(info.bpp, info.width + 128, 1);
+   if (!buf)
+      return -1;
+
+   line = create_sub_bitmap(buf, 0, 0, info.width, 1);
+   if (!line) {
+      destroy_bitmap(buf);
+      return -1;
+   }
+
+   *allegro_errno = 0;
+   ret = 0;
+
+   for (y=info.height; y; y--) {
+      read_tga_line(f, &info, line->line[0]);
+
+      if (*allegro_errno) {
+	 ret = -1;
+	 break;
+      }
+
+      ret = callback(line, (info.top_down) ? info.height-y : y-1, info.height, dp);
+      if (ret)
+	 break;
+   }
+
+   destroy_bitmap(line);
+   destroy_bitmap(buf);
+
+   return ret;
+}
+
+
+
 /* save_tga:
  *  Writes a bitmap into a TGA file, using the specified palette (this
  *  should be an array of at least 256 RGB structures).
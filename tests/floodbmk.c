@@ -0,0 +1,134 @@
+/*         ______   ___    ___
+ *        /\  _  \ /\_ \  /\_ \
+ *        \ \ \L\ \\//\ \ \//\ \      __     __   _ __   ___
+ *         \ \  __ \ \ \ \  \ \ \   /'__`\ /'_ `\/\`'__\/ __`\
+ *          \ \ \/\ \ \_\ \_ \_\ \_/\  __//\ \L\ \ \ \//\ \L\ \
+ *           \ \_\ \_\/\____\/\____\ \____\ \____ \ \_\\ \____/
+ *            \/_/\/_/\/____/\/____/\/____/\/___L\ \/_/ \/___/
+ *                                           /\____/
+ *                                           \_/__/
+ *
+ *      Floodfill benchmark: fills labyrinths drawn on large memory bitmaps.
+ *
+ *      Usage: floodbmk [size [depth]]
+ *
+ *      See readme.txt for copyright information.
+ */
+
+#define ALLEGRO_USE_CONSOLE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "allegro.h"
+
+
+
+/* draw_labyrinth:
+ *  Draws a perfect maze with one pixel wide corridors, so that every
+ *  corridor is reachable from every other one and a single floodfill has
+ *  to turn every corner in the bitmap. Uses the binary tree algorithm,
+ *  which needs no memory: each cell opens either to the north or the east.
+ */
+static void draw_labyrinth(BITMAP *bmp, int wall, int floor)
+{
+   int cx, cy, cw, ch;
+
+   clear_to_color(bmp, wall);
+
+   cw = (bmp->w - 1) / 2;
+   ch = (bmp->h - 1) / 2;
+
+   for (cy=0; cy<ch; cy++) {
+      for (cx=0; cx<cw; cx++) {
+	 putpixel(bmp, cx*2+1, cy*2+1, floor);
+
+	 if ((cy == 0) && (cx == cw-1))
+	    continue;
+
+	 if ((cy == 0) || ((cx < cw-1) && (rand() & 1)))
+	    putpixel(bmp, cx*2+2, cy*2+1, floor);
+	 else
+	    putpixel(bmp, cx*2+1, cy*2, floor);
+      }
+   }
+}
+
+
+
+/* time_fill:
+ *  Returns how many seconds a floodfill from the first corridor takes.
+ */
+static double time_fill(BITMAP *bmp, int color)
+{
+   clock_t start = clock();
+
+   floodfill(bmp, 1, 1, color);
+
+   return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+   BITMAP *bmp, *pattern;
+   int size = 8192;
+   int depth = 8;
+   int wall, floor, fill;
+
+   if (argc > 1)
+      size = atoi(argv[1]);
+
+   if (argc > 2)
+      depth = atoi(argv[2]);
+
+   if (install_allegro(SYSTEM_NONE, &errno, atexit) != 0)
+      return 1;
+
+   set_color_depth(depth);
+   select_palette(default_palette);
+
+   bmp = create_bitmap(size, size);
+   pattern = create_bitmap(8, 8);
+   if ((!bmp) || (!pattern)) {
+      printf("Not enough memory for a %dx%d bitmap\n", size, size);
+      return 1;
+   }
+
+   wall = makecol(255, 255, 255);
+   floor = makecol(0, 0, 0);
+   fill = makecol(255, 0, 0);
+
+   srand(1);
+   draw_labyrinth(bmp, wall, floor);
+
+   printf("%dx%d labyrinth, %d bpp\n", size, size, depth);
+   printf("solid fill:   %.3f s\n", time_fill(bmp, fill));
+
+   /* patterned fills can't rely on the fill color to tell which pixels
+    * have been done, so they go through the slow segment list algorithm
+    */
+   if (size > 2048) {
+      printf("pattern fill: skipped, use a size of 2048 or less\n");
+      destroy_bitmap(pattern);
+      destroy_bitmap(bmp);
+      return 0;
+   }
+
+   srand(1);
+   draw_labyrinth(bmp, wall, floor);
+
+   clear_to_color(pattern, fill);
+   drawing_mode(DRAW_MODE_COPY_PATTERN, pattern, 0, 0);
+   printf("pattern fill: %.3f s\n", time_fill(bmp, fill));
+   solid_mode();
+
+   destroy_bitmap(pattern);
+   destroy_bitmap(bmp);
+
+   return 0;
+}
+
+END_OF_MAIN()